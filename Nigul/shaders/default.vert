@@ -1,8 +1,7 @@
 #version 460 core
 
 layout (location = 0) in vec3 aPos; // Positions/Coordinates
-layout (location = 1) in vec3 aNormal; // Normals (not necessarily normalized)
-layout (location = 2) in vec3 aColor; // Colors
+layout (location = 1) in vec3 aNormal; // Normals (not necessarily normalized), xy only when octNormals is set
 layout (location = 3) in vec2 aTex; // Texture Coordinates
 
 out vec3 crntPos; // Outputs the current position for the Fragment Shader
@@ -11,23 +10,33 @@ out vec3 color; // Outputs the color for the Fragment Shader
 out vec2 texCoord; // Outputs the texture coordinates to the Fragment Shader
 
 uniform mat4 camMatrix; // Imports the camera matrix from the main function
-uniform mat4 model;
+uniform mat4 model; // Includes the dequantization of compact positions
+uniform bool octNormals;
 
-#define MAX_LIGHTS 4
-uniform mat4 lightProjectionMatrixes[MAX_LIGHTS];
-out vec4 fragPositionLights[MAX_LIGHTS];
+// The depth prepass computes positions the same way, so the main view can test its depth with GL_EQUAL
+invariant gl_Position;
+
+#include "gpuScene.glsl"
+#include "octahedral.glsl"
+layout(std430, binding = 3) readonly buffer Draws { DrawData draws[]; };
+uniform bool drawFromBuffers;
+flat out uint materialIndex;
 
 void main()
 {
-	crntPos = vec3(model * vec4(aPos, 1.0f));
-	Normal = aNormal; // Assigns the normal from the Vertex Data to "Normal"
-	color = aColor; // Assigns the colors from the Vertex Data to "color"
-	texCoord = aTex; // Assigns the texture coordinates from the Vertex Data to "texCoord"
-	for (int i = 0; i < MAX_LIGHTS; i++)
-	{
-		fragPositionLights[i] = lightProjectionMatrixes[i] * vec4(crntPos, 1.0);
+	mat4 modelMatrix = model;
+	bool octEncoded = octNormals;
+	materialIndex = 0u;
+	if (drawFromBuffers) {
+		modelMatrix = draws[gl_BaseInstance].model;
+		octEncoded = draws[gl_BaseInstance].octNormals != 0u;
+		materialIndex = draws[gl_BaseInstance].material;
 	}
-	
+
+	crntPos = vec3(modelMatrix * vec4(aPos, 1.0f));
+	Normal = octEncoded ? octDecode(aNormal.xy) : aNormal; // Assigns the normal from the Vertex Data to "Normal"
+	color = vec3(1.0f); // Vertex colors are not imported, they are always white
+	texCoord = aTex; // Assigns the texture coordinates from the Vertex Data to "texCoord"
 	// Outputs the positions/coordinates of all vertices
 	gl_Position = camMatrix * vec4(crntPos, 1.0);
 }
\ No newline at end of file
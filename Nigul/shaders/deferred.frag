@@ -0,0 +1,50 @@
+#version 460 core
+
+// Lighting pass of the deferred path (see DeferredShading): shades the G-buffer once per pixel
+// with the same lights, clusters and BRDF as default.frag
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedoMetallic;
+uniform sampler2D gNormalRoughness;
+uniform sampler2D gEmissive;
+uniform sampler2D gDepth;
+uniform mat4 inverseCamMatrix;
+
+// Rebuilt from the depth, the lights shade this position as default.frag shades its input
+vec3 crntPos;
+
+#include "lighting.glsl"
+#include "octahedral.glsl"
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, texel, 0).r;
+	if (depth >= 1.0)
+		discard; // Nothing was drawn, the clear color and depth stay
+	gl_FragDepth = depth; // For the forward pass of blended primitives and the skybox
+
+	vec4 position = inverseCamMatrix * vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	crntPos = position.xyz / position.w;
+	vec4 albedoMetallic = texelFetch(gAlbedoMetallic, texel, 0);
+	vec4 normalRoughness = texelFetch(gNormalRoughness, texel, 0);
+	Surface surface;
+	surface.color = degamma(albedoMetallic.rgb);
+	surface.metalness = albedoMetallic.a;
+	surface.normal = octDecode(normalRoughness.xy);
+	surface.roughness = normalRoughness.z;
+	surface.occlusion = normalRoughness.w;
+	surface.emissive = texelFetch(gEmissive, texel, 0).rgb;
+
+	uint clusterCount;
+	vec3 light = lightSurface(surface, clusterCount) + surface.emissive;
+
+	// default.frag multiplies by the sampled color again here, the base color only differs with a color factor
+	vec3 color = light * surface.color;
+	if (clusteredLights && clusterHeatmap)
+		color = mix(color, heatmap(clusterCount), 0.7);
+
+	FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 460 core
+#extension GL_ARB_bindless_texture : enable
+
+// The G-buffer of the deferred path (see DeferredShading), lit later by deferred.frag
+layout(location = 0) out vec4 gAlbedoMetallic; // Base color in gamma space, metalness
+layout(location = 1) out vec4 gNormalRoughness; // Octahedral normal, roughness, occlusion
+layout(location = 2) out vec4 gEmissive; // Linear
+
+in vec3 crntPos; 
+in vec3 Normal; 
+in vec3 color; 
+in vec2 texCoord;
+flat in uint materialIndex;
+
+#include "material.glsl"
+#include "octahedral.glsl"
+
+// Same surface as default.frag computes, once
+void main()
+{
+	vec4 colorTexel;
+	Surface surface = readSurface(colorTexel);
+
+	gAlbedoMetallic = vec4(pow(clamp(surface.color, 0.0, 1.0), vec3(1.0 / 2.2)), surface.metalness);
+	gNormalRoughness = vec4(octEncode(surface.normal), surface.roughness, surface.occlusion);
+	gEmissive = vec4(surface.emissive, 1.0);
+}
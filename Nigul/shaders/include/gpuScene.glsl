@@ -0,0 +1,32 @@
+// Records of the GpuScene storage buffers, the same std430 layout as GpuScene::DrawData and GpuScene::MaterialData
+
+// Per draw data of the GpuScene, multi-draws pass the item as their base instance
+struct DrawData {
+	mat4 model; // Includes the dequantization of compact positions
+	uint material;
+	uint octNormals;
+	uint count;
+	uint firstIndex;
+	int baseVertex;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+// Where a material texture lives: a resident bindless handle, a layer of a texture array (see TexturePool)
+// or, for textures that fit in neither, the sampler Material::bind sets
+struct MaterialTexture {
+	uvec2 handle;
+	int array; // -1 without a texture, -2 when it is bound to its sampler
+	int layer;
+};
+
+// Factors and textures of every material of the GpuScene, used instead of the uniforms when drawing from its buffers
+struct MaterialData {
+	vec4 baseColorFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float pad0;
+	float pad1;
+	MaterialTexture textures[5]; // In the order of the material texture units
+};
@@ -0,0 +1,274 @@
+// Lights of the scene shading a Surface, by the forward pass (default.frag) and the deferred lighting pass
+// (deferred.frag). The including stage declares crntPos, the world position of the fragment.
+#include "surface.glsl"
+
+// Scene uniforms
+uniform vec3 camPos;
+
+// Ambient light
+uniform float ambientLight;
+uniform vec3 ambientColor;
+uniform float shadowDarkness;
+uniform float reflectionFactor;
+
+uniform samplerCube skybox;
+uniform bool hasSkybox;
+
+// Math constants
+#define RECIPROCAL_PI 0.3183098861837697
+#define PI 3.141592653589793
+
+// Every light of the model (see LightBuffer), numLights of them
+struct GpuLight {
+	mat4 shadowMatrix; // World to shadow map clip space, directional lights only
+	vec3 position; // Direction towards the light for directional lights
+	int type;
+	vec3 color;
+	float intensity;
+	vec3 direction;
+	float range;
+	float attenuation;
+	float innerConeAngle;
+	float outerConeAngle;
+	float shadowBias;
+	int enabled;
+	int shadowMap; // Index in shadowMaps, -1 without a shadow
+	int pad0;
+	int pad1;
+};
+layout(std430, binding = 7) readonly buffer Lights { GpuLight lights[]; };
+uniform int numLights;
+
+#define MAX_SHADOW_MAPS 4
+uniform sampler2D shadowMaps[MAX_SHADOW_MAPS];
+
+// Lights of each cluster of the view (see LightClusters), the list after the last cluster reaches every fragment
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define NUM_CLUSTERS (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define MAX_CLUSTER_LIGHTS 256
+layout(std430, binding = 8) readonly buffer ClusterCounts { uint clusterCounts[]; };
+layout(std430, binding = 9) readonly buffer ClusterLights { uint clusterLights[]; };
+uniform bool clusteredLights; // Else every light is shaded
+uniform bool clusterHeatmap;
+uniform vec2 clusterTileSize; // In pixels
+uniform mat4 clusterView;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+
+// PBR functions
+// Fresnel and colorized fresnel
+vec3 F_Schlick(float VoH, vec3 f0)
+{
+	float f = pow(1.0 - VoH, 5.0);
+	return f0 + (vec3(1.0) - f0) * f;
+}
+
+float F_Schlick(float VoH, float f0)
+{
+	float f = pow(1.0 - VoH, 5.0);
+	return f0 + (1.0 - f0) * f;
+}
+
+// GGX distribution
+float D_GGX (float NoH, float linearRoughness)
+{
+	float a2 = linearRoughness * linearRoughness;
+	float f = (NoH * NoH) * (a2 - 1.0) + 1.0;
+	return a2 / (PI * f * f);
+}
+
+// Smith's shadowing-masking function and GGX
+float GGX(float NdotV, float k){
+	return NdotV / (NdotV * (1.0 - k) + k);
+}
+	
+float G_Smith( float NdotV, float NdotL, float roughness)
+{
+	float k = pow(roughness + 1.0, 2.0) / 8.0;
+	return GGX(NdotL, k) * GGX(NdotV, k);
+}
+
+
+// Burley diffuse
+float diffuseBurley( float NoV, float NoL, float LoH, float roughness)
+{
+        float f90 = 0.5 + 2.0 * roughness * roughness * LoH * LoH;
+        float lightScatter = F_Schlick(NoL, f90);
+        float viewScatter  = F_Schlick(NoV, f90);
+        return lightScatter * viewScatter * RECIPROCAL_PI;
+}
+
+// BRDF specular
+vec3 specularBRDF( float roughness, vec3 f0, float NoH, float NoV, float NoL, float LoH ){
+	float a = roughness * roughness;
+
+	// Normal Distribution Function
+	float D = D_GGX( NoH, a );
+
+	// Fresnel Function
+	vec3 F = F_Schlick( LoH, f0 );
+
+	// Visibility Function (shadowing/masking)
+	float G = G_Smith( NoV, NoL, roughness );
+		
+	// Norm factor
+	vec3 spec = D * G * F;
+	spec /= (4.0 * NoL * NoV + 1e-6);
+
+	return spec;
+}
+
+float computeShadow(int index, vec3 n, vec3 l){
+	float shadow = 0.0;
+	vec4 fragPosLight = lights[index].shadowMatrix * vec4(crntPos, 1.0);
+	vec3 fragPos = fragPosLight.xyz / fragPosLight.w;
+	if (fragPos.z > 1.0)
+		return 1.0;
+	fragPos = fragPos * 0.5 + 0.5;
+	float currentDepth = fragPos.z;
+	float bias = mix(lights[index].shadowBias, 0.0, dot(n, -l));
+	// bias = max(bias * (1.0f - dot(n, l)), 0.000001f);
+
+	// Smooth the shadow
+	int sampleRadius = 4;
+	// The light loop is the same for every fragment, the index is dynamically uniform
+	int shadowMap = lights[index].shadowMap;
+	vec2 pixelSize = 1.0 / textureSize(shadowMaps[shadowMap], 0);
+	for (int x = -sampleRadius; x <= sampleRadius; ++x) {
+		for (int y = -sampleRadius; y <= sampleRadius; ++y) {
+			vec2 offset = vec2(x, y) * pixelSize;
+			float closestDepth = texture(shadowMaps[shadowMap], fragPos.xy + offset).r;
+			if (currentDepth > (closestDepth + bias)) {
+				shadow += 1.0f * shadowDarkness;
+			}
+		}
+	}
+	shadow /= pow((sampleRadius * 2 + 1), 2);
+	return 1 - shadow;
+}
+
+// Smooth falloff to zero at the range of a light, which is also where the clusters stop listing it
+float rangeFalloff(int index, float dist)
+{
+	float range = lights[index].range;
+	if (range <= 0.0)
+		return 1.0; // Infinite
+	float ratio = dist / range;
+	float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+	return window * window;
+}
+
+// Diffuse and specular of the surface lit from direction l
+vec3 surfaceBRDF(Surface surface, vec3 l)
+{
+	vec3 n = surface.normal;
+	vec3 v = normalize(camPos - crntPos);
+	vec3 h = normalize(l + v);
+
+	float NoL = max(dot(n, l), 0.0);
+	float NoV = max(dot(n, v), 0.0);
+	float NoH = max(dot(n, h), 0.0);
+	float LoH = max(dot(l, h), 0.0);
+
+	// diffuse lighting
+	vec3 diffuseColor = (1.0 - surface.metalness) * surface.color;
+	vec3 diffuse = diffuseColor * diffuseBurley(NoV, NoL, LoH, surface.roughness);
+
+	// specular lighting
+	vec3 f0 = mix(vec3(0.5), surface.color, surface.metalness);
+	vec3 specular = specularBRDF(surface.roughness, f0, NoH, NoV, NoL, LoH);
+	return diffuse + specular;
+}
+
+vec3 pointLight(int index, Surface surface)
+{
+	// intensity of light with respect to distance
+	float dist = length(lights[index].position - crntPos);
+	float inten = rangeFalloff(index, dist) / (lights[index].attenuation * dist * dist + 1.0f);
+	vec3 l = normalize(lights[index].position - crntPos);
+	return surfaceBRDF(surface, l) * lights[index].color * lights[index].intensity * inten;
+}
+
+vec3 directLight(int index, Surface surface)
+{
+	vec3 l = normalize(lights[index].position);
+
+	// compute shadow
+	float shadow = 1.0f;
+	if (lights[index].shadowMap >= 0)
+		shadow = computeShadow(index, surface.normal, l);
+	vec3 light = surfaceBRDF(surface, l) * lights[index].color * lights[index].intensity * shadow * surface.occlusion;
+
+	if (hasSkybox) {
+		vec3 r = reflect(normalize(camPos - crntPos), surface.normal);
+		vec3 reflection = degamma(textureLod(skybox, r, surface.roughness * 4.0).rgb);
+		light = mix(light, reflection, surface.metalness * reflectionFactor);
+	}
+	return light;
+}
+
+vec3 spotLight(int index, Surface surface)
+{
+	// calculates the intensity of the crntPos based on its angle to the center of the light cone
+	vec3 l = normalize(lights[index].position - crntPos);
+	float angle = dot(lights[index].direction, l);
+	float inten = 1 - clamp((angle - lights[index].outerConeAngle) / (lights[index].innerConeAngle - lights[index].outerConeAngle), 0.0f, 1.0f);
+	inten *= rangeFalloff(index, length(lights[index].position - crntPos));
+	return surfaceBRDF(surface, l) * lights[index].color * lights[index].intensity * inten;
+}
+
+vec3 shadeLight(int index, Surface surface)
+{
+	if (lights[index].enabled == 0)
+		return vec3(0.0);
+	switch (lights[index].type) {
+		case 0:
+			return pointLight(index, surface);
+		case 1:
+			return spotLight(index, surface);
+		case 2:
+			return directLight(index, surface);
+	}
+	return vec3(0.0);
+}
+
+uint getCluster()
+{
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), uvec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+	float depth = max(-(clusterView * vec4(crntPos, 1.0)).z, 1e-6);
+	uint slice = uint(clamp(log(depth) * clusterDepthScale + clusterDepthBias, 0.0, float(CLUSTERS_Z - 1)));
+	return tile.x + CLUSTERS_X * (tile.y + CLUSTERS_Y * slice);
+}
+
+// Ambient light and every light reaching the fragment, clusterCount is the number of lights of its cluster
+vec3 lightSurface(Surface surface, out uint clusterCount)
+{
+	vec3 light = ambientLight * ambientColor;
+	clusterCount = 0u;
+	if (clusteredLights) {
+		// The shared list first, its loop is the same for every fragment so shadow maps can be indexed
+		uint everywhere = NUM_CLUSTERS * MAX_CLUSTER_LIGHTS;
+		for (uint i = 0u; i < clusterCounts[NUM_CLUSTERS]; i++)
+			light += shadeLight(int(clusterLights[everywhere + i]), surface);
+
+		uint cluster = getCluster();
+		clusterCount = clusterCounts[cluster];
+		for (uint i = 0u; i < clusterCount; i++)
+			light += shadeLight(int(clusterLights[cluster * MAX_CLUSTER_LIGHTS + i]), surface);
+	}
+	else {
+		for (int i = 0; i < numLights; i++)
+			light += shadeLight(i, surface);
+	}
+	return light;
+}
+
+// Dark blue without lights, then blue to green to red up to heatmapLights
+vec3 heatmap(uint count)
+{
+	const float heatmapLights = 32.0;
+	float t = clamp(float(count) / heatmapLights, 0.0, 1.0);
+	return count == 0u ? vec3(0.0, 0.0, 0.3) : mix(mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), min(t * 2.0, 1.0)), vec3(1.0, 0.0, 0.0), max(t * 2.0 - 1.0, 0.0));
+}
@@ -0,0 +1,146 @@
+// Material of the fragment, from the uniforms Material::bind sets or from the GpuScene buffers when drawing from them.
+// The including stage declares crntPos, Normal, texCoord and materialIndex.
+#include "gpuScene.glsl"
+#include "surface.glsl"
+
+// Gets the Texture Units from the main function
+uniform sampler2D albedo;
+uniform sampler2D metallicRoughness; 
+uniform sampler2D emissive;
+uniform sampler2D normalMap;
+uniform sampler2D occlusion;
+
+// Bools to know if the texture is being used
+uniform bool hasColorTexture;
+uniform bool hasMetallicRoughnessTexture;
+uniform bool hasEmissiveTexture;
+uniform bool hasNormalTexture;
+uniform bool hasOcclusionTexture;
+
+// factor for PBR
+uniform float metallicFactor;
+uniform float roughnessFactor;
+uniform vec4 baseColorFactor;
+
+layout(std430, binding = 4) readonly buffer Materials { MaterialData materials[]; };
+uniform bool drawFromBuffers;
+
+#define ALBEDO_SLOT 0
+#define METALLIC_ROUGHNESS_SLOT 1
+#define EMISSIVE_SLOT 2
+#define NORMAL_MAP_SLOT 3
+#define OCCLUSION_SLOT 4
+
+#define MAX_TEXTURE_ARRAYS 16
+uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+
+// Constant indices, the array of a fragment is not dynamically uniform inside a multi-draw
+vec4 sampleArray(int array, vec3 coord)
+{
+	switch (array) {
+		case 0: return texture(textureArrays[0], coord);
+		case 1: return texture(textureArrays[1], coord);
+		case 2: return texture(textureArrays[2], coord);
+		case 3: return texture(textureArrays[3], coord);
+		case 4: return texture(textureArrays[4], coord);
+		case 5: return texture(textureArrays[5], coord);
+		case 6: return texture(textureArrays[6], coord);
+		case 7: return texture(textureArrays[7], coord);
+		case 8: return texture(textureArrays[8], coord);
+		case 9: return texture(textureArrays[9], coord);
+		case 10: return texture(textureArrays[10], coord);
+		case 11: return texture(textureArrays[11], coord);
+		case 12: return texture(textureArrays[12], coord);
+		case 13: return texture(textureArrays[13], coord);
+		case 14: return texture(textureArrays[14], coord);
+		case 15: return texture(textureArrays[15], coord);
+	}
+	return vec4(0.0);
+}
+
+bool hasMaterialTexture(int slot, bool bound)
+{
+	if (!drawFromBuffers)
+		return bound;
+	MaterialTexture slotTexture = materials[materialIndex].textures[slot];
+	return slotTexture.array != -1 || slotTexture.handle != uvec2(0);
+}
+
+vec4 sampleMaterial(int slot, sampler2D bound, vec2 uv)
+{
+	if (!drawFromBuffers)
+		return texture(bound, uv);
+	MaterialTexture slotTexture = materials[materialIndex].textures[slot];
+#ifdef GL_ARB_bindless_texture
+	if (slotTexture.handle != uvec2(0))
+		return texture(sampler2D(slotTexture.handle), uv);
+#endif
+	if (slotTexture.array >= 0)
+		return sampleArray(slotTexture.array, vec3(uv, float(slotTexture.layer)));
+	return texture(bound, uv);
+}
+
+mat3 cotangent_frame(vec3 N, vec3 p, vec2 uv)
+{
+	// get edge vectors of the pixel triangle
+	vec3 dp1 = dFdx( p );
+	vec3 dp2 = dFdy( p );
+	vec2 duv1 = dFdx( uv );
+	vec2 duv2 = dFdy( uv );
+	
+	// solve the linear system
+	vec3 dp2perp = cross( dp2, N );
+	vec3 dp1perp = cross( N, dp1 );
+	vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+	vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+ 
+	// construct a scale-invariant frame 
+	float invmax = inversesqrt( max( dot(T,T), dot(B,B) ) );
+	return mat3( T * invmax, B * invmax, N );
+}
+
+vec3 perturbNormal(vec3 N, vec3 WP, vec2 uv, vec3 normal_pixel)
+{
+	normal_pixel.xy = normal_pixel.xy * 255./127. - 128./127.;
+	// Normal maps are stored as BC5 (two channels), z is rebuilt from the unit length
+	normal_pixel.z = sqrt(max(1.0 - dot(normal_pixel.xy, normal_pixel.xy), 0.0));
+	mat3 TBN = cotangent_frame(N, WP, uv);
+	return normalize(TBN * normal_pixel);
+}
+
+vec3 readNormal()
+{
+	if (hasMaterialTexture(NORMAL_MAP_SLOT, hasNormalTexture))
+		return perturbNormal(Normal, crntPos, texCoord, sampleMaterial(NORMAL_MAP_SLOT, normalMap, texCoord).xyz);
+	return normalize(Normal);
+}
+
+// Samples every texture of the material once, outside of any light loop. colorTexel is the degammaed base color
+// texture alone (zero without one), which default.frag multiplies the light with
+Surface readSurface(out vec4 colorTexel)
+{
+	vec4 colorFactor = drawFromBuffers ? materials[materialIndex].baseColorFactor : baseColorFactor;
+	colorTexel = vec4(0.0f);
+	if (hasMaterialTexture(ALBEDO_SLOT, hasColorTexture)) {
+		colorTexel = sampleMaterial(ALBEDO_SLOT, albedo, texCoord);
+		colorTexel.xyz = degamma(colorTexel.xyz); // Apply degamma to the input color
+	}
+
+	Surface surface;
+	surface.color = colorTexel.rgb * colorFactor.rgb;
+	surface.metalness = drawFromBuffers ? materials[materialIndex].metallicFactor : metallicFactor;
+	surface.roughness = drawFromBuffers ? materials[materialIndex].roughnessFactor : roughnessFactor;
+	if (hasMaterialTexture(METALLIC_ROUGHNESS_SLOT, hasMetallicRoughnessTexture)) {
+		vec4 metallicRoughnessTexel = sampleMaterial(METALLIC_ROUGHNESS_SLOT, metallicRoughness, texCoord);
+		surface.metalness *= metallicRoughnessTexel.b;
+		surface.roughness *= metallicRoughnessTexel.g;
+	}
+	surface.normal = readNormal();
+	surface.occlusion = 1.0;
+	if (hasMaterialTexture(OCCLUSION_SLOT, hasOcclusionTexture))
+		surface.occlusion = sampleMaterial(OCCLUSION_SLOT, occlusion, texCoord).r;
+	surface.emissive = vec3(0.0);
+	if (hasMaterialTexture(EMISSIVE_SLOT, hasEmissiveTexture))
+		surface.emissive = degamma(sampleMaterial(EMISSIVE_SLOT, emissive, texCoord).rgb);
+	return surface;
+}
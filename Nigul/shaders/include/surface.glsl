@@ -0,0 +1,15 @@
+// What the lights need to know of a fragment, read from its material (see material.glsl) or from the G-buffer
+struct Surface {
+	vec3 color; // Linear base color, factor included
+	float metalness;
+	vec3 normal;
+	float roughness;
+	float occlusion;
+	vec3 emissive; // Linear
+};
+
+// Gamma functions
+vec3 degamma(vec3 c)
+{
+	return pow(c,vec3(2.2));
+}
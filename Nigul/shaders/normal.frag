@@ -1,4 +1,5 @@
 #version 460 core
+#extension GL_ARB_bindless_texture : enable
 
 // Outputs colors in RGBA
 out vec4 FragColor;
@@ -7,39 +8,12 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 crntPos; 
 in vec2 texCoord; 
+flat in uint materialIndex;
 
-uniform sampler2D normalMap;
-
-uniform bool hasNormalTexture;
-
-mat3 cotangent_frame(vec3 N, vec3 p, vec2 uv)
-{
-	// get edge vectors of the pixel triangle
-	vec3 dp1 = dFdx( p );
-	vec3 dp2 = dFdy( p );
-	vec2 duv1 = dFdx( uv );
-	vec2 duv2 = dFdy( uv );
-	
-	// solve the linear system
-	vec3 dp2perp = cross( dp2, N );
-	vec3 dp1perp = cross( N, dp1 );
-	vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
-	vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
- 
-	// construct a scale-invariant frame 
-	float invmax = inversesqrt( max( dot(T,T), dot(B,B) ) );
-	return mat3( T * invmax, B * invmax, N );
-}
-
-vec3 perturbNormal(vec3 N, vec3 WP, vec2 uv, vec3 normal_pixel)
-{
-	normal_pixel = normal_pixel * 255./127. - 128./127.;
-	mat3 TBN = cotangent_frame(N, WP, uv);
-	return normalize(TBN * normal_pixel);
-}
+#include "material.glsl"
 
 void main()
 {
-	vec3 n = hasNormalTexture ? perturbNormal(Normal, crntPos, texCoord, texture(normalMap, texCoord).xyz) : normalize(Normal);
+	vec3 n = readNormal();
     FragColor = vec4(n, 1.0f); 
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #version 460 core
 
 layout (location = 0) in vec3 aPos; // Positions/Coordinates
-layout (location = 1) in vec3 aNormal; // Normals (not necessarily normalized)
+layout (location = 1) in vec3 aNormal; // Normals (not necessarily normalized), xy only when octNormals is set
 layout (location = 3) in vec2 aTex; // Texture Coordinates
 
 out vec3 crntPos; // Outputs the current position for the Fragment Shader
@@ -9,12 +9,26 @@ out vec3 Normal; // Outputs the normal for the Fragment Shader
 out vec2 texCoord; // Outputs the texture coordinates to the Fragment Shader
 
 uniform mat4 camMatrix; // Imports the camera matrix from the main function
-uniform mat4 model;
+uniform mat4 model; // Includes the dequantization of compact positions
+uniform bool octNormals;
+
+// Positions computed as in default.vert, whose depth test against this prepass is GL_EQUAL
+invariant gl_Position;
+
+#include "gpuScene.glsl"
+#include "octahedral.glsl"
+layout(std430, binding = 3) readonly buffer Draws { DrawData draws[]; };
+uniform bool drawFromBuffers;
+flat out uint materialIndex;
 
 void main()
 {
-	crntPos = vec3(model * vec4(aPos, 1.0f));
-	Normal = aNormal; // Assigns the normal from the Vertex Data to "Normal"
+	mat4 modelMatrix = drawFromBuffers ? draws[gl_BaseInstance].model : model;
+	bool octEncoded = drawFromBuffers ? draws[gl_BaseInstance].octNormals != 0u : octNormals;
+	materialIndex = drawFromBuffers ? draws[gl_BaseInstance].material : 0u;
+
+	crntPos = vec3(modelMatrix * vec4(aPos, 1.0f));
+	Normal = octEncoded ? octDecode(aNormal.xy) : aNormal; // Assigns the normal from the Vertex Data to "Normal"
 	texCoord = aTex; // Assigns the texture coordinates from the Vertex Data to "texCoord"
 	
 	// Outputs the positions/coordinates of all vertices
@@ -4,7 +4,16 @@ layout (location = 0) in vec3 aPos;
 uniform mat4 camMatrix;
 uniform mat4 model;
 
+// Same position as default.vert, the depth prepass of the main view draws with this shader when it needs no normals
+invariant gl_Position;
+
+#include "gpuScene.glsl"
+layout(std430, binding = 3) readonly buffer Draws { DrawData draws[]; };
+uniform bool drawFromBuffers;
+
 void main()
 {
-    gl_Position = camMatrix * model * vec4(aPos, 1.0);
+    mat4 modelMatrix = drawFromBuffers ? draws[gl_BaseInstance].model : model;
+    vec3 crntPos = vec3(modelMatrix * vec4(aPos, 1.0f));
+    gl_Position = camMatrix * vec4(crntPos, 1.0);
 }
\ No newline at end of file
@@ -1,10 +1,21 @@
 #include"EBO.h"
 
-EBO::EBO(std::vector<GLuint>& indices)
+EBO::EBO(std::vector<GLuint>& indices) : EBO(indices.data(), indices.size())
+{
+}
+
+EBO::EBO(const GLuint* indices, size_t count)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint), indices, GL_STATIC_DRAW);
+}
+
+EBO::EBO(const GLushort* indices, size_t count)
 {
 	glGenBuffers(1, &ID);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLushort), indices, GL_STATIC_DRAW);
 }
 
 void EBO::Bind()
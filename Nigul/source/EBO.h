@@ -19,6 +19,22 @@ public:
      */
     EBO(std::vector<GLuint>& indices);
 
+    /**
+     * @brief Constructs an EBO from indices that are not owned by a vector, uploaded with a single glBufferData.
+     *
+     * @param indices Pointer to the first index.
+     * @param count Number of indices.
+     */
+    EBO(const GLuint* indices, size_t count);
+
+    /**
+     * @brief Constructs an EBO holding 16 bit indices.
+     *
+     * @param indices Pointer to the first index.
+     * @param count Number of indices.
+     */
+    EBO(const GLushort* indices, size_t count);
+
     /**
      * @brief Binds the EBO to the current OpenGL context.
      */
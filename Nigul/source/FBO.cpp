@@ -9,10 +9,13 @@ FBO::FBO(int width, int height, int slot, FBO_TYPE fboType) : width(width), heig
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex->ID, 0);
 
     } else if (FBO_ONE_COLOR <= fboType && fboType <= FBO_FOUR_COLOR) {
+        std::vector<GLenum> drawBuffers;
         for (int i = 0; i < fboType; i++) {
             colorTextures.push_back(Texture::createColorTexture(width, height, slot + i));
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorTextures[i]->ID, 0);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
         }
+        glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
 
         glGenRenderbuffers(1, &depthBuffer);
         glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
@@ -25,8 +28,9 @@ FBO::FBO(int width, int height, int slot, FBO_TYPE fboType) : width(width), heig
 
         glGenRenderbuffers(1, &depthBuffer);
         glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-        glRenderbufferStorageMultisample(GL_RENDERBUFFER, SAMPLES, GL_DEPTH24_STENCIL8, width, height);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        // Same format as the depth textures, so the depth prepass drawn on it resolves into one (see Renderer::renderDepthPrepass)
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, SAMPLES, GL_DEPTH_COMPONENT32F, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
 	}
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
@@ -35,6 +39,46 @@ FBO::FBO(int width, int height, int slot, FBO_TYPE fboType) : width(width), heig
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+FBO::FBO(int width, int height, int slot, const std::vector<GLenum>& colorFormats) : width(width), height(height) {
+    glGenFramebuffers(1, &ID);
+    glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+    // First, creating the depth texture turns the draw buffers off
+    depthTex = Texture::createShadowMapTexture(width, height, slot + static_cast<int>(colorFormats.size()));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex->ID, 0);
+
+    std::vector<GLenum> drawBuffers;
+    for (size_t i = 0; i < colorFormats.size(); i++) {
+        GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        colorTextures.push_back(Texture::createColorTexture(width, height, slot + static_cast<int>(i), colorFormats[i]));
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, colorTextures[i]->ID, 0);
+        drawBuffers.push_back(attachment);
+    }
+    glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+FBO::FBO(int width, int height, int slot, GLenum colorFormat, GLuint sharedDepthBuffer) : width(width), height(height) {
+    glGenFramebuffers(1, &ID);
+    glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+    colorTextures.push_back(Texture::createMultisampleTexture(width, height, slot, colorFormat));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, colorTextures[0]->ID, 0);
+
+    // Not kept in depthBuffer, the FBO it comes from deletes it
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sharedDepthBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 FBO::~FBO() {
     glDeleteRenderbuffers(1, &depthBuffer);
     glDeleteFramebuffers(1, &ID);
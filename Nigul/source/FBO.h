@@ -16,13 +16,17 @@ enum FBO_TYPE {
 class FBO {
 public:
     FBO(int width, int height, int slot, FBO_TYPE fboType);
+    // One color texture per format from slot on and a depth texture after them that can be sampled, for G-buffers
+    FBO(int width, int height, int slot, const std::vector<GLenum>& colorFormats);
+    // One multisample color texture on the depth renderbuffer of an FBO_MULTISAMPLE, to draw other targets than its color against the same depth
+    FBO(int width, int height, int slot, GLenum colorFormat, GLuint sharedDepthBuffer);
     ~FBO();
 
     void bind();
     void unbind();
 
     GLuint ID;
-    GLuint depthBuffer;
+    GLuint depthBuffer = 0;
 
     std::vector<std::unique_ptr<Texture>> colorTextures = {};
     std::unique_ptr<Texture> depthTex;
@@ -1,4 +1,6 @@
 #include "gui.h"
+#include "textureStreamer.h"
+#include "textureCache.h"
 
 bool GUI::input(Model* model) {
 	bool inputApplied = false;
@@ -94,9 +96,39 @@ bool GUI::input(Model* model) {
 		firstClick = true;
 	}
 
+	// Click to select, unless the click is for a window or the gizmo
+	if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && isMouseAvaliable() && !ImGuizmo::IsOver() && !ImGuizmo::IsUsing()) {
+		inputApplied = true;
+		pick(model);
+	}
+
 	return inputApplied;
 }
 
+Node* GUI::pick(Model* model) {
+	ImGuiIO& io = ImGui::GetIO();
+	Camera* camera = model->getMainCamera();
+	if (!camera || io.DisplaySize.x <= 0.0f || io.DisplaySize.y <= 0.0f)
+		return nullptr;
+
+	// Unprojects the cursor on the near and far planes
+	float x = 2.0f * io.MousePos.x / io.DisplaySize.x - 1.0f;
+	float y = 1.0f - 2.0f * io.MousePos.y / io.DisplaySize.y;
+	glm::mat4 inverseCamera = glm::inverse(camera->cameraMatrix);
+	glm::vec4 nearPoint = inverseCamera * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseCamera * glm::vec4(x, y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+	SceneBVH::RayHit hit;
+	if (!model->getBVH().raycast(origin, direction, hit)) {
+		model->selectedNodeId = 0;
+		return nullptr;
+	}
+	model->selectedNodeId = hit.node->id;
+	return hit.node;
+}
+
 bool GUI::displayGizmo(Model* model)
 {
 	if (!model)
@@ -273,7 +305,7 @@ void GUI::displayLight(Model* model) {
 		}
 	}
 
-	if (showShadowMap) {
+	if (showShadowMap && light->shadowMap) {
 		GLuint textureID = light->shadowMap->depthTex->ID;
 		ImGui::Begin("Shadow Map", &showShadowMap);
 		ImTextureID texID = reinterpret_cast<void*>(static_cast<intptr_t>(textureID));
@@ -329,6 +361,14 @@ void GUI::displayActions(SceneManager* scene) {
 		ImGui::EndCombo();
 	}
 
+	if (Model* pending = scene->getPendingModel()) {
+		std::string label = std::string(Model::getLoadStageName(pending->loadStage)) + " " + scene->pendingModel;
+		ImGui::ProgressBar(pending->getLoadProgress(), ImVec2(-FLT_MIN, 0.0f), label.c_str());
+		if (ImGui::Button("Cancel loading")) {
+			scene->cancelLoad();
+		}
+	}
+
 	Model* model = scene->getMainModel();
 	if (model) {
 		ImGui::SeparatorText("Add nodes");
@@ -359,12 +399,69 @@ void GUI::displayRender(Model* model, Renderer* renderer) {
 	model->hasShadowDarknessChanged = ImGui::SliderFloat("Shadow darkness", &model->shadowDarkness, 0.0f, 1.0f);
 	model->hasReflectionFactorChanged = ImGui::SliderFloat("Reflection factor", &model->reflectionFactor, 0.0f, 1.0f);
 
+	ImGui::SeparatorText("Culling");
+	RenderQueue& queue = renderer->renderQueue;
+	ImGui::Checkbox("Frustum culling", &queue.frustumCulling);
+	ImGui::Text("Main view: %d drawn, %d culled", queue.numDrawn[VIEW_MAIN], queue.numCulled[VIEW_MAIN]);
+	if (renderer->renderQueue.hasView(VIEW_DEPTH))
+		ImGui::Text("Depth prepass: %d drawn, %d culled", queue.numDrawn[VIEW_DEPTH], queue.numCulled[VIEW_DEPTH]);
+	for (auto& light : model->lodLight) {
+		int view = VIEW_SHADOW + light->shadowIndex;
+		if (light->shadowMap)
+			ImGui::Text("Shadow map %d: %d drawn, %d culled", light->shadowIndex, queue.numDrawn[view], queue.numCulled[view]);
+	}
+	OcclusionCuller& occlusion = *renderer->occlusionCuller;
+	ImGui::Checkbox("Occlusion culling", &occlusion.enabled);
+	if (occlusion.enabled)
+		ImGui::Text("Occlusion: %d tested, %d occluded, %.3f ms on the GPU", occlusion.numTested, occlusion.numOccluded, occlusion.passTime);
+	SceneBVH& bvh = model->getBVH();
+	ImGui::Text("BVH: %zu nodes over %zu primitives, built in %.2f ms", bvh.getNumNodes(), bvh.getItems().size(), bvh.buildTime);
+	ImGui::Text("Last refit %.3f ms, last pick %.3f ms", bvh.refitTime, bvh.rayTime);
+
+	GpuScene& gpuScene = *renderer->gpuScene;
+	if (gpuScene.isActive())
+		ImGui::Text("Merged geometry: %d draws in %d multi-draws, %zu KB", gpuScene.numDraws, gpuScene.numMultiDraws, model->geometryPool.getMemorySize() / 1024);
+	ImGui::Text("Uniforms: %d uploads, %d unchanged skipped", Shader::numUploads, Shader::numSkippedUploads);
+	ImGui::Text("Lights: %d in the light buffer, %d uploaded since the start", renderer->lightBuffer->getNumLights(), renderer->lightBuffer->numUploadedLights);
+
+	ImGui::SeparatorText("Shading");
+	ImGui::Checkbox("Deferred shading (no MSAA)", &renderer->deferredShading->enabled);
+	ImGui::Checkbox("Depth prepass (main view shades with GL_EQUAL)", &renderer->isDepthPrepassEnabled);
+	ImGui::SeparatorText("Clustered lights");
+	LightClusters& clusters = *renderer->lightClusters;
+	ImGui::Checkbox("Clustered shading", &clusters.enabled);
+	ImGui::Checkbox("Light count heatmap", &clusters.showHeatmap);
+	if (clusters.enabled) {
+		ImGui::Text("%d of %d clusters lit, %.1f lights on average, %d at most", clusters.numOccupied, LightClusters::NUM_CLUSTERS, clusters.averageLights, clusters.maxLights);
+		ImGui::Text("%d clusters full, %.3f ms on the GPU", clusters.numFull, clusters.passTime);
+	}
+
+	ImGui::SeparatorText("Texture streaming");
+	TextureStreamer& streamer = TextureStreamer::shared();
+	ImGui::Checkbox("Stream textures", &streamer.enabled);
+	int budgetMB = static_cast<int>(streamer.budget >> 20);
+	if (ImGui::SliderInt("Budget (MB)", &budgetMB, 16, 4096))
+		streamer.budget = static_cast<size_t>(budgetMB) << 20;
+	ImGui::SliderFloat("LOD bias", &streamer.lodBias, -2.0f, 4.0f);
+	ImGui::Text("%d textures, %.1f MB resident", streamer.numTextures, streamer.residentBytes / (1024.0 * 1024.0));
+	ImGui::Text("%d reads pending, %d levels streamed in, %d evicted", streamer.numPendingReads, streamer.numStreamedIn, streamer.numEvicted);
+	TexturePool& texturePool = TexturePool::shared();
+	if (texturePool.isBindless())
+		ImGui::Text("%d material textures bindless", texturePool.getNumTextures());
+	else
+		ImGui::Text("%d material textures in %d arrays, %.1f MB", texturePool.getNumTextures(), texturePool.getNumArrays(), texturePool.getMemorySize() / (1024.0 * 1024.0));
+
+	ImGui::SeparatorText("Texture cache");
+	TextureCache& cache = TextureCache::shared();
+	ImGui::Text("%d textures, %.1f MB", cache.getNumTextures(), cache.getMemorySize() / (1024.0 * 1024.0));
+	ImGui::Text("%d hits, %d misses, %.1f MB saved", cache.hits.load(), cache.misses.load(), cache.savedBytes.load() / (1024.0 * 1024.0));
+
 	ImGui::SeparatorText("Camera textures");
 	ImGui::Checkbox("Show depth texture", &showShadowMap);
 	ImGui::Checkbox("Show normal texture", &showNormalMap);
 
 	if (showShadowMap) {
-		GLuint textureID = renderer->depthFBO->depthTex->ID;
+		GLuint textureID = renderer->cameraFBO->depthTex->ID;
 		ImGui::Begin("Shadow Map", &showShadowMap);
 		ImTextureID texID = reinterpret_cast<void*>(static_cast<intptr_t>(textureID));
 		ImGui::Image(texID, ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
@@ -372,7 +469,7 @@ void GUI::displayRender(Model* model, Renderer* renderer) {
 	}
 
 	if (showNormalMap) {
-		GLuint textureID = renderer->normalFBO->colorTextures[0]->ID;
+		GLuint textureID = renderer->cameraFBO->colorTextures[0]->ID;
 		ImGui::Begin("Normal Map", &showShadowMap);
 		ImTextureID texID = reinterpret_cast<void*>(static_cast<intptr_t>(textureID));
 		ImGui::Image(texID, ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
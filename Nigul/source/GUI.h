@@ -30,6 +30,8 @@ public:
 
     void logic(SceneManager* model, Renderer* renderer);
     bool input(Model* model);
+    // Selects the node under the cursor, nothing selects the root
+    Node* pick(Model* model);
 
     void displayNode(Model* model, Node* node);
     bool displayGizmo(Model* model);
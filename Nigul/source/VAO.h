@@ -26,8 +26,9 @@ public:
      * @param type of component
      * @param stride
      * @param offset
+     * @param normalized Integer components are mapped to [-1, 1] (signed) or [0, 1] (unsigned)
      */
-    void linkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
+    void linkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset, GLboolean normalized = GL_FALSE);
 
     /**
      * @brief Binds the VAO to the current OpenGL context.
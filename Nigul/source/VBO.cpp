@@ -1,10 +1,21 @@
 #include"VBO.h"
 
-VBO::VBO(std::vector<Vertex>& vertices)
+VBO::VBO(std::vector<Vertex>& vertices) : VBO(vertices.data(), vertices.size())
+{
+}
+
+VBO::VBO(const Vertex* vertices, size_t count)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_ARRAY_BUFFER, ID);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+}
+
+VBO::VBO(const PackedVertex* vertices, size_t count)
 {
 	glGenBuffers(1, &ID);
 	glBindBuffer(GL_ARRAY_BUFFER, ID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(PackedVertex), vertices, GL_STATIC_DRAW);
 }
 
 void VBO::Bind()
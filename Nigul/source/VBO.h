@@ -13,6 +13,14 @@ struct Vertex
     glm::vec2 texUV;
 };
 
+// Compact layout of a Vertex on the GPU, 16 bytes instead of 44 (see Primitive::dequantizeMatrix)
+struct PackedVertex
+{
+    GLshort position[4]; // snorm16 inside the bounds of the primitive, w is padding
+    GLshort normal[2]; // snorm16 octahedral encoding
+    GLhalf texUV[2];
+};
+
 /**
  * @class VBO
  * @brief Represents an OpenGL Vertex Buffer Object (VBO) used for storing vertices in GPU memory.
@@ -30,6 +38,22 @@ public:
      */
     VBO(std::vector<Vertex>& vertices);
 
+    /**
+     * @brief Constructs a VBO from vertices that are not owned by a vector, uploaded with a single glBufferData.
+     *
+     * @param vertices Pointer to the first vertex.
+     * @param count Number of vertices.
+     */
+    VBO(const Vertex* vertices, size_t count);
+
+    /**
+     * @brief Constructs a VBO from vertices already packed in the compact layout.
+     *
+     * @param vertices Pointer to the first vertex.
+     * @param count Number of vertices.
+     */
+    VBO(const PackedVertex* vertices, size_t count);
+
     /**
      * @brief Binds the VBO to the current OpenGL context.
      */
@@ -3,6 +3,8 @@
 Application::Application(int width, int height, const std::string& title): width(width), height(height), title(title){}
 
 void Application::init() {
+	startTime = std::chrono::high_resolution_clock::now();
+
 	glfwSetErrorCallback([](int error, const char* description) {
 		std::cerr << "GLFW Error (" << error << "): " << description << std::endl;
 	});
@@ -22,11 +24,34 @@ void Application::init() {
 	glfwMakeContextCurrent(window);
 	gladLoadGL();
 
-	sceneManager = std::make_unique<SceneManager>();
-	sceneManager->loadScene();
+	// The driver compiles on its own threads, Shader polls for completion instead of blocking on every program
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile") || glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		typedef void (APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+		auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreads>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+		if (!maxShaderCompilerThreads)
+			maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreads>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+		if (maxShaderCompilerThreads)
+			maxShaderCompilerThreads(0xFFFFFFFF); // As many as the driver wants
+		Shader::parallelCompile = true;
+	}
+
+	// Material textures get resident handles instead of texture array layers. The pool checks the
+	// texture units of the context as it is created, so it is first reached here
+	TexturePool& texturePool = TexturePool::shared();
+	if (glfwExtensionSupported("GL_ARB_bindless_texture")) {
+		auto getHandle = reinterpret_cast<TexturePool::GetTextureHandle>(glfwGetProcAddress("glGetTextureHandleARB"));
+		auto makeResident = reinterpret_cast<TexturePool::SetTextureHandleResidency>(glfwGetProcAddress("glMakeTextureHandleResidentARB"));
+		auto makeNonResident = reinterpret_cast<TexturePool::SetTextureHandleResidency>(glfwGetProcAddress("glMakeTextureHandleNonResidentARB"));
+		if (getHandle && makeResident && makeNonResident)
+			texturePool.setBindless(getHandle, makeResident, makeNonResident);
+	}
 
+	// Every program is submitted first so they compile while the scene and the GUI are set up
 	renderer = std::make_unique<Renderer>(width, height);
 
+	sceneManager = std::make_unique<SceneManager>();
+	sceneManager->loadScene();
+
 	menu = std::make_unique<GUI>();
 	menu->init(window);
 }
@@ -36,14 +61,29 @@ void Application::loop(){
 	Renderer* r = renderer.get();
 
 	while (!glfwWindowShouldClose(window)) {
+		sceneManager->update();
+
 		Model* model = sceneManager->getMainModel();
 		Skybox* skybox = sceneManager->getMainSkybox();
 
 		renderer->render(model, skybox);
+		TextureStreamer::shared().update();
 		menu->createFrame(sm, r);
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (isFirstFrame) {
+			isFirstFrame = false;
+			std::cout << "First frame after " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count()
+				<< " ms" << std::endl;
+		}
+		if (areShadersPending && Shader::finishReady()) {
+			areShadersPending = false;
+			std::cout << "Shaders ready after " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count()
+				<< " ms" << std::endl;
+			ProgramCache::printStats();
+		}
 	}
 }
 
@@ -5,6 +5,9 @@
 #include "skybox.h"
 #include "quad.h"
 #include "renderer.h"
+#include "textureStreamer.h"
+#include "texturePool.h"
+#include "programCache.h"
 
 #include <iostream>
 #include <chrono>
@@ -28,4 +31,9 @@ public:
     std::unique_ptr<SceneManager> sceneManager = nullptr;
     std::unique_ptr<GUI> menu = nullptr;
     std::unique_ptr<Renderer> renderer = nullptr;
+
+    // Startup timing, reported once the first frame is on screen and once the last shader is compiled
+    std::chrono::high_resolution_clock::time_point startTime;
+    bool isFirstFrame = true;
+    bool areShadersPending = true;
 };
@@ -0,0 +1,91 @@
+#include "bounds.h"
+
+#include <algorithm>
+
+AABB AABB::transform(const glm::mat4& matrix) const
+{
+	// The extent of the transformed box along each axis is the absolute matrix applied to the extent
+	glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+	glm::vec3 extent = getExtent();
+	glm::vec3 transformedExtent(0.0f);
+	for (int column = 0; column < 3; column++)
+		transformedExtent += glm::abs(glm::vec3(matrix[column])) * extent[column];
+
+	AABB box;
+	box.min = center - transformedExtent;
+	box.max = center + transformedExtent;
+	return box;
+}
+
+void AABB::expand(const AABB& other)
+{
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+float AABB::getSurfaceArea() const
+{
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool AABB::intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry, float& exit) const
+{
+	glm::vec3 t0 = (min - origin) * inverseDirection;
+	glm::vec3 t1 = (max - origin) * inverseDirection;
+	glm::vec3 nearest = glm::min(t0, t1);
+	glm::vec3 farthest = glm::max(t0, t1);
+	entry = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+	exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+	return entry <= exit;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& matrix)
+{
+	// Rows of the matrix added to and subtracted from the last one (Gribb and Hartmann)
+	glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+	glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+	glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+	glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0; // Left
+	frustum.planes[1] = row3 - row0; // Right
+	frustum.planes[2] = row3 + row1; // Bottom
+	frustum.planes[3] = row3 - row1; // Top
+	frustum.planes[4] = row3 + row2; // Near
+	frustum.planes[5] = row3 - row2; // Far
+	return frustum;
+}
+
+bool Frustum::intersects(const AABB& box) const
+{
+	glm::vec3 center = box.getCenter();
+	glm::vec3 extent = box.getExtent();
+	for (const glm::vec4& plane : planes) {
+		glm::vec3 normal = glm::vec3(plane);
+		// Distance of the center against how far the box reaches towards the plane
+		float distance = glm::dot(normal, center) + plane.w;
+		float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+FrustumTest Frustum::classify(const AABB& box) const
+{
+	glm::vec3 center = box.getCenter();
+	glm::vec3 extent = box.getExtent();
+	FrustumTest result = FRUSTUM_INSIDE;
+	for (const glm::vec4& plane : planes) {
+		glm::vec3 normal = glm::vec3(plane);
+		float distance = glm::dot(normal, center) + plane.w;
+		float radius = glm::dot(glm::abs(normal), extent);
+		if (distance + radius < 0.0f)
+			return FRUSTUM_OUTSIDE;
+		if (distance - radius < 0.0f)
+			result = FRUSTUM_INTERSECTS;
+	}
+	return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * @struct AABB
+ * @brief Axis aligned bounding box.
+ */
+struct AABB
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    inline glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    inline glm::vec3 getExtent() const { return (max - min) * 0.5f; }
+
+    /**
+     * @brief Smallest box holding this one once transformed by matrix.
+     */
+    AABB transform(const glm::mat4& matrix) const;
+
+    void expand(const AABB& other);
+    float getSurfaceArea() const;
+
+    /**
+     * @brief Slab test of a ray given by its origin and 1 / direction.
+     *
+     * @param entry Distance along the ray where it enters the box, 0 if it starts inside.
+     * @param exit Distance where it leaves the box, at most maxDistance.
+     * @return false if the ray misses the box or enters it past maxDistance.
+     */
+    bool intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry, float& exit) const;
+};
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+/**
+ * @struct Frustum
+ * @brief The six planes of a view volume, normals pointing inside.
+ */
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    /**
+     * @brief Extracts the planes of a projection * view matrix, perspective or orthographic.
+     */
+    static Frustum fromMatrix(const glm::mat4& matrix);
+
+    /**
+     * @brief false only if the box is fully outside one of the planes, so some boxes near the corners pass.
+     */
+    bool intersects(const AABB& box) const;
+
+    /**
+     * @brief Same as intersects, also telling boxes fully inside apart so a hierarchy can skip testing their children.
+     */
+    FrustumTest classify(const AABB& box) const;
+};
@@ -5,6 +5,12 @@ void Camera::updateMatrix()
 	cameraMatrix = projectionMatrix * viewMatrix;
 }
 
+glm::vec3 Camera::getPosition() const
+{
+	// The view matrix moves the world in front of the camera, its inverse holds the camera position
+	return glm::vec3(glm::inverse(viewMatrix)[3]);
+}
+
 void Camera::updateView(const glm::mat4& matrix){
 	viewMatrix = matrix;
 }
@@ -0,0 +1,57 @@
+#include "deferredShading.h"
+
+#include "shader.h"
+#include "camera.h"
+
+DeferredShading::DeferredShading(int width, int height)
+{
+	gBuffer = std::make_unique<FBO>(width, height, FIRST_UNIT, std::vector<GLenum>{ GL_RGBA8, GL_RGBA16F, GL_R11F_G11F_B10F });
+	geometryShader = std::make_unique<Shader>("default.vert", "gbuffer.frag");
+	lightingShader = std::make_unique<Shader>("quad.vert", "deferred.frag");
+}
+
+DeferredShading::~DeferredShading()
+{
+}
+
+void DeferredShading::beginGeometryPass()
+{
+	gBuffer->bind();
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+static const ShaderUniform<int> gAlbedoMetallicUniform("gAlbedoMetallic");
+static const ShaderUniform<int> gNormalRoughnessUniform("gNormalRoughness");
+static const ShaderUniform<int> gEmissiveUniform("gEmissive");
+static const ShaderUniform<int> gDepthUniform("gDepth");
+static const ShaderUniform<glm::vec3> camPosUniform("camPos");
+static const ShaderUniform<glm::mat4> inverseCamMatrixUniform("inverseCamMatrix");
+
+void DeferredShading::light(Camera* camera)
+{
+	lightingShader->activate();
+	lightingShader->set(gAlbedoMetallicUniform, static_cast<int>(gBuffer->colorTextures[0]->unit));
+	lightingShader->set(gNormalRoughnessUniform, static_cast<int>(gBuffer->colorTextures[1]->unit));
+	lightingShader->set(gEmissiveUniform, static_cast<int>(gBuffer->colorTextures[2]->unit));
+	lightingShader->set(gDepthUniform, static_cast<int>(gBuffer->depthTex->unit));
+	for (auto& texture : gBuffer->colorTextures)
+		texture->bind();
+	gBuffer->depthTex->bind();
+
+	// Same camera position as the forward pass gets (see Renderer::submit)
+	lightingShader->set(camPosUniform, glm::vec3(camera->viewMatrix[3]));
+	lightingShader->set(inverseCamMatrixUniform, glm::inverse(camera->cameraMatrix));
+
+	// Depth is written, not tested, so the quad covers every pixel a surface was drawn to
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_ALWAYS);
+	GLboolean culling = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+	glBindVertexArray(quad.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindVertexArray(0);
+	glDepthFunc(GL_LESS);
+	if (culling)
+		glEnable(GL_CULL_FACE);
+}
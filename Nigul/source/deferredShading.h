@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <memory>
+
+#include "FBO.h"
+#include "quad.h"
+
+class Shader;
+class Camera;
+
+/**
+ * @class DeferredShading
+ * @brief Optional deferred path of the main view: one geometry pass into a G-buffer, then one lighting pass.
+ *
+ * The geometry pass writes the opaque primitives as base color and metalness (RGBA8), octahedral normal,
+ * roughness and occlusion (RGBA16F), emissive (R11F_G11F_B10F) and depth, 20 bytes a pixel. The lighting
+ * pass is a full-screen quad that runs the lights of default.frag once per covered pixel, through the same
+ * light clusters, and writes the depth back so blended primitives and the skybox are then drawn forward
+ * on top. Lighting costs the same however many surfaces overlap, the price is no MSAA on this path.
+ */
+class DeferredShading
+{
+public:
+    static const GLuint FIRST_UNIT = 103; // The three G-buffer textures, then its depth
+
+    bool enabled = false;
+
+    std::unique_ptr<FBO> gBuffer;
+    std::unique_ptr<Shader> geometryShader; // With default.vert, used for the main view instead of default.frag
+    std::unique_ptr<Shader> lightingShader;
+
+    DeferredShading(int width, int height);
+    ~DeferredShading();
+
+    /**
+     * @brief Binds and clears the G-buffer, the opaque items of the main view are then submitted with geometryShader.
+     */
+    void beginGeometryPass();
+
+    /**
+     * @brief Lights the G-buffer into the framebuffer bound, which must have a depth buffer of the same size.
+     *
+     * The light buffer, clusters and scene uniforms of lightingShader are expected to be set.
+     */
+    void light(Camera* camera);
+
+private:
+    MeshQuad quad;
+};
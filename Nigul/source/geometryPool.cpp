@@ -0,0 +1,133 @@
+#include "geometryPool.h"
+
+#include <cstddef>
+#include <iostream>
+
+#include "mesh.h"
+
+int GeometryPool::getGroup(bool compact, GLenum indexType)
+{
+	return (compact ? 2 : 0) + (indexType == GL_UNSIGNED_SHORT ? 1 : 0);
+}
+
+static GLsizeiptr getIndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+size_t GeometryPool::getMemorySize() const
+{
+	size_t size = 0;
+	for (const Group& group : groups)
+		size += group.vertexBytes + group.indexBytes;
+	return size;
+}
+
+void GeometryPool::build(std::vector<std::unique_ptr<Mesh>>& meshes)
+{
+	release();
+
+	// Sizes first, each primitive gets its offsets in whole vertices and indices
+	for (auto& mesh : meshes) {
+		for (Primitive& primitive : mesh->primitives) {
+			if (primitive.vertexBuffer == 0 || primitive.indexBuffer == 0)
+				continue;
+			Group& group = groups[getGroup(primitive.compact, primitive.indexType)];
+			GLsizeiptr stride = primitive.compact ? sizeof(PackedVertex) : sizeof(Vertex);
+			group.compact = primitive.compact;
+			group.indexType = primitive.indexType;
+			primitive.baseVertex = static_cast<GLint>(group.vertexBytes / stride);
+			primitive.firstIndex = static_cast<GLuint>(group.indexBytes / getIndexSize(primitive.indexType));
+			group.vertexBytes += primitive.vertexCount * stride;
+			group.indexBytes += primitive.indexCount * getIndexSize(primitive.indexType);
+			group.numPrimitives++;
+		}
+	}
+
+	for (Group& group : groups) {
+		if (group.numPrimitives == 0)
+			continue;
+		glGenBuffers(1, &group.vertexBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, group.vertexBuffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, group.vertexBytes, nullptr, 0);
+		glGenBuffers(1, &group.indexBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, group.indexBuffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, group.indexBytes, nullptr, 0);
+	}
+
+	// Copied buffer to buffer, the CPU copies of the geometry may already be released
+	for (auto& mesh : meshes) {
+		for (Primitive& primitive : mesh->primitives) {
+			if (primitive.vertexBuffer == 0 || primitive.indexBuffer == 0)
+				continue;
+			int groupIndex = getGroup(primitive.compact, primitive.indexType);
+			const Group& group = groups[groupIndex];
+			GLsizeiptr stride = primitive.compact ? sizeof(PackedVertex) : sizeof(Vertex);
+			GLsizeiptr indexSize = getIndexSize(primitive.indexType);
+
+			glBindBuffer(GL_COPY_READ_BUFFER, primitive.vertexBuffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, group.vertexBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, primitive.baseVertex * stride, primitive.vertexCount * stride);
+			glBindBuffer(GL_COPY_READ_BUFFER, primitive.indexBuffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, group.indexBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, primitive.firstIndex * indexSize, primitive.indexCount * indexSize);
+
+			primitive.vao.Delete();
+			primitive.vao.ID = 0;
+			glDeleteBuffers(1, &primitive.vertexBuffer);
+			glDeleteBuffers(1, &primitive.indexBuffer);
+			primitive.vertexBuffer = 0;
+			primitive.indexBuffer = 0;
+			primitive.poolGroup = groupIndex;
+		}
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Same attributes as a primitive of the layout (see Primitive::setupBuffers)
+	for (Group& group : groups) {
+		if (group.numPrimitives == 0)
+			continue;
+		glGenVertexArrays(1, &group.vao);
+		glBindVertexArray(group.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, group.vertexBuffer);
+		if (group.compact) {
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+			glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texUV));
+		}
+		else {
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texUV));
+		}
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(3);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.indexBuffer);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	built = true;
+	std::cout << "Merged the geometry into " << getMemorySize() / 1024 << " KB of shared buffers" << std::endl;
+}
+
+void GeometryPool::release()
+{
+	for (Group& group : groups) {
+		if (group.vao)
+			glDeleteVertexArrays(1, &group.vao);
+		if (group.vertexBuffer)
+			glDeleteBuffers(1, &group.vertexBuffer);
+		if (group.indexBuffer)
+			glDeleteBuffers(1, &group.indexBuffer);
+		group = Group();
+	}
+	built = false;
+}
+
+void GeometryPool::bind(int group) const
+{
+	glBindVertexArray(groups[group].vao);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+
+class Mesh;
+
+/**
+ * @class GeometryPool
+ * @brief Shared vertex and index buffers every primitive of a model is suballocated from.
+ *
+ * Primitives are uploaded to their own buffers first, then copied here on the GPU so the CPU copies
+ * are not needed. A multi-draw needs a single vertex layout and index type, so there is one pair of
+ * buffers and one VAO per combination that is used: compact or full vertices, 16 or 32 bit indices.
+ * Each primitive keeps its group, first index and base vertex, its own buffers are freed.
+ */
+class GeometryPool
+{
+public:
+    static const int NUM_GROUPS = 4;
+
+    struct Group {
+        GLuint vao = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        GLsizeiptr vertexBytes = 0;
+        GLsizeiptr indexBytes = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        bool compact = false;
+        int numPrimitives = 0;
+    };
+
+    Group groups[NUM_GROUPS];
+
+    static int getGroup(bool compact, GLenum indexType);
+
+    inline bool isBuilt() const { return built; }
+    size_t getMemorySize() const;
+
+    /**
+     * @brief Moves the geometry of every primitive into the shared buffers.
+     */
+    void build(std::vector<std::unique_ptr<Mesh>>& meshes);
+
+    /**
+     * @brief Frees the shared buffers, the primitives pointing into them cannot be drawn anymore.
+     */
+    void release();
+
+    void bind(int group) const;
+
+private:
+    bool built = false;
+};
@@ -0,0 +1,254 @@
+#include "gpuScene.h"
+
+#include <algorithm>
+
+#include "model.h"
+#include "shader.h"
+#include "renderQueue.h"
+#include "occlusionCuller.h"
+#include "texturePool.h"
+
+GpuScene::GpuScene()
+{
+	commandShader = std::make_unique<Shader>("drawCommands.comp");
+	glGenBuffers(1, &drawBuffer);
+	glGenBuffers(1, &materialBuffer);
+	glGenBuffers(1, &drawItemBuffer);
+	glGenBuffers(1, &commandBuffer);
+}
+
+GpuScene::~GpuScene()
+{
+	glDeleteBuffers(1, &drawBuffer);
+	glDeleteBuffers(1, &materialBuffer);
+	glDeleteBuffers(1, &drawItemBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+}
+
+void GpuScene::beginFrame(Model* model)
+{
+	this->model = model && model->geometryPool.isBuilt() ? model : nullptr;
+	frameOffset = 0;
+	numDraws = 0;
+	numMultiDraws = 0;
+	if (!this->model)
+		return;
+
+	// Factors can be edited and streaming moves textures at any time, there are few materials so they are sent every frame
+	uploadMaterials();
+
+	SceneBVH& bvh = model->getBVH();
+	if (bvh.getVersion() != bvhVersion) {
+		bvhVersion = bvh.getVersion();
+		uploadDraws();
+	}
+}
+
+static GpuScene::MaterialTexture getMaterialTexture(const Texture* texture)
+{
+	GpuScene::MaterialTexture slot = { 0, -1, 0 };
+	if (!texture)
+		return slot;
+	slot.handle = texture->handle;
+	slot.array = texture->arrayIndex >= 0 ? texture->arrayIndex : -2;
+	slot.layer = std::max(texture->layer, 0);
+	return slot;
+}
+
+void GpuScene::uploadMaterials()
+{
+	materials.clear();
+	materialIndices.clear();
+	for (auto& material : model->lodMat) {
+		MaterialData data = {};
+		data.baseColorFactor = material->pbrMetallicRoughness.baseColorFactor;
+		data.metallicFactor = material->pbrMetallicRoughness.metallicFactor;
+		data.roughnessFactor = material->pbrMetallicRoughness.roughnessFactor;
+		data.textures[ALBEDO_UNIT] = getMaterialTexture(material->pbrMetallicRoughness.baseColorTexture);
+		data.textures[METALLIC_ROUGHNESS_UNIT] = getMaterialTexture(material->pbrMetallicRoughness.metallicRoughness);
+		data.textures[EMISSIVE_UNIT] = getMaterialTexture(material->emissiveTexture);
+		data.textures[NORMAL_MAP_UNIT] = getMaterialTexture(material->normalMap);
+		data.textures[OCCLUSION_UNIT] = getMaterialTexture(material->occlusionTexture);
+		materialIndices[material.get()] = static_cast<uint32_t>(materials.size());
+		materials.push_back(data);
+	}
+
+	// Primitives without a material get the glTF defaults
+	MaterialData fallback = {};
+	fallback.baseColorFactor = glm::vec4(1.0f);
+	fallback.metallicFactor = 1.0f;
+	fallback.roughnessFactor = 1.0f;
+	for (MaterialTexture& slot : fallback.textures)
+		slot = getMaterialTexture(nullptr);
+	materialIndices[nullptr] = static_cast<uint32_t>(materials.size());
+	materials.push_back(fallback);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(MaterialData), materials.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuScene::uploadDraws()
+{
+	const std::vector<SceneBVH::Item>& items = model->getBVH().getItems();
+	draws.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++) {
+		const Primitive& primitive = *items[i].primitive;
+		DrawData& draw = draws[i];
+		draw = {};
+		draw.model = items[i].node->globalMatrix * primitive.dequantizeMatrix;
+		auto material = materialIndices.find(primitive.material);
+		draw.material = material != materialIndices.end() ? material->second : materialIndices[nullptr];
+		draw.octNormals = primitive.compact;
+		draw.count = static_cast<uint32_t>(primitive.indexCount);
+		draw.firstIndex = primitive.firstIndex;
+		draw.baseVertex = primitive.baseVertex;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(draws.size(), 1) * sizeof(DrawData), draws.empty() ? nullptr : draws.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuScene::reserve(size_t numItems)
+{
+	if (frameOffset + numItems <= capacity)
+		return;
+
+	// Draws already issued this frame keep the orphaned storage, the new one starts empty
+	capacity = std::max(numItems, capacity * 2);
+	frameOffset = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawItemBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(OcclusionCuller::DrawCommand), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Items drawn by one multi-draw share all of this
+static bool isSameBatch(const Primitive& a, const Primitive& b, bool textured)
+{
+	if (a.poolGroup != b.poolGroup)
+		return false;
+	const Material* ma = a.material;
+	const Material* mb = b.material;
+	if ((ma && ma->doubleSided) != (mb && mb->doubleSided))
+		return false;
+	if ((ma && ma->alphaMode == BLEND_MODE) != (mb && mb->alphaMode == BLEND_MODE))
+		return false;
+	if (!textured || ma == mb)
+		return true;
+
+	// Textures in the TexturePool are found through the material data, only the others need the same bindings
+	if ((!ma || ma->isIndexable()) && (!mb || mb->isIndexable()))
+		return true;
+	if (!ma || !mb)
+		return false;
+	return ma->pbrMetallicRoughness.baseColorTexture == mb->pbrMetallicRoughness.baseColorTexture
+		&& ma->pbrMetallicRoughness.metallicRoughness == mb->pbrMetallicRoughness.metallicRoughness
+		&& ma->emissiveTexture == mb->emissiveTexture
+		&& ma->normalMap == mb->normalMap
+		&& ma->occlusionTexture == mb->occlusionTexture;
+}
+
+static const ShaderUniform<int> firstDrawUniform("firstDraw");
+static const ShaderUniform<int> numDrawsUniform("numDraws");
+static const ShaderUniform<bool> cullHiddenUniform("cullHidden");
+
+void GpuScene::submit(const std::vector<const RenderItem*>& items, Shader* shader, bool textured, GLuint visibilityBuffer)
+{
+	pooled.clear();
+	drawItems.clear();
+	for (const RenderItem* item : items) {
+		if (!item->primitive->isPooled())
+			continue;
+		pooled.push_back(item);
+		drawItems.push_back(item->index);
+	}
+	if (drawItems.empty())
+		return;
+
+	reserve(drawItems.size());
+	GLuint firstDraw = static_cast<GLuint>(frameOffset);
+	GLsizei count = static_cast<GLsizei>(drawItems.size());
+	frameOffset += drawItems.size();
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawItemBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, firstDraw * sizeof(uint32_t), drawItems.size() * sizeof(uint32_t), drawItems.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, drawBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materialBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_ITEM_BINDING, drawItemBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+	if (visibilityBuffer)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibilityBuffer);
+
+	commandShader->activate();
+	commandShader->set(firstDrawUniform, static_cast<int>(firstDraw));
+	commandShader->set(numDrawsUniform, count);
+	commandShader->set(cullHiddenUniform, visibilityBuffer != 0);
+	glDispatchCompute((count + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	shader->activate();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	// Same state changes as a draw per item, only once per batch
+	int cullFace = -1; // Set by the first batch, whatever the state was before
+	bool frontFaceCW = false;
+	bool blend = false;
+	Material* boundMaterial = nullptr;
+
+	// Command i draws pooled[i], a batch is a range of both
+	size_t begin = 0;
+	while (begin < pooled.size()) {
+		const Primitive& first = *pooled[begin]->primitive;
+		bool mirrored = isMirrored(*pooled[begin]);
+		size_t end = begin + 1;
+		while (end < pooled.size() && isSameBatch(first, *pooled[end]->primitive, textured) && isMirrored(*pooled[end]) == mirrored)
+			end++;
+
+		Material* material = first.material;
+		if (textured && material && !material->isIndexable() && material != boundMaterial) {
+			material->bind(shader);
+			boundMaterial = material;
+		}
+
+		bool cull = !(material && material->doubleSided);
+		if (cullFace != static_cast<int>(cull)) {
+			if (cull)
+				glEnable(GL_CULL_FACE);
+			else
+				glDisable(GL_CULL_FACE);
+			cullFace = cull;
+		}
+		if (mirrored != frontFaceCW) {
+			glFrontFace(mirrored ? GL_CW : GL_CCW);
+			frontFaceCW = mirrored;
+		}
+
+		if (!blend && material && material->alphaMode == BLEND_MODE) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			blend = true;
+		}
+
+		model->geometryPool.bind(first.poolGroup);
+		const void* offset = reinterpret_cast<const void*>((firstDraw + begin) * sizeof(OcclusionCuller::DrawCommand));
+		glMultiDrawElementsIndirect(GL_TRIANGLES, model->geometryPool.groups[first.poolGroup].indexType, offset, static_cast<GLsizei>(end - begin), 0);
+		numMultiDraws++;
+		begin = end;
+	}
+	numDraws += count;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+
+	if (cullFace == 1)
+		glDisable(GL_CULL_FACE);
+	if (frontFaceCW)
+		glFrontFace(GL_CCW);
+	if (blend)
+		glDisable(GL_BLEND);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "material.h"
+
+class Model;
+class Shader;
+class Material;
+struct RenderItem;
+
+/**
+ * @class GpuScene
+ * @brief Draws render queue items of a model with merged geometry through glMultiDrawElementsIndirect.
+ *
+ * The model matrix and geometry range of every BVH item live in one storage buffer, the factors of
+ * every material in another, both read by the shaders through gl_BaseInstance. A submit uploads the
+ * item indices in queue order and a compute pass turns them into draw commands, hiding the items the
+ * occlusion test rejected. Consecutive items that share a vertex layout, face culling and blending
+ * are drawn with a single call, views that sample the material also need the same textures unless
+ * every texture of both materials is in the TexturePool.
+ */
+class GpuScene
+{
+public:
+    // Bindings of the storage buffers, 0 to 2 belong to the OcclusionCuller
+    static const GLuint DRAW_BINDING = 3;
+    static const GLuint MATERIAL_BINDING = 4;
+    static const GLuint DRAW_ITEM_BINDING = 5;
+    static const GLuint COMMAND_BINDING = 6;
+
+    // Same std430 layout as shaders/include/gpuScene.glsl
+    struct DrawData {
+        glm::mat4 model; // Includes the dequantization of compact positions
+        uint32_t material;
+        uint32_t octNormals;
+        uint32_t count;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t pad[3];
+    };
+
+    // A material texture is read through its bindless handle, else its array layer, else the sampler its material binds
+    struct MaterialTexture {
+        GLuint64 handle;
+        int32_t array; // -1 without a texture, -2 when it is bound by its material
+        int32_t layer;
+    };
+
+    struct MaterialData {
+        glm::vec4 baseColorFactor;
+        float metallicFactor;
+        float roughnessFactor;
+        float pad[2];
+        MaterialTexture textures[MATERIAL_TEXTURE_UNITS];
+    };
+
+    // Draws and multi-draw calls issued since beginFrame
+    int numDraws = 0;
+    int numMultiDraws = 0;
+
+    GpuScene();
+    ~GpuScene();
+
+    /**
+     * @brief Uploads what changed in the model since the last frame, drawing is only possible if its geometry was merged.
+     */
+    void beginFrame(Model* model);
+    inline bool isActive() const { return model != nullptr; }
+
+    /**
+     * @brief Draws items, in order, with the shader already active.
+     *
+     * textured binds the textures of the materials, visibilityBuffer hides the items with a zero in it when not 0.
+     */
+    void submit(const std::vector<const RenderItem*>& items, Shader* shader, bool textured, GLuint visibilityBuffer);
+
+private:
+    void uploadDraws();
+    void uploadMaterials();
+    void reserve(size_t numItems);
+
+    Model* model = nullptr;
+    uint32_t bvhVersion = 0;
+
+    std::unique_ptr<Shader> commandShader;
+    GLuint drawBuffer = 0;
+    GLuint materialBuffer = 0;
+    GLuint drawItemBuffer = 0;
+    GLuint commandBuffer = 0;
+    size_t capacity = 0; // Items the draw item and command buffers hold
+    size_t frameOffset = 0; // First free item this frame, each submit takes its own range
+
+    std::vector<DrawData> draws;
+    std::vector<MaterialData> materials;
+    std::vector<const RenderItem*> pooled;
+    std::vector<uint32_t> drawItems;
+    std::unordered_map<const Material*, uint32_t> materialIndices;
+};
@@ -28,6 +28,7 @@ public:
 	Camera* camera = nullptr;
 
 	int index = 0;
+	int shadowIndex = -1; // Which of the MAX_SHADOW_MAPS the shadow map is, -1 without one
 
 	virtual void updateProjection() = 0;
 	virtual void updatePosition(const glm::mat4& mat) = 0;
@@ -0,0 +1,108 @@
+#include "lightBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "model.h"
+#include "shader.h"
+
+LightBuffer::LightBuffer()
+{
+	glGenBuffers(1, &buffer);
+}
+
+LightBuffer::~LightBuffer()
+{
+	glDeleteBuffers(1, &buffer);
+}
+
+LightBuffer::GpuLight LightBuffer::pack(Light* light)
+{
+	GpuLight gpuLight = {};
+	gpuLight.shadowMatrix = glm::mat4(1.0f);
+	gpuLight.position = light->position;
+	gpuLight.type = static_cast<int32_t>(light->getType());
+	gpuLight.color = light->color;
+	gpuLight.intensity = light->intensity;
+	gpuLight.range = light->range;
+	gpuLight.shadowBias = light->shadowBias;
+	gpuLight.enabled = light->enabled;
+	gpuLight.shadowMap = -1;
+
+	switch (light->getType()) {
+	case POINTLIGHT:
+		gpuLight.attenuation = static_cast<PointLight*>(light)->attenuation;
+		break;
+	case SPOTLIGHT: {
+		SpotLight* spotLight = static_cast<SpotLight*>(light);
+		gpuLight.direction = spotLight->direction;
+		gpuLight.innerConeAngle = spotLight->innerConeAngle;
+		gpuLight.outerConeAngle = spotLight->outerConeAngle;
+		break;
+	}
+	case DIRECTIONAL:
+		if (light->camera)
+			gpuLight.shadowMatrix = light->camera->cameraMatrix;
+		if (light->castShadows && light->shadowMap)
+			gpuLight.shadowMap = light->shadowIndex;
+		break;
+	}
+	return gpuLight;
+}
+
+void LightBuffer::update(Model* model)
+{
+	if (model->lightFlags.none() && model->lodLight.size() == lights.size())
+		return;
+
+	packed.resize(model->lodLight.size());
+	for (size_t i = 0; i < model->lodLight.size(); i++)
+		packed[i] = pack(model->lodLight[i].get());
+	model->lightFlags.reset();
+
+	if (packed.size() > capacity) {
+		capacity = std::max(packed.size(), capacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuLight), packed.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		lights = packed;
+		numUploadedLights += static_cast<int>(packed.size());
+		return;
+	}
+
+	// One write from the first to the last light that differs, lights past the old count always do
+	size_t first = packed.size();
+	size_t last = 0;
+	for (size_t i = 0; i < packed.size(); i++) {
+		if (i < lights.size() && std::memcmp(&packed[i], &lights[i], sizeof(GpuLight)) == 0)
+			continue;
+		first = std::min(first, i);
+		last = i;
+	}
+	lights = packed;
+	if (first > last)
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GpuLight), (last - first + 1) * sizeof(GpuLight), &packed[first]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	numUploadedLights += static_cast<int>(last - first + 1);
+}
+
+static const ShaderUniform<int> numLightsUniform("numLights");
+static const ShaderUniform<int> shadowMapsUniform("shadowMaps");
+
+void LightBuffer::bind(Model* model, Shader* shader) const
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, buffer);
+	shader->set(numLightsUniform, getNumLights());
+
+	int units[MAX_SHADOW_MAPS];
+	for (int i = 0; i < MAX_SHADOW_MAPS; i++)
+		units[i] = MATERIAL_TEXTURE_UNITS + i;
+	shader->set(shadowMapsUniform, units, MAX_SHADOW_MAPS);
+	for (auto& light : model->lodLight) {
+		if (light->shadowMap)
+			light->shadowMap->depthTex->bind();
+	}
+}
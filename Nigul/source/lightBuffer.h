@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+class Model;
+class Shader;
+class Light;
+
+/**
+ * @class LightBuffer
+ * @brief Every light of a model packed in one shader storage buffer, read by the shaders with a runtime count.
+ *
+ * The lights are packed again only when the model flags a change, and only the range between the first
+ * and the last light that differs from the previous upload is written. Shadow maps cannot live in the buffer,
+ * a light refers to one of the MAX_SHADOW_MAPS samplers of the shadowMaps uniform instead.
+ */
+class LightBuffer
+{
+public:
+    static const GLuint BINDING = 7; // 0 to 6 belong to the OcclusionCuller and the GpuScene
+
+    // Same layout as in the shaders (std430)
+    struct GpuLight {
+        glm::mat4 shadowMatrix; // World to shadow map clip space, directional lights only
+        glm::vec3 position; // Direction towards the light for directional lights
+        int32_t type;
+        glm::vec3 color;
+        float intensity;
+        glm::vec3 direction; // Spot lights only
+        float range;
+        float attenuation; // Point lights only
+        float innerConeAngle; // Spot lights only
+        float outerConeAngle;
+        float shadowBias;
+        int32_t enabled;
+        int32_t shadowMap; // Index in shadowMaps, -1 when the light casts no shadow
+        int32_t pad[2];
+    };
+
+    // Lights written by the last uploads since the start
+    int numUploadedLights = 0;
+
+    LightBuffer();
+    ~LightBuffer();
+
+    /**
+     * @brief Uploads the lights that changed since the last call and clears the light flags of the model.
+     */
+    void update(Model* model);
+
+    /**
+     * @brief Binds the buffer and the shadow maps, and sets the light count and shadow samplers of shader.
+     */
+    void bind(Model* model, Shader* shader) const;
+
+    inline int getNumLights() const { return static_cast<int>(lights.size()); }
+
+private:
+    static GpuLight pack(Light* light);
+
+    GLuint buffer = 0;
+    size_t capacity = 0; // Lights the buffer holds
+    std::vector<GpuLight> lights; // As last uploaded
+    std::vector<GpuLight> packed;
+};
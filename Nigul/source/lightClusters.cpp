@@ -0,0 +1,142 @@
+#include "lightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "shader.h"
+#include "camera.h"
+
+LightClusters::LightClusters(int width, int height) : width(width), height(height)
+{
+	cullShader = std::make_unique<Shader>("lightClusters.comp");
+
+	// One more list than clusters, for the lights that reach all of them
+	glGenBuffers(1, &countBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (NUM_CLUSTERS + 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glGenBuffers(1, &listBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, listBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (NUM_CLUSTERS + 1) * MAX_CLUSTER_LIGHTS * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	for (int i = 0; i < NUM_READBACKS; i++) {
+		glGenBuffers(1, &readbackBuffers[i]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, NUM_CLUSTERS * sizeof(uint32_t), nullptr, flags);
+		readbackData[i] = static_cast<const uint32_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, NUM_CLUSTERS * sizeof(uint32_t), flags));
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glGenQueries(NUM_READBACKS, queries);
+}
+
+LightClusters::~LightClusters()
+{
+	for (int i = 0; i < NUM_READBACKS; i++) {
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(NUM_READBACKS, readbackBuffers);
+	glDeleteQueries(NUM_READBACKS, queries);
+	glDeleteBuffers(1, &countBuffer);
+	glDeleteBuffers(1, &listBuffer);
+}
+
+void LightClusters::readBack()
+{
+	// Oldest first, so the newest finished result is the one kept
+	for (int i = 1; i <= NUM_READBACKS; i++) {
+		int slot = (frame + i) % NUM_READBACKS;
+		if (queryPending[slot]) {
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+				passTime = elapsed / 1e6;
+				queryPending[slot] = false;
+			}
+		}
+
+		if (!fences[slot])
+			continue;
+		GLenum status = glClientWaitSync(fences[slot], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+		glDeleteSync(fences[slot]);
+		fences[slot] = nullptr;
+
+		int total = 0;
+		numOccupied = 0;
+		numFull = 0;
+		maxLights = 0;
+		for (int cluster = 0; cluster < NUM_CLUSTERS; cluster++) {
+			int count = static_cast<int>(readbackData[slot][cluster]);
+			total += count;
+			numOccupied += count > 0;
+			numFull += count >= MAX_CLUSTER_LIGHTS;
+			maxLights = std::max(maxLights, count);
+		}
+		averageLights = numOccupied > 0 ? static_cast<float>(total) / numOccupied : 0.0f;
+	}
+}
+
+void LightClusters::build(Camera* camera, int numLights)
+{
+	readBack();
+	int slot = frame % NUM_READBACKS;
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+
+	cullShader->activate();
+	cullShader->setInt("numLights", numLights);
+	cullShader->setMat4("viewMatrix", camera->viewMatrix);
+	cullShader->setMat4("inverseProjection", glm::inverse(camera->projectionMatrix));
+	cullShader->setFloat("zNear", std::max(camera->nearPlane, 1e-3f));
+	cullShader->setFloat("zFar", std::max(camera->farPlane, camera->nearPlane + 1e-3f));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNT_BINDING, countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIST_BINDING, listBuffer);
+	glDispatchCompute((NUM_CLUSTERS + 1 + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[slot]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, NUM_CLUSTERS * sizeof(uint32_t));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (fences[slot])
+		glDeleteSync(fences[slot]);
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glEndQuery(GL_TIME_ELAPSED);
+	queryPending[slot] = true;
+	frame++;
+}
+
+static const ShaderUniform<bool> clusteredLightsUniform("clusteredLights");
+static const ShaderUniform<bool> clusterHeatmapUniform("clusterHeatmap");
+static const ShaderUniform<glm::vec2> clusterTileSizeUniform("clusterTileSize");
+static const ShaderUniform<glm::mat4> clusterViewUniform("clusterView");
+static const ShaderUniform<float> clusterDepthScaleUniform("clusterDepthScale");
+static const ShaderUniform<float> clusterDepthBiasUniform("clusterDepthBias");
+
+void LightClusters::bind(Shader* shader, Camera* camera) const
+{
+	shader->set(clusteredLightsUniform, enabled);
+	if (!enabled)
+		return;
+
+	// Slice of a view depth d: log(d) * scale + bias, the inverse of the slicing of lightClusters.comp
+	float zNear = std::max(camera->nearPlane, 1e-3f);
+	float zFar = std::max(camera->farPlane, camera->nearPlane + 1e-3f);
+	float logRatio = std::log(zFar / zNear);
+	shader->set(clusterHeatmapUniform, showHeatmap);
+	shader->set(clusterTileSizeUniform, glm::vec2(static_cast<float>(width) / CLUSTERS_X, static_cast<float>(height) / CLUSTERS_Y));
+	shader->set(clusterViewUniform, camera->viewMatrix);
+	shader->set(clusterDepthScaleUniform, CLUSTERS_Z / logRatio);
+	shader->set(clusterDepthBiasUniform, -CLUSTERS_Z * std::log(zNear) / logRatio);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNT_BINDING, countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIST_BINDING, listBuffer);
+}
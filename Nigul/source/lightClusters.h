@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <memory>
+#include <cstdint>
+
+class Shader;
+class Camera;
+
+/**
+ * @class LightClusters
+ * @brief Clustered light culling of the main camera, so a pixel only shades the lights that can reach it.
+ *
+ * The view frustum is split into screen tiles and exponential depth slices. Every frame a compute shader
+ * lists, for each of these clusters, the point and spot lights of the LightBuffer whose range and cone
+ * touch its bounds. default.frag then loops over the list of the cluster of the fragment. Directional
+ * lights reach every cluster and get a list of their own. The counts are read back a frame late for the
+ * statistics, like the OcclusionCuller does.
+ */
+class LightClusters
+{
+public:
+    // Same as in the shaders
+    static const int CLUSTERS_X = 16;
+    static const int CLUSTERS_Y = 9;
+    static const int CLUSTERS_Z = 24;
+    static const int NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    static const int MAX_CLUSTER_LIGHTS = 256;
+
+    // Bindings of the storage buffers, 7 is the LightBuffer
+    static const GLuint COUNT_BINDING = 8;
+    static const GLuint LIST_BINDING = 9;
+
+    static const int NUM_READBACKS = 2;
+
+    bool enabled = true;
+    bool showHeatmap = false; // Tints the main view by the number of lights of each cluster
+
+    // Result of the last frame read back
+    int numOccupied = 0; // Clusters with at least one light
+    int numFull = 0; // Clusters that reached MAX_CLUSTER_LIGHTS, lights past it are dropped
+    int maxLights = 0;
+    float averageLights = 0.0f; // Over the occupied clusters
+    double passTime = 0.0; // Milliseconds of GPU time
+
+    LightClusters(int width, int height);
+    ~LightClusters();
+
+    /**
+     * @brief Lists the lights of every cluster of camera, the LightBuffer must be bound.
+     */
+    void build(Camera* camera, int numLights);
+
+    /**
+     * @brief Binds the lists and sets the uniforms default.frag finds its cluster with.
+     */
+    void bind(Shader* shader, Camera* camera) const;
+
+private:
+    void readBack();
+
+    std::unique_ptr<Shader> cullShader;
+    int width = 0;
+    int height = 0;
+
+    GLuint countBuffer = 0;
+    GLuint listBuffer = 0;
+
+    // Counts copied to persistently mapped buffers, read once their fence has passed
+    GLuint readbackBuffers[NUM_READBACKS] = {};
+    const uint32_t* readbackData[NUM_READBACKS] = {};
+    GLsync fences[NUM_READBACKS] = {};
+    GLuint queries[NUM_READBACKS] = {};
+    bool queryPending[NUM_READBACKS] = {};
+    int frame = 0;
+};
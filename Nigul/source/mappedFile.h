@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * The mapped bytes stay valid until the object is destroyed, nothing is copied into the heap.
+ */
+class MappedFile
+{
+public:
+    /**
+     * @brief Maps the file at the given path, check isOpen() to know if it succeeded.
+     *
+     * @param path Path to the file.
+     */
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline bool isOpen() const { return bytes != nullptr; }
+    inline const unsigned char* data() const { return bytes; }
+    inline size_t size() const { return length; }
+
+    std::string path;
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
@@ -1,57 +1,58 @@
 #include "material.h"
+#include "textureStreamer.h"
 
 Material::Material(){}
 
+// Resolved once, the lookups per draw only index the table of the shader
+static const ShaderUniform<int> albedoUniform("albedo");
+static const ShaderUniform<int> metallicRoughnessUniform("metallicRoughness");
+static const ShaderUniform<int> emissiveUniform("emissive");
+static const ShaderUniform<int> normalMapUniform("normalMap");
+static const ShaderUniform<int> occlusionUniform("occlusion");
+static const ShaderUniform<bool> hasColorTextureUniform("hasColorTexture");
+static const ShaderUniform<bool> hasMetallicRoughnessTextureUniform("hasMetallicRoughnessTexture");
+static const ShaderUniform<bool> hasEmissiveTextureUniform("hasEmissiveTexture");
+static const ShaderUniform<bool> hasNormalTextureUniform("hasNormalTexture");
+static const ShaderUniform<bool> hasOcclusionTextureUniform("hasOcclusionTexture");
+static const ShaderUniform<float> metallicFactorUniform("metallicFactor");
+static const ShaderUniform<float> roughnessFactorUniform("roughnessFactor");
+static const ShaderUniform<glm::vec4> baseColorFactorUniform("baseColorFactor");
+
+// Binds a texture of a slot and tells the shader whether there is one
+static void bindSlot(Shader* shader, Texture* texture, GLuint unit, const ShaderUniform<int>& sampler, const ShaderUniform<bool>& hasTexture)
+{
+	if (texture) {
+		shader->set(sampler, static_cast<int>(unit));
+		texture->bind(unit);
+	}
+	shader->set(hasTexture, texture != nullptr);
+}
+
 void Material::bind(Shader* shader) {
+	bindSlot(shader, pbrMetallicRoughness.baseColorTexture, ALBEDO_UNIT, albedoUniform, hasColorTextureUniform);
+	bindSlot(shader, pbrMetallicRoughness.metallicRoughness, METALLIC_ROUGHNESS_UNIT, metallicRoughnessUniform, hasMetallicRoughnessTextureUniform);
 
-	if (pbrMetallicRoughness.baseColorTexture) {
-		pbrMetallicRoughness.baseColorTexture->texUnit(shader, "albedo");
-		pbrMetallicRoughness.baseColorTexture->bind();
-		glUniform1i(glGetUniformLocation(shader->ID, "hasColorTexture"), 1);
-	}
-	else {
-		glUniform1i(glGetUniformLocation(shader->ID, "hasColorTexture"), 0);
-	}
+	shader->set(metallicFactorUniform, pbrMetallicRoughness.metallicFactor);
+	shader->set(roughnessFactorUniform, pbrMetallicRoughness.roughnessFactor);
+	shader->set(baseColorFactorUniform, pbrMetallicRoughness.baseColorFactor);
 
-	if (pbrMetallicRoughness.metallicRoughness) {
-		pbrMetallicRoughness.metallicRoughness->texUnit(shader, "metallicRoughness");
-		pbrMetallicRoughness.metallicRoughness->bind();
-		glUniform1i(glGetUniformLocation(shader->ID, "hasMetallicRoughnessTexture"), 1);
-	}
-	else {
-		glUniform1i(glGetUniformLocation(shader->ID, "hasMetallicRoughnessTexture"), 0);
-	}
+	bindSlot(shader, emissiveTexture, EMISSIVE_UNIT, emissiveUniform, hasEmissiveTextureUniform);
+	bindSlot(shader, normalMap, NORMAL_MAP_UNIT, normalMapUniform, hasNormalTextureUniform);
+	bindSlot(shader, occlusionTexture, OCCLUSION_UNIT, occlusionUniform, hasOcclusionTextureUniform);
+}
 
-	glUniform1f(glGetUniformLocation(shader->ID, "metallicFactor"), pbrMetallicRoughness.metallicFactor);
-	glUniform1f(glGetUniformLocation(shader->ID, "roughnessFactor"), pbrMetallicRoughness.roughnessFactor);
-	glUniform4f(glGetUniformLocation(shader->ID, "baseColorFactor"), pbrMetallicRoughness.baseColorFactor.x,
-																	pbrMetallicRoughness.baseColorFactor.y,
-																	pbrMetallicRoughness.baseColorFactor.z,
-																	pbrMetallicRoughness.baseColorFactor.w);
-
-	if (emissiveTexture) {
-		emissiveTexture->texUnit(shader, "emissive");
-		emissiveTexture->bind();
-		glUniform1i(glGetUniformLocation(shader->ID, "hasEmissiveTexture"), 1);
-	} else {
-		glUniform1i(glGetUniformLocation(shader->ID, "hasEmissiveTexture"), 0);
+bool Material::isIndexable() const {
+	for (const Texture* texture : { pbrMetallicRoughness.baseColorTexture, pbrMetallicRoughness.metallicRoughness, emissiveTexture, normalMap, occlusionTexture }) {
+		if (texture && !texture->isIndexable())
+			return false;
 	}
+	return true;
+}
 
-	if (normalMap) {
-		normalMap->texUnit(shader, "normalMap");
-		normalMap->bind();
-		glUniform1i(glGetUniformLocation(shader->ID, "hasNormalTexture"), 1);
-	}
-	else {
-		glUniform1i(glGetUniformLocation(shader->ID, "hasNormalTexture"), 0);
-	}
-
-	if (occlusionTexture) {
-		occlusionTexture->texUnit(shader, "occlusion");
-		occlusionTexture->bind();
-		glUniform1i(glGetUniformLocation(shader->ID, "hasOcclusionTexture"), 1);
-	}
-	else {
-		glUniform1i(glGetUniformLocation(shader->ID, "hasOcclusionTexture"), 0);
+void Material::markUsed(float screenSize) {
+	TextureStreamer& streamer = TextureStreamer::shared();
+	for (Texture* texture : { pbrMetallicRoughness.baseColorTexture, pbrMetallicRoughness.metallicRoughness, emissiveTexture, normalMap, occlusionTexture }) {
+		if (texture && texture->isStreamed())
+			streamer.markUsed(texture, screenSize);
 	}
-}
\ No newline at end of file
+}
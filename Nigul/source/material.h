@@ -13,6 +13,17 @@ enum ALPHAMODE {
     OPAQUE_MODE
 };
 
+// Texture unit of each material slot, textures are shared between models (see TextureCache) so their own unit
+// would collide. Units from MATERIAL_TEXTURE_UNITS on are free for the shadow maps
+enum MaterialTextureUnit {
+    ALBEDO_UNIT,
+    METALLIC_ROUGHNESS_UNIT,
+    EMISSIVE_UNIT,
+    NORMAL_MAP_UNIT,
+    OCCLUSION_UNIT,
+    MATERIAL_TEXTURE_UNITS
+};
+
 struct PbrMetallicRoughness {
     glm::vec4 baseColorFactor = glm::vec4(1.0f);  // len = 4. default [1,1,1,1]
     Texture* baseColorTexture = nullptr;
@@ -40,4 +51,8 @@ public:
     Material();
 
     void bind(Shader* shader);
+    // Whether the shaders reach every texture of the material without it being bound
+    bool isIndexable() const;
+    // Reports every texture of the material to the TextureStreamer as drawn screenSize pixels large
+    void markUsed(float screenSize);
 };
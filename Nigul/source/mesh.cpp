@@ -1,23 +1,126 @@
 #include "Mesh.h"
 
-Primitive::Primitive(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, Material* material)
+#include <cmath>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Octahedral encoding, the unit sphere is folded onto a square so two components are enough
+static glm::vec2 octEncode(glm::vec3 n)
+{
+	float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (sum == 0.0f)
+		return glm::vec2(0.0f);
+	glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+	if (n.z < 0.0f) {
+		p = glm::vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+// Positions are quantized inside the bounds, center and half extent go to the dequantize matrix
+static std::vector<PackedVertex> packVertices(const Vertex* vertices, size_t numVertices, glm::vec3 center, glm::vec3 halfExtent)
 {
-	Primitive::vertices = vertices;
-	Primitive::indices = indices;
+	std::vector<PackedVertex> packed(numVertices);
+	for (size_t i = 0; i < numVertices; i++) {
+		const Vertex& vertex = vertices[i];
+		PackedVertex& out = packed[i];
+
+		glm::vec3 position = (vertex.position - center) / halfExtent;
+		for (int c = 0; c < 3; c++)
+			out.position[c] = static_cast<GLshort>(glm::packSnorm1x16(position[c]));
+		out.position[3] = 0;
+
+		glm::vec2 normal = octEncode(vertex.normal);
+		out.normal[0] = static_cast<GLshort>(glm::packSnorm1x16(normal.x));
+		out.normal[1] = static_cast<GLshort>(glm::packSnorm1x16(normal.y));
+
+		out.texUV[0] = glm::packHalf1x16(vertex.texUV.x);
+		out.texUV[1] = glm::packHalf1x16(vertex.texUV.y);
+	}
+	return packed;
+}
+
+Primitive::Primitive(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, Material* material, bool compact, const AABB* bounds)
+{
+	Primitive::compact = compact;
+	Primitive::vertices = std::move(vertices);
+	Primitive::indices = std::move(indices);
 	Primitive::material = material;
 
+	setupBuffers(Primitive::vertices.data(), Primitive::vertices.size(), Primitive::indices.data(), Primitive::indices.size(), bounds);
+}
+
+Primitive::Primitive(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, Material* material, bool compact, const AABB* bounds)
+{
+	Primitive::compact = compact;
+	Primitive::material = material;
+
+	setupBuffers(vertices, numVertices, indices, numIndices, bounds);
+}
+
+void Primitive::setupBuffers(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, const AABB* bounds)
+{
+	vertexCount = static_cast<GLsizei>(numVertices);
+	if (bounds) {
+		boundsMin = bounds->min;
+		boundsMax = bounds->max;
+	}
+	else if (numVertices > 0) {
+		boundsMin = boundsMax = vertices[0].position;
+		for (size_t i = 1; i < numVertices; i++) {
+			boundsMin = glm::min(boundsMin, vertices[i].position);
+			boundsMax = glm::max(boundsMax, vertices[i].position);
+		}
+	}
+
 	vao.bind();
-	// Generates Vertex Buffer Object and links it to vertices
-	VBO VBO(vertices);
-	// Generates Element Buffer Object and links it to indices
-	EBO EBO(indices);
-	// Links VBO attributes such as coordinates and colors to VAO
-	vao.linkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)0);
-	vao.linkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)(3 * sizeof(float)));
-	vao.linkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void*)(6 * sizeof(float)));
-	vao.linkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)(9 * sizeof(float)));
+	// Generates Vertex Buffer Object and links it to vertices, packed to 16 bytes when compact
+	std::vector<PackedVertex> packed;
+	if (compact) {
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+		// Flat axes keep a unit scale so the division stays finite
+		for (int c = 0; c < 3; c++) {
+			if (halfExtent[c] <= 0.0f)
+				halfExtent[c] = 1.0f;
+		}
+		packed = packVertices(vertices, numVertices, center, halfExtent);
+		dequantizeMatrix = glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+	}
+	VBO VBO = compact ? ::VBO(packed.data(), numVertices) : ::VBO(vertices, numVertices);
+	// Generates Element Buffer Object and links it to indices, narrowed to 16 bits when the vertex count allows it
+	indexCount = static_cast<GLsizei>(numIndices);
+	indexType = numVertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	std::vector<GLushort> shortIndices;
+	if (indexType == GL_UNSIGNED_SHORT)
+		shortIndices.assign(indices, indices + numIndices);
+	EBO EBO = indexType == GL_UNSIGNED_SHORT ? ::EBO(shortIndices.data(), numIndices) : ::EBO(indices, numIndices);
+	vertexBuffer = VBO.ID;
+	indexBuffer = EBO.ID;
+	// Links VBO attributes such as coordinates and normals to VAO, the color is constant and never uploaded
+	if (compact) {
+		vao.linkAttrib(VBO, 0, 3, GL_SHORT, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position), GL_TRUE);
+		vao.linkAttrib(VBO, 1, 2, GL_SHORT, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal), GL_TRUE);
+		vao.linkAttrib(VBO, 3, 2, GL_HALF_FLOAT, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texUV));
+	}
+	else {
+		vao.linkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, position));
+		vao.linkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+		vao.linkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, texUV));
+	}
 	// Unbind all to prevent accidentally modifying them
 	vao.unbind();
 	VBO.Unbind();
 	EBO.Unbind();
-}
\ No newline at end of file
+}
+
+size_t Primitive::releaseCpuData()
+{
+	size_t freed = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint);
+	// Swapping with empty vectors gives the memory back, clear() would keep the capacity
+	std::vector<Vertex>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+	return freed;
+}
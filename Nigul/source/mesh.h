@@ -8,6 +8,7 @@
 #include "VAO.h"
 #include "EBO.h"
 #include "Material.h"
+#include "bounds.h"
 
 struct Primitive
 {
@@ -16,8 +17,40 @@ struct Primitive
 	Material* material = nullptr;
 
 	VAO vao;
-
-	Primitive(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, Material* material = nullptr);
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when every vertex can be addressed with 16 bits
+	GLsizei indexCount = 0;
+	GLsizei vertexCount = 0;
+
+	// Place in the GeometryPool of the model once merged, the buffers above are freed then
+	int poolGroup = -1;
+	GLuint firstIndex = 0;
+	GLint baseVertex = 0;
+	inline bool isPooled() const { return poolGroup >= 0; }
+
+	// Object space bounds of the positions, still valid once the CPU copies are released
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	// Uploaded as PackedVertex, the shaders decode octahedral normals and positions go through dequantizeMatrix
+	bool compact = false;
+	// Maps the snorm16 positions back to object space, applied before the node matrix. Identity for full vertices
+	glm::mat4 dequantizeMatrix = glm::mat4(1.0f);
+
+	// Takes ownership of the vertices and indices and uploads them to the GPU. Bounds known by the caller (the glTF
+	// accessor min and max) save a pass over the vertices, they are computed when missing
+	Primitive(std::vector<Vertex>&& vertices, std::vector<GLuint>&& indices, Material* material = nullptr, bool compact = false, const AABB* bounds = nullptr);
+	// Uploads straight from memory it does not own (a mapped scene cache), nothing is kept on the CPU
+	Primitive(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, Material* material = nullptr, bool compact = false, const AABB* bounds = nullptr);
+
+	// Frees the vertices and indices, the primitive can still be drawn from its GL buffers. Returns the bytes freed
+	size_t releaseCpuData();
+	inline bool isResident() const { return vertices.empty() && vertexCount > 0; }
+	inline AABB getBounds() const { return { boundsMin, boundsMax }; }
+
+private:
+	void setupBuffers(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, const AABB* bounds);
 };
 
 class Mesh
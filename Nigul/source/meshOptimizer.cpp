@@ -0,0 +1,219 @@
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const int CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	// Nothing left to draw with this vertex
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// Used by the last triangle, a fixed score so the next triangle does not just reuse its edge
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			float scale = 1.0f / (CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+
+	// Favour vertices with few triangles left, so they leave the cache for good
+	score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+	return score;
+}
+
+bool MeshOptimizer::canOptimize(GLenum mode, const std::vector<GLuint>& indices, size_t numVertices)
+{
+	if (mode != GL_TRIANGLES || indices.size() % 3 != 0)
+		return false;
+	return std::all_of(indices.begin(), indices.end(), [numVertices](GLuint index) { return index < numVertices; });
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<GLuint>& indices, size_t numVertices)
+{
+	// The emit loop below walks whole triangles and indexes per vertex arrays with the indices
+	if (!canOptimize(GL_TRIANGLES, indices, numVertices))
+		return;
+
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles of every vertex, the live ones are kept in front and counted by remaining
+	std::vector<uint32_t> remaining(numVertices, 0);
+	for (GLuint index : indices)
+		remaining[index]++;
+
+	std::vector<uint32_t> offsets(numVertices + 1, 0);
+	for (size_t v = 0; v < numVertices; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < numTriangles; t++) {
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+	}
+
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> scores(numVertices);
+	for (size_t v = 0; v < numVertices; v++)
+		scores[v] = vertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScores(numTriangles);
+	std::vector<bool> emitted(numTriangles, false);
+	int bestTriangle = 0;
+	for (size_t t = 0; t < numTriangles; t++) {
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+		if (triangleScores[t] > triangleScores[bestTriangle])
+			bestTriangle = static_cast<int>(t);
+	}
+
+	std::vector<GLuint> result;
+	result.reserve(indices.size());
+
+	// Three extra slots hold the vertices of the triangle just added before the oldest ones fall out
+	std::vector<uint32_t> cache, newCache;
+	cache.reserve(CACHE_SIZE + 3);
+	newCache.reserve(CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+
+	while (result.size() < indices.size()) {
+		// Nothing in the cache has triangles left, continue with the next triangle in the original order
+		if (bestTriangle < 0) {
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = static_cast<int>(scanCursor);
+		}
+
+		emitted[bestTriangle] = true;
+		const GLuint* triangle = &indices[bestTriangle * 3];
+
+		newCache.clear();
+		for (int k = 0; k < 3; k++) {
+			GLuint v = triangle[k];
+			result.push_back(v);
+			newCache.push_back(v);
+
+			// Remove the triangle from the live list of the vertex
+			uint32_t begin = offsets[v], end = offsets[v] + remaining[v];
+			for (uint32_t i = begin; i < end; i++) {
+				if (adjacency[i] == static_cast<uint32_t>(bestTriangle)) {
+					std::swap(adjacency[i], adjacency[end - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		for (uint32_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache.push_back(v);
+		}
+
+		// Vertices pushed out of the cache lose their cache score
+		for (size_t i = CACHE_SIZE; i < newCache.size(); i++)
+			cachePosition[newCache[i]] = -1;
+		if (newCache.size() > CACHE_SIZE)
+			newCache.resize(CACHE_SIZE);
+		for (size_t i = 0; i < newCache.size(); i++)
+			cachePosition[newCache[i]] = static_cast<int>(i);
+
+		// Rescore every vertex whose position changed, including the evicted ones, and their live triangles
+		auto rescore = [&](uint32_t v) {
+			float score = vertexScore(cachePosition[v], remaining[v]);
+			float delta = score - scores[v];
+			scores[v] = score;
+			for (uint32_t i = offsets[v]; i < offsets[v] + remaining[v]; i++)
+				triangleScores[adjacency[i]] += delta;
+		};
+		for (uint32_t v : cache) {
+			if (cachePosition[v] == -1)
+				rescore(v);
+		}
+		for (uint32_t v : newCache)
+			rescore(v);
+
+		// The next triangle is the best one touching the cache
+		bestTriangle = -1;
+		float bestScore = -std::numeric_limits<float>::max();
+		for (uint32_t v : newCache) {
+			for (uint32_t i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+				uint32_t t = adjacency[i];
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+		}
+
+		std::swap(cache, newCache);
+	}
+
+	indices.swap(result);
+}
+
+size_t MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	size_t numVertices = vertices.size();
+	if (std::any_of(indices.begin(), indices.end(), [numVertices](GLuint index) { return index >= numVertices; }))
+		return 0;
+
+	const GLuint unused = std::numeric_limits<GLuint>::max();
+	std::vector<GLuint> remap(vertices.size(), unused);
+
+	GLuint nextVertex = 0;
+	for (GLuint& index : indices) {
+		if (remap[index] == unused)
+			remap[index] = nextVertex++;
+		index = remap[index];
+	}
+
+	std::vector<Vertex> reordered(nextVertex);
+	for (size_t v = 0; v < vertices.size(); v++) {
+		if (remap[v] != unused)
+			reordered[remap[v]] = vertices[v];
+	}
+
+	size_t dropped = vertices.size() - reordered.size();
+	vertices.swap(reordered);
+	return dropped;
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<GLuint>& indices, size_t numVertices, size_t cacheSize)
+{
+	VertexCacheStats stats;
+	if (indices.empty() || !canOptimize(GL_TRIANGLES, indices, numVertices))
+		return stats;
+
+	// A vertex is still cached if fewer than cacheSize misses happened since it was loaded
+	std::vector<size_t> loadedAt(numVertices, 0);
+	size_t misses = 0;
+	size_t numReferenced = 0; // Vertices no index points at are never transformed, they do not count
+	for (GLuint index : indices) {
+		if (loadedAt[index] == 0)
+			numReferenced++;
+		if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize) {
+			misses++;
+			loadedAt[index] = misses;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+	stats.atvr = static_cast<float>(misses) / numReferenced;
+	return stats;
+}
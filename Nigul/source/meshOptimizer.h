@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+#include "VBO.h"
+
+// Post-transform cache efficiency of an index buffer
+struct VertexCacheStats
+{
+    float acmr = 0.0f; // Average cache miss ratio, vertex shader invocations per triangle
+    float atvr = 0.0f; // Average transformed vertex ratio, vertex shader invocations per referenced vertex
+};
+
+/**
+ * @class MeshOptimizer
+ * @brief Load time reordering of primitives for the GPU vertex pipeline.
+ *
+ * Triangles are reordered for the post-transform vertex cache (Forsyth's linear-speed algorithm),
+ * then vertices are reordered in first use order so the vertex fetch walks memory linearly.
+ */
+class MeshOptimizer
+{
+public:
+    /**
+     * @brief Whether a primitive can be reordered: a triangle list (GL_TRIANGLES, glTF modes have the GL values)
+     * of whole triangles whose indices all reference one of the vertices.
+     */
+    static bool canOptimize(GLenum mode, const std::vector<GLuint>& indices, size_t numVertices);
+
+    /**
+     * @brief Reorders the triangles of an indexed triangle list to maximize vertex cache hits.
+     *
+     * Indices that canOptimize rejects are left untouched.
+     */
+    static void optimizeVertexCache(std::vector<GLuint>& indices, size_t numVertices);
+
+    /**
+     * @brief Reorders the vertices in the order the indices first reference them and remaps the indices.
+     *
+     * Vertices that no index references are dropped. Nothing changes when an index is out of range.
+     *
+     * @return Number of vertices dropped.
+     */
+    static size_t optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    /**
+     * @brief Simulates a FIFO post-transform cache of the given size.
+     */
+    static VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t numVertices, size_t cacheSize = 16);
+};
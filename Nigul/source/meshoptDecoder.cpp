@@ -0,0 +1,517 @@
+#include "meshoptDecoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Vertex codec
+static const unsigned char VERTEX_HEADER = 0xa0;
+static const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+static const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+static const size_t BYTE_GROUP_SIZE = 16;
+static const size_t BYTE_GROUP_DECODE_LIMIT = 24; // Largest encoded group, 8 bytes of 4 bit values and 16 spilled bytes
+static const size_t TAIL_MIN_SIZE = 32;
+
+// Index codecs
+static const unsigned char INDEX_HEADER = 0xe0;
+static const unsigned char SEQUENCE_HEADER = 0xd0;
+
+static size_t getVertexBlockSize(size_t stride)
+{
+	// A block fills the scratch buffer and holds a whole number of byte groups
+	size_t result = VERTEX_BLOCK_SIZE_BYTES / stride;
+	result &= ~(BYTE_GROUP_SIZE - 1);
+	return result < VERTEX_BLOCK_MAX_SIZE ? result : VERTEX_BLOCK_MAX_SIZE;
+}
+
+static inline unsigned char unzigzag8(unsigned char v)
+{
+	return static_cast<unsigned char>(-(v & 1) ^ (v >> 1));
+}
+
+// 16 values of 0, 2, 4 or 8 bits, values equal to the largest small value are stored whole after the packed bits
+static const unsigned char* decodeBytesGroup(const unsigned char* data, unsigned char* buffer, int bitsLog2)
+{
+	switch (bitsLog2) {
+	case 0:
+		std::memset(buffer, 0, BYTE_GROUP_SIZE);
+		return data;
+	case 1:
+	case 2: {
+		int bits = 1 << bitsLog2;
+		int perByte = 8 / bits;
+		unsigned char sentinel = static_cast<unsigned char>((1 << bits) - 1);
+		const unsigned char* spilled = data + BYTE_GROUP_SIZE / perByte;
+		for (size_t i = 0; i < BYTE_GROUP_SIZE; i += perByte) {
+			unsigned char byte = *data++;
+			for (int k = 0; k < perByte; k++) {
+				unsigned char value = static_cast<unsigned char>(byte >> (8 - bits));
+				byte = static_cast<unsigned char>(byte << bits);
+				buffer[i + k] = value == sentinel ? *spilled++ : value;
+			}
+		}
+		return spilled;
+	}
+	default:
+		std::memcpy(buffer, data, BYTE_GROUP_SIZE);
+		return data + BYTE_GROUP_SIZE;
+	}
+}
+
+static const unsigned char* decodeBytes(const unsigned char* data, const unsigned char* dataEnd, unsigned char* buffer, size_t size)
+{
+	// Two bits per group select its width
+	const unsigned char* header = data;
+	size_t headerSize = (size / BYTE_GROUP_SIZE + 3) / 4;
+	if (static_cast<size_t>(dataEnd - data) < headerSize)
+		return nullptr;
+	data += headerSize;
+
+	for (size_t i = 0; i < size; i += BYTE_GROUP_SIZE) {
+		if (static_cast<size_t>(dataEnd - data) < BYTE_GROUP_DECODE_LIMIT)
+			return nullptr;
+		size_t group = i / BYTE_GROUP_SIZE;
+		int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+		data = decodeBytesGroup(data, buffer + i, bitsLog2);
+	}
+	return data;
+}
+
+static const unsigned char* decodeVertexBlock(const unsigned char* data, const unsigned char* dataEnd, unsigned char* destination,
+	size_t count, size_t stride, unsigned char lastVertex[256])
+{
+	unsigned char buffer[VERTEX_BLOCK_MAX_SIZE];
+	unsigned char transposed[VERTEX_BLOCK_SIZE_BYTES];
+	size_t alignedCount = (count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+	// Each byte of the vertex is its own plane of zigzag deltas from the previous vertex
+	for (size_t k = 0; k < stride; k++) {
+		data = decodeBytes(data, dataEnd, buffer, alignedCount);
+		if (!data)
+			return nullptr;
+
+		unsigned char previous = lastVertex[k];
+		size_t i = 0;
+#ifdef USE_SSE2
+		// Prefix sum of 16 deltas at a time in log steps
+		const __m128i one = _mm_set1_epi8(1);
+		const __m128i low7 = _mm_set1_epi8(0x7f);
+		for (; i + BYTE_GROUP_SIZE <= count; i += BYTE_GROUP_SIZE) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i));
+			v = _mm_xor_si128(_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, one)), _mm_and_si128(_mm_srli_epi16(v, 1), low7));
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+			v = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(previous)));
+
+			alignas(16) unsigned char values[BYTE_GROUP_SIZE];
+			_mm_store_si128(reinterpret_cast<__m128i*>(values), v);
+			for (size_t j = 0; j < BYTE_GROUP_SIZE; j++)
+				transposed[(i + j) * stride + k] = values[j];
+			previous = values[BYTE_GROUP_SIZE - 1];
+		}
+#endif
+		for (; i < count; i++) {
+			previous = static_cast<unsigned char>(previous + unzigzag8(buffer[i]));
+			transposed[i * stride + k] = previous;
+		}
+	}
+
+	std::memcpy(destination, transposed, count * stride);
+	std::memcpy(lastVertex, transposed + (count - 1) * stride, stride);
+	return data;
+}
+
+bool MeshoptDecoder::decodeVertexBuffer(unsigned char* destination, size_t count, size_t stride, const unsigned char* source, size_t sourceSize)
+{
+	if (stride == 0 || stride > 256 || stride % 4 != 0)
+		return false;
+
+	const unsigned char* data = source;
+	const unsigned char* dataEnd = source + sourceSize;
+	size_t tailSize = stride < TAIL_MIN_SIZE ? TAIL_MIN_SIZE : stride;
+	if (sourceSize < 1 + tailSize)
+		return false;
+
+	// Only version 0 exists
+	if (*data++ != VERTEX_HEADER)
+		return false;
+
+	// The first vertex every delta starts from is stored at the very end
+	unsigned char lastVertex[256];
+	std::memcpy(lastVertex, dataEnd - stride, stride);
+
+	size_t blockSize = getVertexBlockSize(stride);
+	for (size_t offset = 0; offset < count; offset += blockSize) {
+		size_t size = offset + blockSize < count ? blockSize : count - offset;
+		data = decodeVertexBlock(data, dataEnd, destination + offset * stride, size, stride, lastVertex);
+		if (!data)
+			return false;
+	}
+
+	return static_cast<size_t>(dataEnd - data) == tailSize;
+}
+
+static unsigned int decodeVByte(const unsigned char*& data)
+{
+	unsigned char lead = *data++;
+	if (lead < 128)
+		return lead;
+
+	// Up to five bytes of 7 bits, the high bit tells if another one follows
+	unsigned int result = lead & 127;
+	unsigned int shift = 7;
+	for (int i = 0; i < 4; i++) {
+		unsigned char group = *data++;
+		result |= static_cast<unsigned int>(group & 127) << shift;
+		shift += 7;
+		if (group < 128)
+			break;
+	}
+	return result;
+}
+
+static unsigned int decodeIndex(const unsigned char*& data, unsigned int last)
+{
+	unsigned int v = decodeVByte(data);
+	unsigned int delta = (v >> 1) ^ (0u - (v & 1));
+	return last + delta;
+}
+
+static inline void writeIndex(unsigned char* destination, size_t i, size_t indexSize, unsigned int index)
+{
+	if (indexSize == 2) {
+		uint16_t value = static_cast<uint16_t>(index);
+		std::memcpy(destination + i * 2, &value, 2);
+	}
+	else {
+		std::memcpy(destination + i * 4, &index, 4);
+	}
+}
+
+struct IndexFifos
+{
+	unsigned int edges[16][2];
+	unsigned int vertices[16];
+	size_t edgeOffset = 0;
+	size_t vertexOffset = 0;
+
+	IndexFifos()
+	{
+		std::memset(edges, -1, sizeof(edges));
+		std::memset(vertices, -1, sizeof(vertices));
+	}
+
+	inline void pushEdge(unsigned int a, unsigned int b)
+	{
+		edges[edgeOffset][0] = a;
+		edges[edgeOffset][1] = b;
+		edgeOffset = (edgeOffset + 1) & 15;
+	}
+
+	inline void pushVertex(unsigned int v, bool advance = true)
+	{
+		vertices[vertexOffset] = v;
+		vertexOffset = (vertexOffset + (advance ? 1 : 0)) & 15;
+	}
+
+	// Entries are addressed backwards from the most recent one
+	inline unsigned int vertex(int age) const { return vertices[(vertexOffset - age) & 15]; }
+};
+
+bool MeshoptDecoder::decodeIndexBuffer(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* source, size_t sourceSize)
+{
+	if (count % 3 != 0 || (indexSize != 2 && indexSize != 4))
+		return false;
+
+	// Header, one code per triangle and the 16 byte table of auxiliary codes at the end
+	if (sourceSize < 1 + count / 3 + 16)
+		return false;
+	if ((source[0] & 0xf0) != INDEX_HEADER)
+		return false;
+	int version = source[0] & 0x0f;
+	if (version > 1)
+		return false;
+
+	IndexFifos fifos;
+	unsigned int next = 0;
+	unsigned int last = 0;
+	// Version 1 spends the vertex FIFO codes 13 and 14 on last - 1 and last + 1
+	int fecMax = version >= 1 ? 13 : 15;
+
+	const unsigned char* code = source + 1;
+	const unsigned char* data = code + count / 3;
+	const unsigned char* dataSafeEnd = source + sourceSize - 16;
+	const unsigned char* codeAuxTable = dataSafeEnd;
+
+	for (size_t i = 0; i < count; i += 3) {
+		// A triangle reads at most 16 bytes of data, the table at the end is the padding
+		if (data > dataSafeEnd)
+			return false;
+
+		unsigned char codeTriangle = *code++;
+
+		if (codeTriangle < 0xf0) {
+			// The triangle shares an edge in the FIFO, only its third vertex is encoded
+			int fe = codeTriangle >> 4;
+			unsigned int a = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][0];
+			unsigned int b = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][1];
+			int fec = codeTriangle & 15;
+
+			unsigned int c;
+			if (fec < fecMax) {
+				c = fec == 0 ? next++ : fifos.vertex(1 + fec);
+				fifos.pushVertex(c, fec == 0);
+			}
+			else {
+				// 13 and 14 become -1 and +1, 15 is a free index
+				last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+				fifos.pushVertex(c);
+			}
+
+			writeIndex(destination, i + 0, indexSize, a);
+			writeIndex(destination, i + 1, indexSize, b);
+			writeIndex(destination, i + 2, indexSize, c);
+
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		else {
+			unsigned int a, b, c;
+			int feb, fec;
+
+			if (codeTriangle < 0xfe) {
+				// a is the next new vertex, b and c come from the table of common codes
+				unsigned char codeAux = codeAuxTable[codeTriangle & 15];
+				feb = codeAux >> 4;
+				fec = codeAux & 15;
+
+				a = next++;
+				b = feb == 0 ? next++ : fifos.vertex(feb);
+				c = fec == 0 ? next++ : fifos.vertex(fec);
+			}
+			else {
+				// The auxiliary code is spelled out, 0xff also makes a a free index
+				unsigned char codeAux = *data++;
+				int fea = codeTriangle == 0xfe ? 0 : 15;
+				feb = codeAux >> 4;
+				fec = codeAux & 15;
+
+				// Restart of the new vertex counter
+				if (codeAux == 0)
+					next = 0;
+
+				a = fea == 0 ? next++ : 0;
+				b = feb == 0 ? next++ : fifos.vertex(feb);
+				c = fec == 0 ? next++ : fifos.vertex(fec);
+
+				if (fea == 15)
+					last = a = decodeIndex(data, last);
+				if (feb == 15)
+					last = b = decodeIndex(data, last);
+				if (fec == 15)
+					last = c = decodeIndex(data, last);
+			}
+
+			writeIndex(destination, i + 0, indexSize, a);
+			writeIndex(destination, i + 1, indexSize, b);
+			writeIndex(destination, i + 2, indexSize, c);
+
+			fifos.pushVertex(a);
+			fifos.pushVertex(b, feb == 0 || feb == 15);
+			fifos.pushVertex(c, fec == 0 || fec == 15);
+
+			fifos.pushEdge(b, a);
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+	}
+
+	// Every byte up to the table has to be used
+	return data == dataSafeEnd;
+}
+
+bool MeshoptDecoder::decodeIndexSequence(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* source, size_t sourceSize)
+{
+	if (indexSize != 2 && indexSize != 4)
+		return false;
+
+	// Header, at least one byte per index and a 4 byte tail
+	if (sourceSize < 1 + count + 4)
+		return false;
+	if ((source[0] & 0xf0) != SEQUENCE_HEADER)
+		return false;
+	int version = source[0] & 0x0f;
+	if (version > 1)
+		return false;
+
+	const unsigned char* data = source + 1;
+	const unsigned char* dataSafeEnd = source + sourceSize - 4;
+
+	// Deltas are taken from one of two baselines, selected by the low bit
+	unsigned int last[2] = { 0, 0 };
+
+	for (size_t i = 0; i < count; i++) {
+		// An index reads at most 5 bytes, the tail is the padding
+		if (data >= dataSafeEnd)
+			return false;
+
+		unsigned int v = decodeVByte(data);
+		unsigned int baseline = v & 1;
+		v >>= 1;
+
+		unsigned int delta = (v >> 1) ^ (0u - (v & 1));
+		unsigned int index = last[baseline] + delta;
+		last[baseline] = index;
+
+		writeIndex(destination, i, indexSize, index);
+	}
+
+	return data == dataSafeEnd;
+}
+
+template <typename T>
+static void decodeFilterOctahedral(T* data, size_t count)
+{
+	const float maxValue = static_cast<float>((1 << (sizeof(T) * 8 - 1)) - 1);
+
+	for (size_t i = 0; i < count; i++) {
+		// z holds the value 1.0 maps to, the unit vector is rebuilt and renormalized to it
+		float x = static_cast<float>(data[i * 4 + 0]);
+		float y = static_cast<float>(data[i * 4 + 1]);
+		float z = static_cast<float>(data[i * 4 + 2]) - std::abs(x) - std::abs(y);
+
+		// Unfold the lower hemisphere
+		float t = z < 0.0f ? z : 0.0f;
+		x += x >= 0.0f ? t : -t;
+		y += y >= 0.0f ? t : -t;
+
+		float length = std::sqrt(x * x + y * y + z * z);
+		float scale = maxValue / length;
+
+		data[i * 4 + 0] = static_cast<T>(static_cast<int>(x * scale + (x >= 0.0f ? 0.5f : -0.5f)));
+		data[i * 4 + 1] = static_cast<T>(static_cast<int>(y * scale + (y >= 0.0f ? 0.5f : -0.5f)));
+		data[i * 4 + 2] = static_cast<T>(static_cast<int>(z * scale + (z >= 0.0f ? 0.5f : -0.5f)));
+	}
+}
+
+static void decodeFilterQuaternion(int16_t* data, size_t count)
+{
+	const float scale = 1.0f / std::sqrt(2.0f);
+
+	for (size_t i = 0; i < count; i++) {
+		// The fourth component holds the range of the other three and which component was dropped
+		int rangeBits = data[i * 4 + 3] | 3;
+		float range = scale / static_cast<float>(rangeBits);
+
+		float x = static_cast<float>(data[i * 4 + 0]) * range;
+		float y = static_cast<float>(data[i * 4 + 1]) * range;
+		float z = static_cast<float>(data[i * 4 + 2]) * range;
+
+		// The dropped component is the largest one, always positive
+		float ww = 1.0f - x * x - y * y - z * z;
+		float w = std::sqrt(ww >= 0.0f ? ww : 0.0f);
+
+		int xf = static_cast<int>(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f));
+		int yf = static_cast<int>(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f));
+		int zf = static_cast<int>(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f));
+		int wf = static_cast<int>(w * 32767.0f + 0.5f);
+
+		int dropped = data[i * 4 + 3] & 3;
+		data[i * 4 + ((dropped + 1) & 3)] = static_cast<int16_t>(xf);
+		data[i * 4 + ((dropped + 2) & 3)] = static_cast<int16_t>(yf);
+		data[i * 4 + ((dropped + 3) & 3)] = static_cast<int16_t>(zf);
+		data[i * 4 + ((dropped + 0) & 3)] = static_cast<int16_t>(wf);
+	}
+}
+
+static void decodeFilterExponential(uint32_t* data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		// 24 bit signed mantissa and 8 bit signed exponent, ldexp without the library call
+		uint32_t v = data[i];
+		int mantissa = static_cast<int>(v << 8) >> 8;
+		int exponent = static_cast<int>(v) >> 24;
+
+		uint32_t powerBits = static_cast<uint32_t>(exponent + 127) << 23;
+		float power;
+		std::memcpy(&power, &powerBits, sizeof(float));
+		float value = power * static_cast<float>(mantissa);
+		std::memcpy(&data[i], &value, sizeof(float));
+	}
+}
+
+bool MeshoptDecoder::applyFilter(unsigned char* data, size_t count, size_t stride, MeshoptFilter filter)
+{
+	switch (filter) {
+	case MESHOPT_FILTER_NONE:
+		return true;
+	case MESHOPT_FILTER_OCTAHEDRAL:
+		if (stride == 4)
+			decodeFilterOctahedral(reinterpret_cast<int8_t*>(data), count);
+		else if (stride == 8)
+			decodeFilterOctahedral(reinterpret_cast<int16_t*>(data), count);
+		else
+			return false;
+		return true;
+	case MESHOPT_FILTER_QUATERNION:
+		if (stride != 8)
+			return false;
+		decodeFilterQuaternion(reinterpret_cast<int16_t*>(data), count);
+		return true;
+	case MESHOPT_FILTER_EXPONENTIAL:
+		if (stride % 4 != 0)
+			return false;
+		decodeFilterExponential(reinterpret_cast<uint32_t*>(data), count * (stride / 4));
+		return true;
+	}
+	return false;
+}
+
+bool MeshoptDecoder::decode(unsigned char* destination, size_t count, size_t stride, MeshoptMode mode, MeshoptFilter filter,
+	const unsigned char* source, size_t sourceSize)
+{
+	switch (mode) {
+	case MESHOPT_MODE_ATTRIBUTES:
+		return decodeVertexBuffer(destination, count, stride, source, sourceSize) && applyFilter(destination, count, stride, filter);
+	case MESHOPT_MODE_TRIANGLES:
+		return filter == MESHOPT_FILTER_NONE && decodeIndexBuffer(destination, count, stride, source, sourceSize);
+	case MESHOPT_MODE_INDICES:
+		return filter == MESHOPT_FILTER_NONE && decodeIndexSequence(destination, count, stride, source, sourceSize);
+	}
+	return false;
+}
+
+bool MeshoptDecoder::parseMode(const std::string& name, MeshoptMode& mode)
+{
+	if (name == "ATTRIBUTES")
+		mode = MESHOPT_MODE_ATTRIBUTES;
+	else if (name == "TRIANGLES")
+		mode = MESHOPT_MODE_TRIANGLES;
+	else if (name == "INDICES")
+		mode = MESHOPT_MODE_INDICES;
+	else
+		return false;
+	return true;
+}
+
+bool MeshoptDecoder::parseFilter(const std::string& name, MeshoptFilter& filter)
+{
+	if (name.empty() || name == "NONE")
+		filter = MESHOPT_FILTER_NONE;
+	else if (name == "OCTAHEDRAL")
+		filter = MESHOPT_FILTER_OCTAHEDRAL;
+	else if (name == "QUATERNION")
+		filter = MESHOPT_FILTER_QUATERNION;
+	else if (name == "EXPONENTIAL")
+		filter = MESHOPT_FILTER_EXPONENTIAL;
+	else
+		return false;
+	return true;
+}
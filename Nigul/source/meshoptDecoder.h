@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// How a compressed buffer view was encoded, the "mode" of EXT_meshopt_compression
+enum MeshoptMode
+{
+    MESHOPT_MODE_ATTRIBUTES,
+    MESHOPT_MODE_TRIANGLES,
+    MESHOPT_MODE_INDICES
+};
+
+// Transform applied to attribute data after decoding, the "filter" of EXT_meshopt_compression
+enum MeshoptFilter
+{
+    MESHOPT_FILTER_NONE,
+    MESHOPT_FILTER_OCTAHEDRAL,
+    MESHOPT_FILTER_QUATERNION,
+    MESHOPT_FILTER_EXPONENTIAL
+};
+
+/**
+ * @class MeshoptDecoder
+ * @brief Decoder for buffer views compressed with EXT_meshopt_compression.
+ *
+ * Implements the three bitstreams of the extension: the vertex codec (byte planes of deltas
+ * between consecutive elements), the triangle index codec (edge and vertex FIFOs) and the index
+ * sequence codec (delta varints), plus the octahedral, quaternion and exponential filters.
+ * Every function validates its input and never reads outside of the source.
+ */
+class MeshoptDecoder
+{
+public:
+    /**
+     * @brief Decodes a whole compressed buffer view into destination, count * stride bytes.
+     *
+     * @return false if the data is malformed or the mode, filter and stride do not go together.
+     */
+    static bool decode(unsigned char* destination, size_t count, size_t stride, MeshoptMode mode, MeshoptFilter filter,
+        const unsigned char* source, size_t sourceSize);
+
+    /**
+     * @brief Vertex codec, stride must be a multiple of 4 up to 256 bytes.
+     */
+    static bool decodeVertexBuffer(unsigned char* destination, size_t count, size_t stride, const unsigned char* source, size_t sourceSize);
+
+    /**
+     * @brief Triangle index codec, count is a multiple of 3 and indexSize is 2 or 4.
+     */
+    static bool decodeIndexBuffer(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* source, size_t sourceSize);
+
+    /**
+     * @brief Index sequence codec, indexSize is 2 or 4.
+     */
+    static bool decodeIndexSequence(unsigned char* destination, size_t count, size_t indexSize, const unsigned char* source, size_t sourceSize);
+
+    /**
+     * @brief Applies a filter in place to count elements of stride bytes.
+     */
+    static bool applyFilter(unsigned char* data, size_t count, size_t stride, MeshoptFilter filter);
+
+    static bool parseMode(const std::string& name, MeshoptMode& mode);
+    static bool parseFilter(const std::string& name, MeshoptFilter& filter);
+};
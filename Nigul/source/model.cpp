@@ -9,9 +9,167 @@
 #include <tinyGLTF/tinyGLTF.h>
 
 #include <glm/gtx/string_cast.hpp>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "threadPool.h"
+#include "sceneCache.h"
+#include "textureCompressor.h"
+#include "textureStreamer.h"
+#include "textureCache.h"
+#include "meshOptimizer.h"
+#include "meshoptDecoder.h"
+
+// Binary glTF container
+static const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+static const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+// Smallest buffer tinygltf accepts, the real bytes stay in the mapped file
+static const char* MAPPED_BUFFER_PLACEHOLDER = "data:application/octet-stream;base64,AA==";
+
+struct GlbChunks {
+	const unsigned char* json = nullptr;
+	size_t jsonSize = 0;
+	const unsigned char* bin = nullptr;
+	size_t binSize = 0;
+};
+
+static bool parseGlb(const unsigned char* data, size_t size, GlbChunks& chunks, std::string& err) {
+	auto readU32 = [data](size_t offset) {
+		uint32_t value;
+		std::memcpy(&value, data + offset, sizeof(uint32_t));
+		return value;
+	};
+
+	if (size < 20 || readU32(0) != GLB_MAGIC) {
+		err = "Invalid GLB header";
+		return false;
+	}
+	if (readU32(4) != 2) {
+		err = "Only GLB version 2 is supported";
+		return false;
+	}
+
+	size_t length = std::min<size_t>(readU32(8), size);
+	size_t offset = 12;
+	while (offset + 8 <= length) {
+		size_t chunkLength = readU32(offset);
+		uint32_t chunkType = readU32(offset + 4);
+		offset += 8;
+		if (offset + chunkLength > length) {
+			err = "GLB chunk exceeds the file size";
+			return false;
+		}
+
+		if (chunkType == GLB_CHUNK_JSON && !chunks.json) {
+			chunks.json = data + offset;
+			chunks.jsonSize = chunkLength;
+		}
+		else if (chunkType == GLB_CHUNK_BIN && !chunks.bin) {
+			chunks.bin = data + offset;
+			chunks.binSize = chunkLength;
+		}
+		offset += (chunkLength + 3) & ~size_t(3);
+	}
+
+	if (!chunks.json) {
+		err = "GLB without JSON chunk";
+		return false;
+	}
+	return true;
+}
+
+// Keeps embedded images encoded, they are decoded later by the texture worker pool
+static bool storeEncodedImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*) {
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+// Parses the glTF JSON but leaves every binary buffer inside its file, they are mapped afterwards by mapBufferSources
+static bool loadMappedGltf(Model* owner, tinygltf::TinyGLTF& loader, tinygltf::Model* output, std::string* err, std::string* warn) {
+	MappedFile source(owner->file);
+	if (!source.isOpen()) {
+		*err = "Failed to map file: " + owner->file;
+		return false;
+	}
+
+	const char* jsonText = reinterpret_cast<const char*>(source.data());
+	size_t jsonSize = source.size();
+	if (owner->isBinary) {
+		GlbChunks chunks;
+		if (!parseGlb(source.data(), source.size(), chunks, *err))
+			return false;
+		jsonText = reinterpret_cast<const char*>(chunks.json);
+		jsonSize = chunks.jsonSize;
+	}
+
+	nlohmann::json document = nlohmann::json::parse(jsonText, jsonText + jsonSize, nullptr, false);
+	if (document.is_discarded()) {
+		*err = "Failed to parse glTF JSON: " + owner->file;
+		return false;
+	}
+
+	owner->mappedBufferUris.clear();
+	owner->mappedBufferSizes.clear();
+	owner->mappedImageViews.clear();
 
-// Global model as tinygltf can only be loaded in one cpp file
-tinygltf::Model model;
+	if (document.contains("buffers")) {
+		for (auto& buffer : document["buffers"]) {
+			std::string uri = buffer.value("uri", "");
+			owner->mappedBufferSizes.push_back(buffer.value("byteLength", size_t(0)));
+
+			if (tinygltf::IsDataURI(uri)) {
+				owner->mappedBufferUris.push_back(""); // Embedded as base64, tinygltf has to decode it
+				owner->mappedBufferSizes.back() = 0;
+				continue;
+			}
+
+			// Fallback of EXT_meshopt_compression, it has no data of its own and is filled by decodeCompressedViews
+			if (uri.empty() && buffer.contains("extensions") && buffer["extensions"].contains("EXT_meshopt_compression")
+				&& buffer["extensions"]["EXT_meshopt_compression"].value("fallback", false)) {
+				owner->mappedBufferUris.push_back("");
+				owner->mappedBufferSizes.back() = 0;
+				buffer["uri"] = MAPPED_BUFFER_PLACEHOLDER;
+				buffer["byteLength"] = 1;
+				continue;
+			}
+
+			owner->mappedBufferUris.push_back(uri);
+			buffer["uri"] = MAPPED_BUFFER_PLACEHOLDER;
+			buffer["byteLength"] = 1;
+		}
+	}
+
+	if (document.contains("images")) {
+		for (auto& image : document["images"]) {
+			// Images inside a buffer view are decoded straight from the mapping
+			if (image.contains("bufferView")) {
+				owner->mappedImageViews.push_back(image["bufferView"].get<int>());
+				image.erase("bufferView");
+				image["uri"] = "";
+			}
+			else {
+				owner->mappedImageViews.push_back(-1);
+			}
+		}
+	}
+
+	std::string json = document.dump();
+	std::string baseDir = std::filesystem::path(owner->file).parent_path().string();
+	if (!loader.LoadASCIIFromString(output, err, warn, json.c_str(), static_cast<unsigned int>(json.size()), baseDir))
+		return false;
+
+	return owner->mapBufferSources();
+}
 
 Node::Node(int id, glm::mat4 matrix, glm::mat4 globalMatrix, Node* parent, std::string name):
 	matrix(matrix), globalMatrix(globalMatrix), parent(parent), name(name), id(id)
@@ -40,21 +198,297 @@ bool Node::isLeaf() const
 
 Model::Model()
 {
+	gltf = std::make_unique<tinygltf::Model>();
 	root = std::make_unique<Node>();
 	numNodes = 1;
 }
 
+Model::~Model()
+{
+	// The loading thread may be waiting for GL work, the cancelled tasks are skipped
+	if (isLoading()) {
+		cancelLoad();
+		while (!updateLoad(std::numeric_limits<double>::max()))
+			std::this_thread::yield();
+	}
+}
+
 void Model::load()
+{
+	asyncLoad = false;
+	cancelRequested = false;
+
+	if (loadContents())
+		finishLoad();
+	else
+		loadStage = LOAD_FAILED;
+}
+
+void Model::loadAsync()
+{
+	if (isLoading() || loaded)
+		return;
+
+	asyncLoad = true;
+	cancelRequested = false;
+	workerDone = false;
+
+	loadThread = std::thread([this]() {
+		try {
+			if (loadContents())
+				runOnGLThread([this]() { finishLoad(); });
+		}
+		catch (const std::exception& e) {
+			if (!cancelRequested)
+				std::cerr << "Failed to load " << file << ": " << e.what() << std::endl;
+		}
+		// Every task of this load is queued before the GL thread sees this
+		workerDone = true;
+	});
+}
+
+bool Model::updateLoad(double budgetMs)
+{
+	if (!isLoading())
+		return true;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool finished = workerDone;
+
+	std::function<void()> task;
+	while (glTasks.tryPop(task)) {
+		task();
+		if (std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budgetMs)
+			return false;
+	}
+
+	if (!finished)
+		return false;
+
+	loadThread.join();
+	asyncLoad = false;
+
+	if (!loaded) {
+		unload();
+		if (cancelRequested) {
+			std::cout << "Cancelled loading " << file << std::endl;
+			loadStage = LOAD_IDLE;
+		}
+		else {
+			loadStage = LOAD_FAILED;
+		}
+	}
+	return true;
+}
+
+void Model::cancelLoad()
+{
+	if (isLoading())
+		cancelRequested = true;
+}
+
+void Model::checkCancelled()
+{
+	if (cancelRequested)
+		throw std::runtime_error("Load cancelled");
+}
+
+float Model::getLoadProgress() const
+{
+	if (loadStage == LOAD_DONE)
+		return 1.0f;
+	int total = loadWorkTotal;
+	return total > 0 ? std::min(static_cast<float>(loadWorkDone) / total, 1.0f) : 0.0f;
+}
+
+const char* Model::getLoadStageName(LoadStage stage)
+{
+	switch (stage) {
+	case LOAD_PARSE: return "Parsing";
+	case LOAD_DECODE: return "Decoding";
+	case LOAD_UPLOAD: return "Uploading";
+	case LOAD_TRAVERSE: return "Building the scene";
+	case LOAD_DONE: return "Loaded";
+	case LOAD_FAILED: return "Failed";
+	default: return "Idle";
+	}
+}
+
+std::future<void> Model::runOnGLThread(std::function<void()> task)
+{
+	auto packagedTask = std::make_shared<std::packaged_task<void()>>([this, task = std::move(task)]() {
+		if (!cancelRequested)
+			task();
+	});
+	std::future<void> result = packagedTask->get_future();
+
+	if (asyncLoad)
+		glTasks.push([packagedTask]() { (*packagedTask)(); });
+	else
+		(*packagedTask)();
+
+	return result;
+}
+
+void Model::waitForGLThread(std::vector<std::future<void>>& tasks)
+{
+	LoadStage stage = loadStage;
+	loadStage = LOAD_UPLOAD;
+
+	// Every task has to end before rethrowing, they reference the state of the caller
+	std::exception_ptr error;
+	for (std::future<void>& task : tasks) {
+		try {
+			task.get();
+		}
+		catch (...) {
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+	tasks.clear();
+	loadStage = stage;
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+bool Model::loadContents()
+{
+	loadStart = std::chrono::high_resolution_clock::now();
+	loadStage = LOAD_PARSE;
+	loadWorkDone = 0;
+	loadWorkTotal = 0;
+
+	std::string extension = std::filesystem::path(file).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	isBinary = (extension == ".glb");
+
+	// A valid baked cache replaces the whole glTF parse
+	loadedFromCache = useSceneCache && SceneCache::load(*this);
+	checkCancelled();
+
+	if (!loadedFromCache) {
+		if (!parseGltf())
+			return false;
+		checkCancelled();
+
+		// One unit of work per image decode and upload and per primitive decode and upload
+		int numPrimitives = 0;
+		for (const auto& mesh : gltf->meshes)
+			numPrimitives += static_cast<int>(mesh.primitives.size());
+		loadWorkTotal = 2 * static_cast<int>(gltf->textures.size()) + 2 * numPrimitives;
+		loadStage = LOAD_DECODE;
+
+		loadTextures(); // Load all textures
+		loadMaterials(); // Load all materials
+		loadMeshes(); // Load all meshes
+		loadLights(); // Load all lights
+		loadCameras(); // Load all cameras
+		loadModelProperties(); // Load the model properties 
+		checkCancelled();
+
+		// Traverse all nodes
+		loadStage = LOAD_TRAVERSE;
+		auto rootNodes = findRootNodes();
+		for (unsigned int rootNodeIndex : rootNodes) {
+			traverseNode(rootNodeIndex, root->matrix, root.get());
+		}
+
+		// If there is no camera, we add a default one
+		if (nodeWithCamera == -1)
+			addMainCameraNode();
+	}
+
+	// We update cameras and lights
+	loadStage = LOAD_TRAVERSE;
+	updateTreeFrom(root.get(), glm::mat4(1.0f));
+
+	// Baked while the buffers are still mapped, embedded images are copied from them
+	if (!loadedFromCache && useSceneCache)
+		SceneCache::save(*this);
+
+	// Everything is already on the GPU, the files are mapped again if the model is saved
+	textureSources.clear();
+	releaseMappedBuffers();
+
+	if (gpuResident) {
+		size_t geometryBytes = releaseCpuGeometry();
+		size_t bufferBytes = retainSourceBuffers ? 0 : releaseSourceBuffers();
+		std::cout << "Released " << (geometryBytes + bufferBytes) / 1024 << " KB of CPU memory for " << file
+			<< " (geometry " << geometryBytes / 1024 << " KB, glTF buffers " << bufferBytes / 1024 << " KB)" << std::endl;
+	}
+
+	return true;
+}
+
+void Model::finishLoad()
+{
+	// Set up flags
+	lightFlags.set();
+
+	loaded = true;
+	loadStage = LOAD_DONE;
+	bvh.invalidate();
+	if (mergeGeometry)
+		geometryPool.build(lodMesh);
+
+	double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	std::cout << "Loaded " << file << (loadedFromCache ? " from its scene cache" : "") << (asyncLoad ? " in the background" : "")
+		<< " in " << totalTime << " ms" << std::endl;
+}
+
+void Model::unload()
+{
+	for (auto& mesh : lodMesh) {
+		for (Primitive& primitive : mesh->primitives) {
+			primitive.vao.Delete();
+			glDeleteBuffers(1, &primitive.vertexBuffer);
+			glDeleteBuffers(1, &primitive.indexBuffer);
+		}
+	}
+
+	// Textures and shadow maps free their GL objects themselves
+	geometryPool.release();
+	bvh.invalidate();
+	root = std::make_unique<Node>();
+	lodLight.clear();
+	lodCamera.clear();
+	lodMesh.clear();
+	lodMat.clear();
+	lodTex.clear();
+
+	mainCameraId = -1;
+	nodeWithCamera = -1;
+	numNodes = 1;
+	selectedNodeId = 0;
+
+	textureSources.clear();
+	releaseMappedBuffers();
+	*gltf = tinygltf::Model();
+	loadedFromCache = false;
+	sourceBuffersReleased = false;
+}
+
+bool Model::parseGltf()
 {
 	tinygltf::TinyGLTF loader;
 	std::string err;
 	std::string warn;
 	tinygltf::Model newModel;
 
-	bool ret = loader.LoadASCIIFromFile(&newModel, &err, &warn, this->file.c_str());
+	loader.SetImageLoader(storeEncodedImage, nullptr);
+
+	bool ret;
+	if (mapBuffers)
+		ret = loadMappedGltf(this, loader, &newModel, &err, &warn);
+	else if (isBinary)
+		ret = loader.LoadBinaryFromFile(&newModel, &err, &warn, this->file.c_str());
+	else
+		ret = loader.LoadASCIIFromFile(&newModel, &err, &warn, this->file.c_str());
 
 	// So it resets between loads
-	model = newModel;
+	*gltf = std::move(newModel);
 
 	if (!warn.empty()) {
 		std::cout << "Warn: " << warn << std::endl;
@@ -66,36 +500,237 @@ void Model::load()
 
 	if (!ret) {
 		std::cerr << "Failed to load glTF: " << this->file.c_str() << std::endl;
-		return;
+		releaseMappedBuffers();
+		return false;
+	}
+
+	if (!decodeCompressedViews()) {
+		std::cerr << "Failed to decode EXT_meshopt_compression: " << this->file.c_str() << std::endl;
+		releaseMappedBuffers();
+		return false;
 	}
 
-	loadTextures(); // Load all textures
-	loadMaterials(); // Load all materials
-	loadMeshes(); // Load all meshes
-	loadLights(); // Load all lights
-	loadCameras(); // Load all cameras
-	loadModelProperties(); // Load the model properties 
+	return true;
+}
+
+bool Model::decodeCompressedViews()
+{
+	struct CompressedView {
+		int sourceBuffer = -1;
+		size_t sourceOffset = 0;
+		size_t sourceSize = 0;
+		unsigned char* destination = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		MeshoptMode mode = MESHOPT_MODE_ATTRIBUTES;
+		MeshoptFilter filter = MESHOPT_FILTER_NONE;
+	};
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<CompressedView> views;
+	std::vector<size_t> viewIndices;
+	std::vector<size_t> decodedSizes(gltf->buffers.size(), 0);
+
+	for (size_t i = 0; i < gltf->bufferViews.size(); i++) {
+		const tinygltf::BufferView& bufferView = gltf->bufferViews[i];
+		auto extension = bufferView.extensions.find("EXT_meshopt_compression");
+		if (extension == bufferView.extensions.end())
+			continue;
+
+		// The uncompressed data is already in a mapped file
+		if (bufferView.buffer >= 0 && static_cast<size_t>(bufferView.buffer) < mappedBuffers.size() && mappedBuffers[bufferView.buffer])
+			continue;
+
+		const tinygltf::Value& value = extension->second;
+		CompressedView view;
+		view.sourceBuffer = value.Get("buffer").GetNumberAsInt();
+		view.sourceOffset = value.Has("byteOffset") ? static_cast<size_t>(value.Get("byteOffset").GetNumberAsDouble()) : 0;
+		view.sourceSize = static_cast<size_t>(value.Get("byteLength").GetNumberAsDouble());
+		view.stride = static_cast<size_t>(value.Get("byteStride").GetNumberAsInt());
+		view.count = static_cast<size_t>(value.Get("count").GetNumberAsDouble());
+
+		if (!value.Get("mode").IsString() || !MeshoptDecoder::parseMode(value.Get("mode").Get<std::string>(), view.mode)) {
+			std::cerr << "Unknown EXT_meshopt_compression mode in buffer view " << i << std::endl;
+			return false;
+		}
+		std::string filter = value.Has("filter") ? value.Get("filter").Get<std::string>() : "NONE";
+		if (!MeshoptDecoder::parseFilter(filter, view.filter)) {
+			std::cerr << "Unknown EXT_meshopt_compression filter " << filter << " in buffer view " << i << std::endl;
+			return false;
+		}
+
+		if (view.sourceBuffer < 0 || static_cast<size_t>(view.sourceBuffer) >= gltf->buffers.size()
+			|| view.sourceOffset + view.sourceSize > getBufferSize(view.sourceBuffer)) {
+			std::cerr << "Compressed buffer view " << i << " is outside of its buffer" << std::endl;
+			return false;
+		}
+		if (view.count * view.stride > bufferView.byteLength) {
+			std::cerr << "Compressed buffer view " << i << " decodes to more than its byteLength" << std::endl;
+			return false;
+		}
 
-	// Traverse all nodes
-	auto rootNodes = findRootNodes();
-	for (unsigned int rootNodeIndex : rootNodes) {
-		traverseNode(rootNodeIndex, root->matrix, root.get());
+		decodedSizes[bufferView.buffer] = std::max(decodedSizes[bufferView.buffer], bufferView.byteOffset + bufferView.byteLength);
+		views.push_back(view);
+		viewIndices.push_back(i);
 	}
 
-	// If there is no camera, we add a default one
-	if (nodeWithCamera == -1)
-		addMainCameraNode();
+	if (views.empty())
+		return true;
 
-	// We update cameras and lights
-	updateTreeFrom(root.get(), glm::mat4(1.0f));
+	// Fallback buffers only hold a placeholder byte, every view decodes into its own range of them
+	for (size_t i = 0; i < gltf->buffers.size(); i++) {
+		if (gltf->buffers[i].data.size() < decodedSizes[i])
+			gltf->buffers[i].data.resize(decodedSizes[i]);
+	}
+	for (size_t v = 0; v < views.size(); v++) {
+		const tinygltf::BufferView& bufferView = gltf->bufferViews[viewIndices[v]];
+		views[v].destination = gltf->buffers[bufferView.buffer].data.data() + bufferView.byteOffset;
+	}
 
-	// Set up flags
-	lightFlags.set();
+	// Views are independent, one task each on the worker pool
+	ThreadPool& pool = ThreadPool::shared();
+	ConcurrentQueue<std::pair<size_t, bool>> results;
+	for (size_t v = 0; v < views.size(); v++) {
+		const unsigned char* source = getBufferData(views[v].sourceBuffer) + views[v].sourceOffset;
+		pool.submit([&views, &results, source, v]() {
+			const CompressedView& view = views[v];
+			bool decoded = MeshoptDecoder::decode(view.destination, view.count, view.stride, view.mode, view.filter, source, view.sourceSize);
+			results.push({ v, decoded });
+		});
+	}
 
-	loaded = true;
+	bool success = true;
+	size_t decodedBytes = 0;
+	for (size_t v = 0; v < views.size(); v++) {
+		std::pair<size_t, bool> result = results.waitPop();
+		if (!result.second) {
+			std::cerr << "Corrupt EXT_meshopt_compression data in buffer view " << viewIndices[result.first] << std::endl;
+			success = false;
+		}
+		decodedBytes += views[result.first].count * views[result.first].stride;
+	}
+
+	double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Decoded " << views.size() << " compressed buffer views (" << decodedBytes / 1024 << " KB) in " << time << " ms" << std::endl;
+	return success;
+}
+
+std::vector<std::string> Model::getBufferFiles()
+{
+	std::filesystem::path directory = std::filesystem::path(file).parent_path();
+	std::vector<std::string> files;
+
+	for (size_t i = 0; i < gltf->buffers.size(); i++) {
+		const std::string& uri = i < mappedBufferUris.size() ? mappedBufferUris[i] : gltf->buffers[i].uri;
+		if (uri.empty() || tinygltf::IsDataURI(uri))
+			continue; // Inside the model file itself
+		std::string decodedUri;
+		tinygltf::URIDecode(uri, &decodedUri, nullptr);
+		files.push_back((directory / decodedUri).string());
+	}
+
+	return files;
+}
+
+bool Model::mapBufferSources()
+{
+	std::filesystem::path directory = std::filesystem::path(file).parent_path();
+	mappedFiles.clear();
+	mappedBuffers.assign(mappedBufferUris.size(), nullptr);
+
+	const MappedFile* glbFile = nullptr;
+	GlbChunks chunks;
+
+	for (size_t i = 0; i < mappedBufferUris.size(); i++) {
+		if (mappedBufferSizes[i] == 0)
+			continue; // tinygltf owns this buffer
+
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+
+		if (mappedBufferUris[i].empty()) { // BIN chunk of the .glb itself
+			if (!glbFile) {
+				mappedFiles.push_back(std::make_unique<MappedFile>(file));
+				glbFile = mappedFiles.back().get();
+				std::string err;
+				if (!glbFile->isOpen() || !parseGlb(glbFile->data(), glbFile->size(), chunks, err)) {
+					std::cerr << "Failed to map GLB buffer: " << file << " " << err << std::endl;
+					return false;
+				}
+			}
+			data = chunks.bin;
+			size = chunks.binSize;
+		}
+		else { // External .bin file
+			std::string decodedUri;
+			tinygltf::URIDecode(mappedBufferUris[i], &decodedUri, nullptr);
+			mappedFiles.push_back(std::make_unique<MappedFile>((directory / decodedUri).string()));
+			data = mappedFiles.back()->data();
+			size = mappedFiles.back()->size();
+		}
+
+		if (!data || size < mappedBufferSizes[i]) {
+			std::cerr << "Buffer " << i << " is missing or smaller than its byteLength" << std::endl;
+			return false;
+		}
+		mappedBuffers[i] = data;
+	}
+
+	return true;
+}
+
+void Model::releaseMappedBuffers()
+{
+	std::fill(mappedBuffers.begin(), mappedBuffers.end(), nullptr);
+	mappedFiles.clear();
+}
+
+const unsigned char* Model::getBufferData(int bufferIndex)
+{
+	if (static_cast<size_t>(bufferIndex) < mappedBuffers.size() && mappedBuffers[bufferIndex])
+		return mappedBuffers[bufferIndex];
+	return gltf->buffers[bufferIndex].data.data();
+}
+
+size_t Model::getBufferSize(int bufferIndex)
+{
+	if (static_cast<size_t>(bufferIndex) < mappedBuffers.size() && mappedBuffers[bufferIndex])
+		return mappedBufferSizes[bufferIndex];
+	return gltf->buffers[bufferIndex].data.size();
+}
+
+size_t Model::releaseCpuGeometry()
+{
+	size_t freed = 0;
+	for (auto& mesh : lodMesh) {
+		for (Primitive& primitive : mesh->primitives)
+			freed += primitive.releaseCpuData();
+	}
+	return freed;
+}
+
+size_t Model::releaseSourceBuffers()
+{
+	size_t freed = 0;
+	for (tinygltf::Buffer& buffer : gltf->buffers) {
+		freed += buffer.data.capacity();
+		std::vector<unsigned char>().swap(buffer.data);
+	}
+	for (tinygltf::Image& image : gltf->images) {
+		freed += image.image.capacity();
+		std::vector<unsigned char>().swap(image.image);
+	}
+	sourceBuffersReleased = true;
+	return freed;
 }
 
 void Model::updateTreeFrom(Node* node, glm::mat4 parentMatrix)
+{
+	updateGlobalMatrices(node, parentMatrix);
+	bvh.refit(node);
+}
+
+void Model::updateGlobalMatrices(Node* node, glm::mat4 parentMatrix)
 {
 	node->globalMatrix = parentMatrix * node->matrix;
 
@@ -114,10 +749,17 @@ void Model::updateTreeFrom(Node* node, glm::mat4 parentMatrix)
 	}
 
 	for (auto& child : node->children) {
-		updateTreeFrom(child.get(), node->globalMatrix);
+		updateGlobalMatrices(child.get(), node->globalMatrix);
 	}
 }
 
+SceneBVH& Model::getBVH()
+{
+	if (!bvh.isValid())
+		bvh.build(root.get());
+	return bvh;
+}
+
 Node* Model::searchNodeByID(Node* node, int targetId)
 {
 	if (node == nullptr) {
@@ -167,12 +809,12 @@ std::vector<unsigned int> Model::findRootNodes()
 	std::unordered_set<unsigned int> potentialRoots;
 
 	// Step 1: Add all nodes to potential roots
-	for (unsigned int i = 0; i < model.nodes.size(); ++i) {
+	for (unsigned int i = 0; i < gltf->nodes.size(); ++i) {
 		potentialRoots.insert(i);
 	}
 
 	// Step 2: Remove nodes that are referenced as children
-	for (const auto& node : model.nodes) {
+	for (const auto& node : gltf->nodes) {
 		for (int childIndex : node.children) {
 			potentialRoots.erase(childIndex);
 		}
@@ -184,7 +826,7 @@ std::vector<unsigned int> Model::findRootNodes()
 
 void Model::traverseNode(unsigned int nextNode, glm::mat4 parentMatrix, Node* parentNode)
 {
-	const tinygltf::Node& node = model.nodes[nextNode];
+	const tinygltf::Node& node = gltf->nodes[nextNode];
 	// Directly access the name or default to "Node"
 	std::string nameNode = node.name.empty() ? "Node" : node.name;
 
@@ -251,95 +893,113 @@ void Model::traverseNode(unsigned int nextNode, glm::mat4 parentMatrix, Node* pa
 	}
 }
 
-std::vector<GLuint> Model::getIndices(int accessorIndex)
+// Copies an index accessor of any supported width into 32 bit indices
+template <typename T>
+static void copyIndices(const unsigned char* src, size_t byteStride, size_t count, GLuint* dst)
 {
-	std::vector<GLuint> indices;
+	if (byteStride == sizeof(T) && sizeof(T) == sizeof(GLuint)) {
+		std::memcpy(dst, src, count * sizeof(GLuint));
+		return;
+	}
 
-	const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
-	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-	const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+	for (size_t i = 0; i < count; ++i) {
+		T value;
+		std::memcpy(&value, src + i * byteStride, sizeof(T));
+		dst[i] = static_cast<GLuint>(value);
+	}
+}
 
-	const unsigned char* dataPtr = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-	size_t byteStride = accessor.ByteStride(bufferView);
+std::vector<GLuint> Model::getIndices(int accessorIndex, size_t numVertices)
+{
+	const tinygltf::Accessor& accessor = gltf->accessors[accessorIndex];
+	if (accessor.bufferView < 0)
+		throw std::runtime_error("Index accessor without buffer view is not supported");
+
+	const tinygltf::BufferView& bufferView = gltf->bufferViews[accessor.bufferView];
+
+	int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+	int byteStride = accessor.ByteStride(bufferView);
+	if (componentSize <= 0 || byteStride < componentSize)
+		throw std::runtime_error("Unsupported component type or stride in index accessor");
+
+	// Same check as the attribute streams, the copies below trust the stride
+	size_t lastByte = accessor.byteOffset + (accessor.count > 0 ? (accessor.count - 1) * byteStride + componentSize : 0);
+	if (lastByte > bufferView.byteLength || bufferView.byteOffset + bufferView.byteLength > getBufferSize(bufferView.buffer))
+		throw std::runtime_error("Index accessor reads past the end of its buffer");
+
+	const unsigned char* dataPtr = getBufferData(bufferView.buffer) + bufferView.byteOffset + accessor.byteOffset;
+
+	std::vector<GLuint> indices(accessor.count);
 
 	switch (accessor.componentType) {
-	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
-		for (size_t i = 0; i < accessor.count; ++i) {
-			unsigned int value;
-			std::memcpy(&value, dataPtr + i * byteStride, sizeof(unsigned int));
-			indices.push_back(static_cast<GLuint>(value));
-		}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		copyIndices<unsigned int>(dataPtr, byteStride, accessor.count, indices.data());
 		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		copyIndices<unsigned short>(dataPtr, byteStride, accessor.count, indices.data());
 		break;
-	}
-	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-		for (size_t i = 0; i < accessor.count; ++i) {
-			unsigned short value;
-			std::memcpy(&value, dataPtr + i * byteStride, sizeof(unsigned short));
-			indices.push_back(static_cast<GLuint>(value));
-		}
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		copyIndices<short>(dataPtr, byteStride, accessor.count, indices.data());
 		break;
-	}
-	case TINYGLTF_COMPONENT_TYPE_SHORT: {
-		for (size_t i = 0; i < accessor.count; ++i) {
-			short value;
-			std::memcpy(&value, dataPtr + i * byteStride, sizeof(short));
-			indices.push_back(static_cast<GLuint>(value));
-		}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		copyIndices<unsigned char>(dataPtr, byteStride, accessor.count, indices.data());
 		break;
-	}
 	default:
 		throw std::runtime_error("Unsupported component type in accessor");
 	}
 
+	// The optimizer, the bounds and the BVH index the vertices with them
+	if (!indices.empty() && *std::max_element(indices.begin(), indices.end()) >= numVertices)
+		throw std::runtime_error("Index accessor references a vertex past the end of the primitive");
+
 	return indices;
 }
 
 void Model::loadModelProperties() {
-	if (model.extras.Has("Ambient color")) {
-		auto ambientColorValue = model.extras.Get("Ambient color").Get<tinygltf::Value::Array>();
+	if (gltf->extras.Has("Ambient color")) {
+		auto ambientColorValue = gltf->extras.Get("Ambient color").Get<tinygltf::Value::Array>();
 		ambientColor = glm::vec3(ambientColorValue[0].GetNumberAsDouble(), ambientColorValue[1].GetNumberAsDouble(), ambientColorValue[2].GetNumberAsDouble());
 	}
 
-	if (model.extras.Has("Shadow darkness")) {
-		shadowDarkness = model.extras.Get("Shadow darkness").GetNumberAsDouble();
+	if (gltf->extras.Has("Shadow darkness")) {
+		shadowDarkness = gltf->extras.Get("Shadow darkness").GetNumberAsDouble();
 	}
 
-	if (model.extras.Has("Reflection factor")) {
-		reflectionFactor = model.extras.Get("Reflection factor").GetNumberAsDouble();
+	if (gltf->extras.Has("Reflection factor")) {
+		reflectionFactor = gltf->extras.Get("Reflection factor").GetNumberAsDouble();
 	}
 
-	if (model.extras.Has("Ambient intensity")) {
-		ambientLight = model.extras.Get("Ambient intensity").GetNumberAsDouble();
+	if (gltf->extras.Has("Ambient intensity")) {
+		ambientLight = gltf->extras.Get("Ambient intensity").GetNumberAsDouble();
 	}
 
 }
 
 void Model::loadCameras() {
 	// Preallocate space for lodCam
-	lodCamera.reserve(model.cameras.size());
+	lodCamera.reserve(gltf->cameras.size());
 
-	for (size_t i = 0; i < model.cameras.size(); ++i) {
+	for (size_t i = 0; i < gltf->cameras.size(); ++i) {
 		std::unique_ptr<Camera> camera;
 
-		if (model.cameras[i].type == "perspective") {
+		if (gltf->cameras[i].type == "perspective") {
 			auto perspectiveCamera = std::make_unique<PerspectiveCamera>();
-			perspectiveCamera->aspectRatio = model.cameras[i].perspective.aspectRatio;
-			perspectiveCamera->fov = model.cameras[i].perspective.yfov;
-			perspectiveCamera->nearPlane = model.cameras[i].perspective.znear;
-			perspectiveCamera->farPlane = model.cameras[i].perspective.zfar;
+			perspectiveCamera->aspectRatio = gltf->cameras[i].perspective.aspectRatio;
+			perspectiveCamera->fov = gltf->cameras[i].perspective.yfov;
+			perspectiveCamera->nearPlane = gltf->cameras[i].perspective.znear;
+			perspectiveCamera->farPlane = gltf->cameras[i].perspective.zfar;
 			camera = std::move(perspectiveCamera);
 		}
-		else if (model.cameras[i].type == "orthographic") {
+		else if (gltf->cameras[i].type == "orthographic") {
 			auto orthographicCamera = std::make_unique<OrthographicCamera>();
-			orthographicCamera->size.x = model.cameras[i].orthographic.xmag;
-			orthographicCamera->size.y = model.cameras[i].orthographic.ymag;
-			orthographicCamera->nearPlane = model.cameras[i].orthographic.znear;
-			orthographicCamera->farPlane = model.cameras[i].orthographic.zfar;
+			orthographicCamera->size.x = gltf->cameras[i].orthographic.xmag;
+			orthographicCamera->size.y = gltf->cameras[i].orthographic.ymag;
+			orthographicCamera->nearPlane = gltf->cameras[i].orthographic.znear;
+			orthographicCamera->farPlane = gltf->cameras[i].orthographic.zfar;
 			camera = std::move(orthographicCamera);
 		}
 		else {
-			std::cerr << "Unknown camera type: " << model.cameras[i].type << std::endl;
+			std::cerr << "Unknown camera type: " << gltf->cameras[i].type << std::endl;
 			throw std::runtime_error("Unsupported camera type encountered");
 		}
 
@@ -350,68 +1010,270 @@ void Model::loadCameras() {
 void Model::loadLights()
 {
 	// Preallocate space for lights
-	lodLight.reserve(model.lights.size());
+	lodLight.reserve(gltf->lights.size());
+	std::vector<std::future<void>> shadowMaps;
+	int numShadowMaps = 0;
 
-	for (size_t i = 0; i < model.lights.size(); ++i) {
+	for (size_t i = 0; i < gltf->lights.size(); ++i) {
 		std::unique_ptr<Light> light;
 
-		if (model.lights[i].type == "point") {
+		if (gltf->lights[i].type == "point") {
 			auto pointLight = std::make_unique<PointLight>();
 			light = std::move(pointLight);
 		}
-		else if (model.lights[i].type == "spot") {
+		else if (gltf->lights[i].type == "spot") {
 			auto spotLight = std::make_unique<SpotLight>();
-			spotLight->innerConeAngle = model.lights[i].spot.innerConeAngle;
-			spotLight->outerConeAngle = model.lights[i].spot.outerConeAngle;
+			spotLight->innerConeAngle = gltf->lights[i].spot.innerConeAngle;
+			spotLight->outerConeAngle = gltf->lights[i].spot.outerConeAngle;
 			spotLight->direction = glm::vec3(0.0f);
 			light = std::move(spotLight);
 		}
-		else if (model.lights[i].type == "directional") {
+		else if (gltf->lights[i].type == "directional") {
 			auto directionalLight = std::make_unique<DirectionalLight>();
-			directionalLight->shadowMap = std::make_unique<FBO>(8192, 8192, lodTex.size() + i, FBO_DEPTH);
-			if (model.lights[i].extras.Has("distance"))
-				directionalLight->distance = model.lights[i].extras.Get("distance").GetNumberAsDouble();
+			DirectionalLight* target = directionalLight.get();
+			if (numShadowMaps < MAX_SHADOW_MAPS) {
+				directionalLight->shadowIndex = numShadowMaps++;
+				int slot = MATERIAL_TEXTURE_UNITS + directionalLight->shadowIndex;
+				shadowMaps.push_back(runOnGLThread([target, slot]() {
+					target->shadowMap = std::make_unique<FBO>(8192, 8192, slot, FBO_DEPTH);
+				}));
+			}
+			if (gltf->lights[i].extras.Has("distance"))
+				directionalLight->distance = gltf->lights[i].extras.Get("distance").GetNumberAsDouble();
 			light = std::move(directionalLight);
 		}
 		else {
-			std::cerr << "Unknown light type: " << model.lights[i].type << std::endl;
+			std::cerr << "Unknown light type: " << gltf->lights[i].type << std::endl;
 			throw std::runtime_error("Unsupported light type encountered");
 		}
 
-		light->color = glm::vec3(model.lights[i].color[0], model.lights[i].color[1], model.lights[i].color[2]);
-		light->intensity = model.lights[i].intensity;
-		light->range = model.lights[i].range;
+		light->color = glm::vec3(gltf->lights[i].color[0], gltf->lights[i].color[1], gltf->lights[i].color[2]);
+		light->intensity = gltf->lights[i].intensity;
+		light->range = gltf->lights[i].range;
 		light->index = i;
 
 		lodLight.push_back(std::move(light));
 	}
+
+	waitForGLThread(shadowMaps);
 }
 
 void Model::loadTextures()
+{
+	// One source per texture slot, encoded images are not copied, they stay in the buffers until the load ends
+	textureSources.assign(gltf->textures.size(), TextureSource());
+
+	for (size_t i = 0; i < gltf->textures.size(); i++)
+	{
+		// Textures whose image comes from an unsupported extension (KHR_texture_basisu, EXT_texture_webp) stay empty
+		int source = gltf->textures[i].source;
+		if (source < 0 || static_cast<size_t>(source) >= gltf->images.size())
+			continue;
+		const tinygltf::Image& image = gltf->images[source];
+		TextureSource& textureSource = textureSources[i];
+
+		// Embedded image, either copied by tinygltf or still inside a mapped buffer
+		if (!image.image.empty()) {
+			textureSource.encoded = image.image.data();
+			textureSource.encodedSize = image.image.size();
+		}
+		else if (static_cast<size_t>(source) < mappedImageViews.size() && mappedImageViews[source] != -1) {
+			const tinygltf::BufferView& bufferView = gltf->bufferViews[mappedImageViews[source]];
+			textureSource.encoded = getBufferData(bufferView.buffer) + bufferView.byteOffset;
+			textureSource.encodedSize = bufferView.byteLength;
+		}
+		else {
+			// URI of current texture
+			textureSource.uri = image.uri;
+		}
+	}
+
+	// The compressed format of each texture follows how the materials sample it
+	auto addRole = [this](int textureIndex, int role) {
+		if (textureIndex >= 0 && static_cast<size_t>(textureIndex) < textureSources.size())
+			textureSources[textureIndex].roles |= role;
+	};
+	for (const auto& mat : gltf->materials) {
+		addRole(mat.pbrMetallicRoughness.baseColorTexture.index, TEXTURE_ROLE_BASE_COLOR);
+		addRole(mat.pbrMetallicRoughness.metallicRoughnessTexture.index, TEXTURE_ROLE_METALLIC_ROUGHNESS);
+		addRole(mat.normalTexture.index, TEXTURE_ROLE_NORMAL);
+		addRole(mat.occlusionTexture.index, TEXTURE_ROLE_OCCLUSION);
+		addRole(mat.emissiveTexture.index, TEXTURE_ROLE_EMISSIVE);
+	}
+
+	uploadTextures(textureSources);
+}
+
+void Model::uploadTextures(const std::vector<TextureSource>& sources)
 {
 	std::filesystem::path filePath = file;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// One texture per glTF texture, the index the materials use
+	lodTex.resize(sources.size());
+
+	// Decode every image on the worker pool, the GL thread only uploads what is already decoded
+	ThreadPool& pool = ThreadPool::shared();
+	ConcurrentQueue<ImageData> decodedImages;
+	int numImages = 0;
+
+	// Only the coarse levels are read now, the TextureStreamer brings in the rest once the model is drawn
+	TextureStreamer& streamer = TextureStreamer::shared();
+	int streamSize = streamer.enabled ? streamer.initialSize : 0;
+
+	// Images another model already has on the GPU are neither decoded nor uploaded again
+	TextureCache& cache = TextureCache::shared();
+	std::vector<TextureKey> keys(sources.size());
+	std::vector<std::function<ImageData()>> decoders(sources.size());
+	std::vector<char> skipped(sources.size(), 0);
+	int numShared = 0;
+
+	// Per image timings, printed as one table once every upload is done
+	struct TextureTiming {
+		int width = 0;
+		int height = 0;
+		double decodeTime = 0.0;
+		double uploadTime = 0.0;
+		bool shared = false;
+	};
+	std::vector<TextureTiming> timings(sources.size());
+
+	for (int i = 0; i < static_cast<int>(sources.size()); i++)
+	{
+		const TextureSource& source = sources[i];
+		if (source.empty())
+			continue;
+		numImages++;
+
+		GLenum format = TextureCompressor::chooseFormat(source.roles);
+		GLenum cacheFormat = compressTextures ? format : 0;
+		std::function<ImageData()> decode;
+		std::function<TextureKey()> getKey;
+
+		if (source.encoded) {
+			const unsigned char* encoded = source.encoded;
+			size_t encodedSize = source.encodedSize;
+			getKey = [encoded, encodedSize, cacheFormat]() { return TextureCache::getMemoryKey(encoded, encodedSize, cacheFormat); };
+			if (compressTextures) {
+				std::string containerPath = TextureCompressor::getContainerPath(file + ".image" + std::to_string(i), format);
+				decode = [containerPath, format, encoded, encodedSize, i, streamSize]() {
+					return TextureCompressor::load(containerPath, format, encoded, encodedSize, i, streamSize);
+				};
+			}
+			else {
+				decode = [encoded, encodedSize, i]() { return ImageData::decode(encoded, encodedSize, i); };
+			}
+		}
+		else {
+			// Construct the full path to the texture
+			std::string fullPath = (filePath.parent_path() / std::filesystem::path(source.uri)).string();
+			getKey = [&cache, fullPath, cacheFormat]() { return cache.getFileKey(fullPath, cacheFormat); };
+
+			if (compressTextures) {
+				std::string containerPath = TextureCompressor::getContainerPath(fullPath, format);
+				decode = [containerPath, format, fullPath, i, streamSize]() { return TextureCompressor::load(containerPath, format, fullPath, i, streamSize); };
+			}
+			else {
+				decode = [fullPath, i]() { return ImageData::decode(fullPath, i); };
+			}
+		}
 
-	// Preallocate space for lodTex
-	lodTex.resize(model.images.size());
+		// A cancelled load still hands back an empty image so the loop below can finish
+		decoders[i] = decode;
+		pool.submit([this, decode, getKey, i, &cache, &keys, &skipped, &decodedImages]() {
+			ImageData image;
+			image.index = i;
+			if (!cancelRequested) {
+				keys[i] = getKey();
+				if (cache.contains(keys[i]))
+					skipped[i] = 1;
+				else
+					image = decode();
+			}
+			loadWorkDone++;
+			decodedImages.push(std::move(image));
+		});
+	}
 
-	for (int i = 0; i < model.textures.size(); i++) // TODO: Use textures of the gltf instead of images
+	// Upload the images in completion order while the workers keep decoding the rest
+	std::vector<ImageData> images(sources.size());
+	std::vector<std::future<void>> uploads;
+	double decodeTime = 0.0;
+	size_t memorySize = 0;
+	for (int received = 0; received < numImages; received++)
 	{
-		// URI of current texture
-		std::filesystem::path texPath = model.images[model.textures[i].source].uri;
+		ImageData decoded = decodedImages.waitPop();
+		ImageData& image = images[decoded.index];
+		image = std::move(decoded);
+		decodeTime += image.decodeTime;
+
+		uploads.push_back(runOnGLThread([this, &image, &memorySize, &cache, &keys, &decoders, &skipped, &numShared, &timings]() {
+			auto uploadStart = std::chrono::high_resolution_clock::now();
+			TextureTiming& timing = timings[image.index];
+			const TextureKey& key = keys[image.index];
+			lodTex[image.index] = cache.acquire(key);
+			if (lodTex[image.index]) {
+				timing.width = lodTex[image.index]->width;
+				timing.height = lodTex[image.index]->height;
+				timing.shared = true;
+				numShared++;
+				loadWorkDone++;
+				image.free();
+				return;
+			}
+
+			// The model the worker saw it in has been freed since
+			if (skipped[image.index])
+				image = decoders[image.index]();
+
+			try {
+				// Load texture and add it to lodTex, images that failed to decode are not shared. Materials bind their
+				// textures to the unit of each slot, the one given here is only used by the upload
+				auto texture = std::make_unique<Texture>(image, ALBEDO_UNIT);
+				if (image.bytes || image.isCompressed())
+					lodTex[image.index] = cache.insert(key, std::move(texture));
+				else
+					lodTex[image.index] = std::move(texture);
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Texture " << image.index << ": " << e.what() << std::endl;
+			}
+			if (lodTex[image.index])
+				memorySize += lodTex[image.index]->memorySize;
+			timing.width = image.width;
+			timing.height = image.height;
+			timing.decodeTime = image.decodeTime;
+			timing.uploadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+			loadWorkDone++;
+			image.free();
+		}));
+	}
 
-		// Construct the full path to the texture
-		std::filesystem::path fullPath = filePath.parent_path() / texPath;
+	// Images skipped by a cancelled load are still waiting to be freed
+	waitForGLThread(uploads);
+	for (ImageData& image : images)
+		image.free();
+	checkCancelled();
 
-		// Load texture and add it to lodTex
-		lodTex[i] = std::make_unique<Texture>(fullPath.string().c_str(), (GLuint)i);
+	for (size_t i = 0; i < timings.size(); i++) {
+		const TextureTiming& timing = timings[i];
+		if (sources[i].empty())
+			continue;
+		std::cout << "  Texture " << i << " (" << timing.width << "x" << timing.height << "): ";
+		if (timing.shared)
+			std::cout << "shared" << std::endl;
+		else
+			std::cout << "decode " << timing.decodeTime << " ms, upload " << timing.uploadTime << " ms" << std::endl;
 	}
 
-	std::cout << "Loaded " << model.images.size() << " textures." << std::endl;
+	double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Loaded " << numImages << " textures (" << numShared << " shared with other models, " << memorySize / (1024 * 1024)
+		<< " MB of new video memory) in " << totalTime << " ms (" << decodeTime << " ms of decode across " << pool.size() << " threads)." << std::endl;
 }
 
 void Model::loadMaterials() {
 	// Assuming `gltfModel` is a tinygltf::Model object containing the loaded GLTF data
-	for (const auto& mat : model.materials) {
+	for (const auto& mat : gltf->materials) {
 		auto material = std::make_unique<Material>();
 
 		// Set name
@@ -476,122 +1338,265 @@ void Model::loadMaterials() {
 	std::cout << "Number of materials: " << lodMat.size() << std::endl;
 }
 
+// Bounds of a POSITION accessor, only float positions have them in the units of the vertices
+static bool getAccessorBounds(const tinygltf::Accessor& accessor, AABB& bounds)
+{
+	if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.minValues.size() != 3 || accessor.maxValues.size() != 3)
+		return false;
+	bounds.min = glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+	bounds.max = glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+	return glm::all(glm::lessThanEqual(bounds.min, bounds.max));
+}
+
 void Model::loadMeshes()
 {
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t numVertices = 0;
+	size_t numIndices = 0;
+
+	// Decoded here, uploaded by the GL thread while the next primitives are decoded
+	std::vector<std::future<void>> uploads;
+
 	// Go through all the meshes in the gltfModel
-	for (size_t i = 0; i < model.meshes.size(); i++) {
-		const auto& mesh = model.meshes[i];
-		std::unique_ptr<Mesh> meshPtr = std::make_unique<Mesh>();
+	for (size_t i = 0; i < gltf->meshes.size(); i++) {
+		checkCancelled();
+		const auto& mesh = gltf->meshes[i];
+		lodMesh.push_back(std::make_unique<Mesh>());
+		Mesh* meshPtr = lodMesh.back().get();
+		meshPtr->primitives.reserve(mesh.primitives.size());
+		size_t primitiveIndex = 0;
 
 		// Iterate over all primitives in the mesh
 		for (const auto& primitive : mesh.primitives) {
-			// Get all accessor indices
-			unsigned int posAccInd = primitive.attributes.find("POSITION")->second;
-			unsigned int normalAccInd = primitive.attributes.find("NORMAL")->second;
-
-			std::vector<glm::vec3> positions = getVec3(posAccInd);
-			std::vector<glm::vec3> normals = getVec3(normalAccInd);
-			std::vector<glm::vec2> texUVs;
-
-			// Check if TEXCOORD_0 exists
-			auto texCoordIt = primitive.attributes.find("TEXCOORD_0");
-			if (texCoordIt != primitive.attributes.end()) {
-				unsigned int texAccInd = texCoordIt->second;
-				texUVs = getVec2(texAccInd);
+			// Get all accessor indices, -1 if the attribute is missing
+			auto findAttribute = [&primitive](const char* name) {
+				auto it = primitive.attributes.find(name);
+				return it != primitive.attributes.end() ? it->second : -1;
+			};
+
+			int posAccInd = findAttribute("POSITION");
+			if (posAccInd < 0)
+				throw std::runtime_error("Primitive without POSITION attribute");
+
+			// Read every attribute straight into the interleaved vertices
+			std::vector<Vertex> vertices = interleaveVertices(posAccInd, findAttribute("NORMAL"), findAttribute("TEXCOORD_0"));
+
+			// glTF requires the bounds of the positions in their accessor, the upload then does not scan the vertices
+			AABB bounds;
+			bool hasBounds = getAccessorBounds(gltf->accessors[posAccInd], bounds);
+
+			// Get indices, non indexed primitives draw their vertices in order
+			std::vector<GLuint> indices;
+			if (primitive.indices >= 0) {
+				try {
+					indices = getIndices(primitive.indices, vertices.size());
+				}
+				catch (const std::runtime_error& e) {
+					std::cerr << "Mesh " << i << " primitive " << primitiveIndex << " skipped: " << e.what() << std::endl;
+					primitiveIndex++;
+					loadWorkDone += 2; // Its decode and upload
+					continue;
+				}
 			}
 			else {
-				// Fill with zeros if TEXCOORD_0 does not exist
-				texUVs.assign(positions.size(), glm::vec2(0.0f, 0.0f));
+				indices.resize(vertices.size());
+				std::iota(indices.begin(), indices.end(), 0);
 			}
-			int indexMaterial = primitive.material;
 
-			// Get indices
-			unsigned int indAccInd = primitive.indices;
-			std::vector<GLuint> indices = getIndices(indAccInd);
+			if (optimizeMeshes)
+				optimizePrimitive(vertices, indices, primitive.mode, i, primitiveIndex);
+			primitiveIndex++;
 
-			// Combine the vertices, indices, and textures into a mesh
-			std::vector<Vertex> vertices = assembleVertices(positions, normals, texUVs);
-			
+			numVertices += vertices.size();
+			numIndices += indices.size();
+			loadWorkDone++;
 
-			// Add the mesh to the lodMesh vector
-			Primitive prim = Primitive(vertices, indices, lodMat[indexMaterial].get());
-			meshPtr->primitives.push_back(prim);
+			// Add the primitive to its mesh, in order as the GL thread runs the uploads first in first out
+			Material* material = primitive.material >= 0 ? lodMat[primitive.material].get() : nullptr;
+			uploads.push_back(runOnGLThread([this, meshPtr, vertices = std::move(vertices), indices = std::move(indices), material, bounds, hasBounds]() mutable {
+				meshPtr->primitives.emplace_back(std::move(vertices), std::move(indices), material, compactVertices, hasBounds ? &bounds : nullptr);
+				loadWorkDone++;
+			}));
 		}
-
-		lodMesh.push_back(std::move(meshPtr));
 	}
 
-	std::cout << "Number of meshes: " << lodMesh.size() << std::endl;
+	waitForGLThread(uploads);
+	checkCancelled();
+
+	double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	size_t vertexSize = compactVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+	std::cout << "Number of meshes: " << lodMesh.size() << " (" << numVertices << " vertices of " << vertexSize << " bytes, "
+		<< numIndices << " indices) loaded in " << totalTime << " ms" << std::endl;
 }
 
-std::vector<Vertex> Model::assembleVertices(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texUVs)
+void Model::optimizePrimitive(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, int mode, size_t meshIndex, size_t primitiveIndex)
 {
-	size_t numVertices = positions.size();
-	std::vector<Vertex> vertices;
-	vertices.reserve(numVertices); // Reserve space in the vector
-
-	for (size_t i = 0; i < numVertices; i++) {
-		vertices.emplace_back(Vertex{
-			positions[i],
-			normals[i],
-			glm::vec3(1.0f, 1.0f, 1.0f),
-			texUVs[i]
-			});
+	// Primitives without a mode are triangle lists, lines, points, strips and fans keep their order
+	GLenum drawMode = mode < 0 ? GL_TRIANGLES : static_cast<GLenum>(mode);
+	if (!MeshOptimizer::canOptimize(drawMode, indices, vertices.size())) {
+		std::cout << "Mesh " << meshIndex << " primitive " << primitiveIndex << ": not optimized, not a list of whole triangles" << std::endl;
+		return;
 	}
 
-	return vertices;
-}
+	VertexCacheStats before = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+	MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+	size_t dropped = MeshOptimizer::optimizeVertexFetch(vertices, indices);
 
-std::vector<glm::vec2> Model::getVec2(int accessorIndex) {
-	std::vector<glm::vec2> vec2Array;
+	VertexCacheStats after = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+	std::cout << "Mesh " << meshIndex << " primitive " << primitiveIndex << ": ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << ", " << (vertices.size() <= 65536 ? 16 : 32) << " bit indices";
+	if (dropped > 0)
+		std::cout << ", " << dropped << " unused vertices dropped";
+	std::cout << std::endl;
+}
 
-	const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
-	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-	const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+Model::AttributeStream Model::getAttributeStream(int accessorIndex, int numComponents, size_t count)
+{
+	AttributeStream stream;
+	if (accessorIndex < 0)
+		return stream;
+
+	const tinygltf::Accessor& accessor = gltf->accessors[accessorIndex];
+	if (accessor.bufferView < 0)
+		throw std::runtime_error("Accessor without buffer view is not supported");
+	if (tinygltf::GetNumComponentsInType(accessor.type) != numComponents)
+		throw std::runtime_error("Accessor has an unexpected number of components");
+	if (accessor.count < count)
+		throw std::runtime_error("Accessor has fewer elements than the primitive has vertices");
+
+	const tinygltf::BufferView& bufferView = gltf->bufferViews[accessor.bufferView];
+
+	int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+	if (componentSize <= 0)
+		throw std::runtime_error("Unsupported component type in accessor");
 
-	const unsigned char* dataPtr = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+	size_t elementSize = static_cast<size_t>(componentSize) * numComponents;
 	size_t byteStride = accessor.ByteStride(bufferView);
+	if (byteStride < elementSize)
+		throw std::runtime_error("Byte stride is smaller than the accessor element");
+
+	// The readers below trust the strides, make sure the last element is still inside the buffer
+	size_t lastByte = accessor.byteOffset + (count > 0 ? (count - 1) * byteStride + elementSize : 0);
+	if (lastByte > bufferView.byteLength || bufferView.byteOffset + bufferView.byteLength > getBufferSize(bufferView.buffer))
+		throw std::runtime_error("Accessor reads past the end of its buffer");
+
+	stream.data = getBufferData(bufferView.buffer) + bufferView.byteOffset + accessor.byteOffset;
+	stream.stride = byteStride;
+	stream.componentType = accessor.componentType;
+	stream.numComponents = numComponents;
+	stream.normalized = accessor.normalized;
+	return stream;
+}
 
-	if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
-		throw std::runtime_error("Accessor does not contain float type data");
+// Converts a single component to float following the glTF rules for normalized integers
+static inline float readComponent(const unsigned char* src, int componentType, bool normalized)
+{
+	switch (componentType) {
+	case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+		float value;
+		std::memcpy(&value, src, sizeof(float));
+		return value;
 	}
-	if (byteStride != sizeof(glm::vec2)) {
-		throw std::runtime_error("Byte stride does not match glm::vec2 size");
+	case TINYGLTF_COMPONENT_TYPE_BYTE: {
+		float value = static_cast<float>(static_cast<int8_t>(*src));
+		return normalized ? std::max(value / 127.0f, -1.0f) : value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+		float value = static_cast<float>(*src);
+		return normalized ? value / 255.0f : value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_SHORT: {
+		int16_t raw;
+		std::memcpy(&raw, src, sizeof(int16_t));
+		return normalized ? std::max(raw / 32767.0f, -1.0f) : static_cast<float>(raw);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		uint16_t raw;
+		std::memcpy(&raw, src, sizeof(uint16_t));
+		return normalized ? raw / 65535.0f : static_cast<float>(raw);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		uint32_t raw;
+		std::memcpy(&raw, src, sizeof(uint32_t));
+		return static_cast<float>(raw);
+	}
+	default:
+		return 0.0f;
 	}
+}
+
+static inline void readElement(const Model::AttributeStream& stream, size_t index, float* out)
+{
+	const unsigned char* src = stream.data + index * stream.stride;
 
-	for (size_t i = 0; i < accessor.count; ++i) {
-		glm::vec2 value;
-		std::memcpy(&value, dataPtr + i * byteStride, sizeof(glm::vec2));
-		vec2Array.push_back(value);
+	if (stream.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+		std::memcpy(out, src, stream.numComponents * sizeof(float));
+		return;
 	}
 
-	return vec2Array;
+	size_t componentSize = tinygltf::GetComponentSizeInBytes(stream.componentType);
+	for (int c = 0; c < stream.numComponents; c++) {
+		out[c] = readComponent(src + c * componentSize, stream.componentType, stream.normalized);
+	}
 }
 
-std::vector<glm::vec3> Model::getVec3(int accessorIndex) {
-	std::vector<glm::vec3> vec3Array;
+std::vector<Vertex> Model::interleaveVertices(int positionAccessor, int normalAccessor, int texUVAccessor)
+{
+	static_assert(sizeof(Vertex) == 11 * sizeof(float), "Vertex is expected to be 11 tightly packed floats");
 
-	const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
-	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-	const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+	size_t count = gltf->accessors[positionAccessor].count;
 
-	const unsigned char* dataPtr = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-	size_t byteStride = accessor.ByteStride(bufferView);
+	AttributeStream position = getAttributeStream(positionAccessor, 3, count);
+	AttributeStream normal = getAttributeStream(normalAccessor, 3, count);
+	AttributeStream texUV = getAttributeStream(texUVAccessor, 2, count);
 
-	if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
-		throw std::runtime_error("Accessor does not contain float type data");
-	}
-	if (byteStride != sizeof(glm::vec3)) {
-		throw std::runtime_error("Byte stride does not match glm::vec3 size");
+	std::vector<Vertex> vertices(count);
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	// Float positions and normals (the usual case), two unaligned 16 byte loads and stores per vertex.
+	// The loads read one float past each vec3, so the last vertex is left to the scalar loop.
+	if (position.isFloat() && normal.isFloat() && (!texUV.data || texUV.isFloat())) {
+		const __m128 ones = _mm_set1_ps(1.0f);
+
+		for (; i + 1 < count; i++) {
+			__m128 p = _mm_loadu_ps(reinterpret_cast<const float*>(position.data + i * position.stride));
+			__m128 n = _mm_loadu_ps(reinterpret_cast<const float*>(normal.data + i * normal.stride));
+			__m128 pzNx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));
+
+			float* dst = reinterpret_cast<float*>(&vertices[i]);
+			_mm_storeu_ps(dst, _mm_shuffle_ps(p, pzNx, _MM_SHUFFLE(2, 0, 1, 0)));     // px py pz nx
+			_mm_storeu_ps(dst + 4, _mm_shuffle_ps(n, ones, _MM_SHUFFLE(0, 0, 2, 1))); // ny nz r  g
+			dst[8] = 1.0f;                                                             // b
+
+			if (texUV.data)
+				std::memcpy(dst + 9, texUV.data + i * texUV.stride, 2 * sizeof(float));
+			else
+				dst[9] = dst[10] = 0.0f;
+		}
 	}
+#endif
+
+	for (; i < count; i++) {
+		Vertex& vertex = vertices[i];
+
+		readElement(position, i, &vertex.position.x);
 
-	for (size_t i = 0; i < accessor.count; ++i) {
-		glm::vec3 value;
-		std::memcpy(&value, dataPtr + i * byteStride, sizeof(glm::vec3));
-		vec3Array.push_back(value);
+		if (normal.data)
+			readElement(normal, i, &vertex.normal.x);
+		else
+			vertex.normal = glm::vec3(0.0f);
+
+		vertex.color = glm::vec3(1.0f);
+
+		if (texUV.data)
+			readElement(texUV, i, &vertex.texUV.x);
+		else
+			vertex.texUV = glm::vec2(0.0f);
 	}
 
-	return vec3Array;
+	return vertices;
 }
 
 void Model::reparentNode(int id, int newParentId) {
@@ -628,6 +1633,7 @@ void Model::reparentNode(int id, int newParentId) {
 
 	// Update the node's matrix
 	targetNode->rewriteMatrix();
+	bvh.invalidate();
 }
 
 void Model::deleteNode(int id) {
@@ -660,7 +1666,7 @@ void Model::deleteNode(int id) {
 	auto& siblings = targetNode->parent->children;
 	siblings.erase(std::remove_if(siblings.begin(), siblings.end(),
 		[targetNode](const std::unique_ptr<Node>& node) { return node.get() == targetNode; }), siblings.end());
-
+	bvh.invalidate();
 }
 
 void Model::addTransformNode() {
@@ -673,12 +1679,6 @@ void Model::addTransformNode() {
 }
 
 void Model::addLightNode(LIGHT_TYPE lightType) {
-	if (lodLight.size() > MAX_LIGHTS)
-	{
-		std::cerr << "Maximum number of lights reached." << std::endl;
-		return;
-	}
-
 	auto newNode = std::make_unique<Node>();
 	std::unique_ptr<Light> newLight;
 
@@ -703,7 +1703,18 @@ void Model::addLightNode(LIGHT_TYPE lightType) {
 		return;
 	}
 
-	newLight->shadowMap = std::make_unique<FBO>(8192, 8192, lodTex.size() + lodLight.size(), FBO_DEPTH);
+	// Only directional lights draw shadow maps, as long as one is free
+	if (lightType == DIRECTIONAL) {
+		int numShadowMaps = 0;
+		for (auto& light : lodLight)
+			numShadowMaps += light->shadowIndex >= 0;
+		if (numShadowMaps < MAX_SHADOW_MAPS) {
+			newLight->shadowIndex = numShadowMaps;
+			newLight->shadowMap = std::make_unique<FBO>(8192, 8192, MATERIAL_TEXTURE_UNITS + numShadowMaps, FBO_DEPTH);
+		}
+		else
+			std::cerr << "Maximum number of shadow maps reached, the light casts no shadow." << std::endl;
+	}
 	newNode->id = numNodes;
 	newNode->parent = root.get();
 	newLight->index = lodLight.size();
@@ -732,7 +1743,7 @@ void Model::addMainCameraNode() {
 
 std::vector<int> Model::filterNodesOfModel(std::function<bool(int node)> func) {
 	std::vector<int> nodesID;
-	for (int i = 0; i < model.nodes.size(); i++) {
+	for (int i = 0; i < gltf->nodes.size(); i++) {
 		if (func(i)) {
 			nodesID.push_back(i);
 		}
@@ -744,8 +1755,43 @@ void Model::save() {
 	tinygltf::TinyGLTF gltfWriter;
 	tinygltf::Model outputModel;
 
-	// Copy the global model to the output model
-	outputModel = model;
+	// Loading from the scene cache skipped the glTF and GPU resident models dropped its buffers, everything outside the scene graph comes from it
+	if (loadedFromCache || sourceBuffersReleased) {
+		if (!parseGltf()) {
+			std::cerr << "Failed to save the model, its glTF could not be read!" << std::endl;
+			return;
+		}
+		loadedFromCache = false;
+		sourceBuffersReleased = false;
+	}
+
+	// Copy the parsed glTF to the output model
+	outputModel = *gltf;
+
+	// Mapped buffers are not owned by tinygltf, put their bytes back before writing
+	if (!mappedBufferUris.empty()) {
+		if (!mapBufferSources()) {
+			std::cerr << "Failed to save the model, its buffers could not be read!" << std::endl;
+			return;
+		}
+
+		for (size_t i = 0; i < mappedBuffers.size() && i < outputModel.buffers.size(); i++) {
+			if (!mappedBuffers[i])
+				continue;
+			outputModel.buffers[i].uri = mappedBufferUris[i];
+			outputModel.buffers[i].data.assign(mappedBuffers[i], mappedBuffers[i] + mappedBufferSizes[i]);
+		}
+
+		for (size_t i = 0; i < mappedImageViews.size() && i < outputModel.images.size(); i++) {
+			if (mappedImageViews[i] == -1)
+				continue;
+			outputModel.images[i].bufferView = mappedImageViews[i];
+			outputModel.images[i].uri.clear();
+		}
+
+		// The files are about to be overwritten
+		releaseMappedBuffers();
+	}
 
 	// Now we will copy the everything of the previous model outside of the nodes, lights and cameras
 	outputModel.nodes.clear();
@@ -886,8 +1932,12 @@ void Model::save() {
 	
 
 	// Save the modified model to a file
-	bool success = gltfWriter.WriteGltfSceneToFile(&outputModel, file, false, false, true, false);
+	bool success = gltfWriter.WriteGltfSceneToFile(&outputModel, file, isBinary, isBinary, !isBinary, isBinary);
 	if (!success) {
 		std::cerr << "Failed to save the model!" << std::endl;
 	}
+
+	// The buffers parsed for this save are not needed until the next one
+	if (gpuResident && !retainSourceBuffers)
+		releaseSourceBuffers();
 }
\ No newline at end of file
@@ -9,14 +9,24 @@
 #include <functional>
 #include <unordered_set>
 #include <bitset>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
 
 #include "Mesh.h"
 #include "Material.h"
 #include "camera.h"
 #include "FBO.h"
 #include "light.h"
+#include "mappedFile.h"
+#include "threadPool.h"
+#include "sceneBVH.h"
+#include "geometryPool.h"
 
-#define MAX_LIGHTS 4
+namespace tinygltf { class Model; }
+
+#define MAX_SHADOW_MAPS 4 // Directional lights with a shadow map, each takes a texture unit and a render queue view
 
 enum LightChangeFlags {
 	Colors,
@@ -36,6 +46,27 @@ enum LightChangeFlags {
 	NumLightChangeFlags
 };
 
+// What a load is busy with, see Model::loadAsync
+enum LoadStage {
+	LOAD_IDLE,
+	LOAD_PARSE, // Reading the glTF or the scene cache
+	LOAD_DECODE, // Decoding images and accessors
+	LOAD_UPLOAD, // Waiting for the GL thread to upload
+	LOAD_TRAVERSE, // Building the node tree
+	LOAD_DONE,
+	LOAD_FAILED
+};
+
+// Where the encoded bytes of a texture come from, a file next to the model or memory that outlives the upload
+struct TextureSource {
+	std::string uri; // Relative to the model file
+	const unsigned char* encoded = nullptr;
+	size_t encodedSize = 0;
+	int roles = 0; // TextureRole flags of the materials using it
+
+	inline bool empty() const { return uri.empty() && !encoded; }
+};
+
 class Node {
 public:
 	Node() = default;
@@ -67,15 +98,55 @@ class Model
 public:
 	// Loads in a model from a file and stores the information in 'data', 'JSON', and 'file'
 	Model();
-	~Model() = default;
-	void load();
+	~Model();
+	void load(); // Blocks until the model is on the GPU, must be called from the GL thread
 	void save();
 
+	// Loads on a background thread while the GL thread keeps rendering, the GL work is handed
+	// back through updateLoad, called once per frame
+	void loadAsync();
+	// Runs queued GL work for at most budgetMs (at least one task), returns true once the load has ended
+	bool updateLoad(double budgetMs);
+	// The load ends at its next checkpoint and everything it created is freed, the model can be loaded again
+	void cancelLoad();
+	inline bool isLoading() const { return loadThread.joinable(); }
+	float getLoadProgress() const;
+	static const char* getLoadStageName(LoadStage stage);
+
+	std::atomic<LoadStage> loadStage{ LOAD_IDLE };
+	std::atomic<int> loadWorkDone{ 0 }; // Images and primitives decoded and uploaded
+	std::atomic<int> loadWorkTotal{ 0 };
+
+	// Runs GL work on the GL thread, right away outside of loadAsync. Tasks are skipped once the load is cancelled
+	std::future<void> runOnGLThread(std::function<void()> task);
+	// Waits for GL work handed out by the loading thread, rethrows its exceptions
+	void waitForGLThread(std::vector<std::future<void>>& tasks);
+	// Throws if the load has been cancelled
+	void checkCancelled();
+
 	// Variables for easy access
 	std::string file;
+	bool isBinary = false; // .glb file
+
+	// Parsed glTF, owned by each model so several can load at once
+	std::unique_ptr<tinygltf::Model> gltf;
 
-	// Prevents textures from being loaded twice
-	std::vector<std::unique_ptr<Texture>> lodTex; 
+	// Memory mapped buffers, accessors read straight from the mapping instead of a copy owned by tinygltf
+	bool mapBuffers = true;
+	std::vector<std::unique_ptr<MappedFile>> mappedFiles;
+	std::vector<const unsigned char*> mappedBuffers; // One per glTF buffer, nullptr if tinygltf owns the data (data uris)
+	std::vector<size_t> mappedBufferSizes;
+	std::vector<std::string> mappedBufferUris; // Original uris, empty for the BIN chunk of a .glb
+	std::vector<int> mappedImageViews; // One per glTF image, buffer view holding the encoded image or -1
+
+	bool mapBufferSources();
+	void releaseMappedBuffers();
+	std::vector<std::string> getBufferFiles(); // External files the buffers come from
+	const unsigned char* getBufferData(int bufferIndex);
+	size_t getBufferSize(int bufferIndex);
+
+	// Prevents textures from being loaded twice, shared with other models through the TextureCache
+	std::vector<std::shared_ptr<Texture>> lodTex; 
 	std::vector<std::unique_ptr<Material>> lodMat;
 	std::vector<std::unique_ptr<Mesh>> lodMesh; 
 	std::vector<std::unique_ptr<Light>> lodLight;
@@ -83,6 +154,38 @@ public:
 
 	std::unique_ptr<Node> root;
 
+	// World bounds of every primitive for picking and culling, rebuilt once the tree changes and refitted when nodes move
+	SceneBVH bvh;
+	SceneBVH& getBVH();
+
+	// Every primitive drawn from shared buffers with multi-draws, set before loading
+	bool mergeGeometry = true;
+	GeometryPool geometryPool;
+
+	// Baked binary copy of the loaded scene next to the model file, see SceneCache
+	bool useSceneCache = true;
+	bool loadedFromCache = false;
+
+	// Parses the glTF into the tinygltf model, false if it could not be read
+	bool parseGltf();
+	// Decodes the buffer views compressed with EXT_meshopt_compression into their fallback buffers
+	bool decodeCompressedViews();
+
+	// Frees the CPU copies of the geometry once it is on the GPU, only draw counts, bounds and GL handles remain
+	bool gpuResident = true;
+	// Keeps the glTF buffers and images for a pending save(), otherwise save() parses the glTF again
+	bool retainSourceBuffers = false;
+	bool sourceBuffersReleased = false;
+	size_t releaseCpuGeometry();
+	size_t releaseSourceBuffers();
+
+	// Block compresses textures by material role and keeps the result next to the sources, see TextureCompressor
+	bool compressTextures = true;
+
+	// Sources of lodTex, only valid during load()
+	std::vector<TextureSource> textureSources;
+	void uploadTextures(const std::vector<TextureSource>& sources);
+
 	// Loads a single mesh by its index
 	void loadTextures();
 	void loadMaterials();
@@ -108,6 +211,7 @@ public:
 	std::vector<unsigned int> findRootNodes();
 	void traverseNode(unsigned int nextNode, glm::mat4 parentMatrix = glm::mat4(1.0f), Node* parentNode = nullptr);
 	void updateTreeFrom(Node* node, glm::mat4 parentMatrix);
+	void updateGlobalMatrices(Node* node, glm::mat4 parentMatrix);
 
 	Node* searchNodeByID(Node* node, int targetId);
 	Node* getNodeByID(int id);
@@ -128,11 +232,29 @@ public:
 	inline Node* getMainCameraNode() { return getNodeByID(nodeWithCamera); }
 	inline Node* getRootNode() { return root.get(); }
 
-	// Assembles all the floats into vertices
-	std::vector<Vertex> assembleVertices(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texUVs);
-	std::vector<GLuint> getIndices(int accessorIndex);
-	std::vector<glm::vec2> getVec2(int accessorIndex);
-	std::vector<glm::vec3> getVec3(int accessorIndex);
+	// Strided view over the elements of an accessor, data is nullptr if the attribute is missing
+	struct AttributeStream {
+		const unsigned char* data = nullptr;
+		size_t stride = 0;
+		int componentType = 0;
+		int numComponents = 0;
+		bool normalized = false;
+
+		inline bool isFloat() const { return data && componentType == GL_FLOAT; }
+	};
+	AttributeStream getAttributeStream(int accessorIndex, int numComponents, size_t count);
+
+	// Reads the attributes of a primitive in a single pass into interleaved vertices, accessors of -1 are left at their defaults
+	std::vector<Vertex> interleaveVertices(int positionAccessor, int normalAccessor = -1, int texUVAccessor = -1);
+	// Throws when the accessor reads past its buffer or an index is not below numVertices
+	std::vector<GLuint> getIndices(int accessorIndex, size_t numVertices);
+
+	// Uploads primitives as 16 byte PackedVertex (snorm16 positions and octahedral normals, half UVs) instead of 44 byte Vertex
+	bool compactVertices = true;
+
+	// Reorders a primitive for the vertex cache and the vertex fetch before it is uploaded, see MeshOptimizer
+	bool optimizeMeshes = true;
+	void optimizePrimitive(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, int mode, size_t meshIndex, size_t primitiveIndex);
 
 	// Flags for changes
 	std::bitset<NumLightChangeFlags> lightFlags;
@@ -141,4 +263,16 @@ public:
 	bool hasShadowDarknessChanged = true;
 	bool hasReflectionFactorChanged = true;
 	bool hasSkyboxChanged = true;
+
+private:
+	std::thread loadThread;
+	ConcurrentQueue<std::function<void()>> glTasks;
+	bool asyncLoad = false;
+	std::atomic<bool> cancelRequested{ false };
+	std::atomic<bool> workerDone{ false };
+	std::chrono::high_resolution_clock::time_point loadStart;
+
+	bool loadContents(); // Everything up to the node tree, on the loading thread
+	void finishLoad(); // On the GL thread once every upload is done
+	void unload(); // Frees what a failed or cancelled load created, on the GL thread
 };
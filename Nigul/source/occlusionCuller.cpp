@@ -0,0 +1,217 @@
+#include "occlusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "shader.h"
+#include "texture.h"
+#include "camera.h"
+#include "renderQueue.h"
+#include "sceneBVH.h"
+#include "mesh.h"
+
+OcclusionCuller::OcclusionCuller(int width, int height) : width(width), height(height)
+{
+	pyramidShader = std::make_unique<Shader>("hiz.comp");
+	cullShader = std::make_unique<Shader>("occlusion.comp");
+
+	numLevels = static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
+	glGenTextures(1, &hiZ);
+	glBindTexture(GL_TEXTURE_2D, hiZ);
+	glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(1, &boxBuffer);
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &visibilityBuffer);
+	glGenQueries(NUM_READBACKS, queries);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	releaseReadbacks();
+	glDeleteQueries(NUM_READBACKS, queries);
+	glDeleteBuffers(1, &boxBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &visibilityBuffer);
+	glDeleteTextures(1, &hiZ);
+}
+
+void OcclusionCuller::releaseReadbacks()
+{
+	for (int i = 0; i < NUM_READBACKS; i++) {
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = nullptr;
+		if (readbackBuffers[i]) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glDeleteBuffers(1, &readbackBuffers[i]);
+		}
+		readbackBuffers[i] = 0;
+		readbackData[i] = nullptr;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void OcclusionCuller::reserve(size_t numItems)
+{
+	if (numItems <= capacity)
+		return;
+	capacity = std::max(numItems, capacity * 2);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(Box), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawCommand), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Immutable storage, the results in flight are dropped with the old buffers
+	releaseReadbacks();
+	GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	for (int i = 0; i < NUM_READBACKS; i++) {
+		glGenBuffers(1, &readbackBuffers[i]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, capacity * sizeof(uint32_t), nullptr, flags);
+		readbackData[i] = static_cast<const uint32_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity * sizeof(uint32_t), flags));
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void OcclusionCuller::beginFrame(const SceneBVH& bvh)
+{
+	size_t numItems = bvh.getItems().size();
+	reserve(numItems);
+
+	// Item indices of an older BVH mean nothing anymore, everything is an occluder until the first result
+	if (bvh.getGeneration() != bvhGeneration || lastVisible.size() != numItems) {
+		bvhGeneration = bvh.getGeneration();
+		lastVisible.assign(numItems, 1);
+		for (GLsync& fence : fences) {
+			if (fence)
+				glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	// Oldest first, so the newest finished result is the one kept
+	for (int i = 1; i <= NUM_READBACKS; i++) {
+		int slot = (frame + i) % NUM_READBACKS;
+		if (queryPending[slot]) {
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+				passTime = elapsed / 1e6;
+				queryPending[slot] = false;
+			}
+		}
+
+		if (!fences[slot])
+			continue;
+		GLenum status = glClientWaitSync(fences[slot], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+		glDeleteSync(fences[slot]);
+		fences[slot] = nullptr;
+
+		// Items outside of the frustum were not tested and read as hidden, they are tested again once back in it
+		int numVisible = 0;
+		for (size_t item = 0; item < numItems; item++) {
+			lastVisible[item] = readbackData[slot][item] != 0;
+			numVisible += lastVisible[item];
+		}
+		numTested = readbackTested[slot];
+		numOccluded = numTested - numVisible;
+	}
+}
+
+void OcclusionCuller::buildPyramid(Texture* depth)
+{
+	glBeginQuery(GL_TIME_ELAPSED, queries[frame % NUM_READBACKS]);
+
+	pyramidShader->activate();
+	pyramidShader->setInt("depthTexture", depth->unit);
+	depth->bind();
+
+	for (int level = 0; level < numLevels; level++) {
+		int levelWidth = std::max(width >> level, 1);
+		int levelHeight = std::max(height >> level, 1);
+		pyramidShader->setBool("fromDepth", level == 0);
+		glBindImageTexture(0, hiZ, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, hiZ, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void OcclusionCuller::cull(const RenderItem* begin, const RenderItem* end, const SceneBVH& bvh, Camera* camera)
+{
+	int slot = frame % NUM_READBACKS;
+	const std::vector<SceneBVH::Item>& items = bvh.getItems();
+
+	boxes.clear();
+	for (const RenderItem* item = begin; item != end; ++item) {
+		const AABB& bounds = items[item->index].bounds;
+		Box box = {};
+		std::copy(&bounds.min.x, &bounds.min.x + 3, box.minimum);
+		std::copy(&bounds.max.x, &bounds.max.x + 3, box.maximum);
+		box.item = item->index;
+		box.indexCount = static_cast<uint32_t>(item->primitive->indexCount);
+		boxes.push_back(box);
+	}
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (!boxes.empty()) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, boxes.size() * sizeof(Box), boxes.data());
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boxBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibilityBuffer);
+
+		cullShader->activate();
+		cullShader->setMat4("camMatrix", camera->cameraMatrix);
+		cullShader->setInt("numLevels", numLevels);
+		cullShader->setInt("numBoxes", static_cast<int>(boxes.size()));
+		cullShader->setInt("hiZ", HIZ_UNIT);
+		glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+		glBindTexture(GL_TEXTURE_2D, hiZ);
+
+		glDispatchCompute(static_cast<GLuint>((boxes.size() + 63) / 64), 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	size_t numItems = items.size();
+	if (numItems > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, visibilityBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[slot]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, numItems * sizeof(uint32_t));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		if (fences[slot])
+			glDeleteSync(fences[slot]);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		readbackTested[slot] = static_cast<int>(boxes.size());
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	queryPending[slot] = true;
+	frame++;
+}
+
+void OcclusionCuller::bindCommands()
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+}
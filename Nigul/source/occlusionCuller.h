@@ -0,0 +1,115 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+class Shader;
+class Texture;
+class Camera;
+class SceneBVH;
+struct RenderItem;
+
+/**
+ * @class OcclusionCuller
+ * @brief Hierarchical-Z occlusion culling of the main camera, entirely on the GPU.
+ *
+ * The depth prepass first draws the occluders that were visible last frame. A compute shader turns
+ * that depth into a pyramid where each texel keeps the farthest depth under it, then tests the world
+ * bounds of every primitive in the frustum against it and writes one indirect draw per primitive,
+ * with no instance when it is hidden. Later passes draw everything through those commands, so the
+ * CPU never waits on the result. It is read back a frame late, only to choose the next occluders
+ * and for the statistics.
+ */
+class OcclusionCuller
+{
+public:
+    // Matches DrawElementsIndirectCommand, one per item of the scene BVH
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    static const GLuint HIZ_UNIT = 102;
+    static const int NUM_READBACKS = 2;
+
+    bool enabled = true;
+
+    // Result of the last frame read back
+    int numTested = 0;
+    int numOccluded = 0;
+    double passTime = 0.0; // Milliseconds of GPU time to build the pyramid and test the boxes
+
+    OcclusionCuller(int width, int height);
+    ~OcclusionCuller();
+
+    /**
+     * @brief Picks up the newest result the GPU is done with, starts over when the BVH was rebuilt.
+     */
+    void beginFrame(const SceneBVH& bvh);
+
+    /**
+     * @brief Whether an item of the BVH passed the last test read back, true until one is.
+     */
+    inline bool wasVisible(uint32_t item) const { return item >= lastVisible.size() || lastVisible[item] != 0; }
+
+    /**
+     * @brief Builds the pyramid from a depth texture of the size given to the constructor.
+     */
+    void buildPyramid(Texture* depth);
+
+    /**
+     * @brief Tests the items of a view seen by camera and writes their draw commands.
+     */
+    void cull(const RenderItem* begin, const RenderItem* end, const SceneBVH& bvh, Camera* camera);
+
+    /**
+     * @brief Binds the draw commands for glDrawElementsIndirect, an item draws from getCommandOffset.
+     */
+    void bindCommands();
+    static inline size_t getCommandOffset(uint32_t item) { return item * sizeof(DrawCommand); }
+    // One uint per BVH item, non zero when it passed the last test
+    inline GLuint getVisibilityBuffer() const { return visibilityBuffer; }
+
+private:
+    struct Box {
+        float minimum[4];
+        float maximum[4];
+        uint32_t item;
+        uint32_t indexCount;
+        uint32_t pad[2];
+    };
+
+    void reserve(size_t numItems);
+    void releaseReadbacks();
+
+    std::unique_ptr<Shader> pyramidShader;
+    std::unique_ptr<Shader> cullShader;
+
+    GLuint hiZ = 0;
+    int width = 0;
+    int height = 0;
+    int numLevels = 0;
+
+    GLuint boxBuffer = 0;
+    GLuint commandBuffer = 0;
+    GLuint visibilityBuffer = 0;
+    size_t capacity = 0; // Items the buffers hold
+
+    // Visibility copied to persistently mapped buffers, read once their fence has passed
+    GLuint readbackBuffers[NUM_READBACKS] = {};
+    const uint32_t* readbackData[NUM_READBACKS] = {};
+    GLsync fences[NUM_READBACKS] = {};
+    int readbackTested[NUM_READBACKS] = {};
+    GLuint queries[NUM_READBACKS] = {};
+    bool queryPending[NUM_READBACKS] = {};
+    int frame = 0;
+
+    std::vector<uint8_t> lastVisible;
+    std::vector<Box> boxes;
+    uint32_t bvhGeneration = 0;
+};
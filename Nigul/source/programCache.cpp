@@ -0,0 +1,153 @@
+#include "programCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+static const char PROGRAM_MAGIC[4] = { 'N', 'P', 'R', 'G' };
+static const char* CACHE_DIRECTORY = "shaders/cache";
+
+struct ProgramHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format; // Driver specific binary format
+	uint32_t size;
+};
+
+bool ProgramCache::enabled = true;
+int ProgramCache::numLoaded = 0;
+int ProgramCache::numCompiled = 0;
+int ProgramCache::numRejected = 0;
+double ProgramCache::loadTime = 0.0;
+double ProgramCache::compileTime = 0.0;
+
+// FNV-1a, continues from hash
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool supportsBinaries()
+{
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	return numFormats > 0;
+}
+
+std::string ProgramCache::getPath(const std::vector<std::string>& stageFiles)
+{
+	std::string name;
+	for (const std::string& file : stageFiles)
+		name += (name.empty() ? "" : "+") + file;
+	return std::string(CACHE_DIRECTORY) + "/" + name + ".nprg";
+}
+
+uint64_t ProgramCache::getKey(const std::vector<std::string>& stageSources)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (const std::string& source : stageSources) {
+		uint64_t size = source.size();
+		hash = hashBytes(&size, sizeof(size), hash);
+		hash = hashBytes(source.data(), source.size(), hash);
+	}
+
+	// A driver update changes the version string, its binaries may not load anymore
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char* value = reinterpret_cast<const char*>(glGetString(name));
+		if (value)
+			hash = hashBytes(value, std::strlen(value) + 1, hash);
+	}
+	return hash;
+}
+
+bool ProgramCache::load(GLuint program, const std::string& path, uint64_t key)
+{
+	if (!enabled || !supportsBinaries())
+		return false;
+
+	std::ifstream input(path, std::ios::binary);
+	if (!input)
+		return false;
+
+	ProgramHeader header;
+	if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) != 0
+		|| header.version != VERSION || header.key != key)
+		return false;
+
+	std::vector<char> binary(header.size);
+	if (!input.read(binary.data(), binary.size()))
+		return false;
+
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE) {
+		std::cout << "Shader binary " << path << " was rejected by the driver, compiling from source" << std::endl;
+		numRejected++;
+		return false;
+	}
+	return true;
+}
+
+bool ProgramCache::save(GLuint program, const std::string& path, uint64_t key)
+{
+	if (!enabled || !supportsBinaries())
+		return false;
+
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return false;
+
+	ProgramHeader header;
+	std::memcpy(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+	header.version = VERSION;
+	header.key = key;
+	std::vector<char> binary(size);
+	GLsizei length = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, size, &length, &format, binary.data());
+	if (length <= 0)
+		return false;
+	header.format = format;
+	header.size = static_cast<uint32_t>(length);
+
+	std::error_code error;
+	std::filesystem::create_directories(CACHE_DIRECTORY, error);
+
+	// Written under a temporary name so another launch never reads half a file
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(binary.data(), length);
+		if (!output) {
+			std::cerr << "Failed to write the shader binary " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::cerr << "Failed to write the shader binary " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
+
+void ProgramCache::printStats()
+{
+	std::cout << "Shaders: " << numLoaded << " programs from binaries in " << loadTime << " ms (warm), "
+		<< numCompiled << " compiled from source in " << compileTime << " ms (cold";
+	if (numRejected > 0)
+		std::cout << ", " << numRejected << " binaries rejected";
+	std::cout << ")" << std::endl;
+}
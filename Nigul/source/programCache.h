@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @class ProgramCache
+ * @brief Linked shader programs saved with glGetProgramBinary, so later launches skip the GLSL compile.
+ *
+ * A binary is keyed by the source of every stage and by the vendor, renderer and version strings of
+ * the driver, which may reject binaries from another build of itself anyway. Anything stale,
+ * corrupt or rejected is compiled from source again and the binary is rewritten.
+ */
+class ProgramCache
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    static bool enabled;
+
+    // Statistics since the start, programs restored from a binary and programs compiled from source
+    static int numLoaded;
+    static int numCompiled;
+    static int numRejected; // Binaries the driver refused, also counted in numCompiled
+    static double loadTime; // Milliseconds the GL thread spent restoring binaries
+    static double compileTime; // Milliseconds from submit to link completion summed over programs, parallel compiles overlap
+
+    /**
+     * @brief Path of the binary of a program made of the given stage files.
+     */
+    static std::string getPath(const std::vector<std::string>& stageFiles);
+
+    /**
+     * @brief Hash of the stage sources and of the current driver, needs a GL context.
+     */
+    static uint64_t getKey(const std::vector<std::string>& stageSources);
+
+    /**
+     * @brief Restores a program from its binary.
+     *
+     * @return false if there is no binary for key or the driver rejects it, the program is then unusable.
+     */
+    static bool load(GLuint program, const std::string& path, uint64_t key);
+
+    /**
+     * @brief Writes the binary of a linked program, which was linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+     */
+    static bool save(GLuint program, const std::string& path, uint64_t key);
+
+    /**
+     * @brief Prints how long the programs took, warm and cold apart.
+     */
+    static void printStats();
+};
@@ -0,0 +1,183 @@
+#include "renderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "model.h"
+
+static const int VIEW_SHIFT = 60;
+static const int BLEND_SHIFT = 59;
+static const uint64_t DEPTH_MASK = (1ull << 24) - 1;
+static const uint32_t SHADER_MASK = (1u << 8) - 1;
+static const uint32_t TEXTURE_SET_MASK = (1u << 14) - 1;
+static const uint32_t MATERIAL_MASK = (1u << 13) - 1;
+
+// Positive floats sort like their bits, the top 24 of them are plenty to order draws
+static uint64_t quantizeDepth(float depth)
+{
+	depth = std::max(depth, 0.0f);
+	uint32_t bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return (bits >> 7) & DEPTH_MASK;
+}
+
+// Materials sampling the same textures get the same id, collisions only cost some grouping
+static uint32_t getTextureSetId(const Material* material)
+{
+	if (!material)
+		return 0;
+	uint64_t hash = 14695981039346656037ull;
+	for (const Texture* texture : { material->pbrMetallicRoughness.baseColorTexture, material->pbrMetallicRoughness.metallicRoughness,
+		material->emissiveTexture, material->normalMap, material->occlusionTexture }) {
+		hash ^= reinterpret_cast<uintptr_t>(texture);
+		hash *= 1099511628211ull;
+	}
+	return static_cast<uint32_t>(hash ^ (hash >> 32)) & TEXTURE_SET_MASK;
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	usedViews = 0;
+}
+
+void RenderQueue::addView(int id, Shader* shader, Camera* camera)
+{
+	views[id].shader = shader;
+	views[id].camera = camera;
+	if (camera)
+		views[id].frustum = Frustum::fromMatrix(camera->cameraMatrix);
+	usedViews |= 1u << id;
+	numDrawn[id] = 0;
+	numCulled[id] = 0;
+}
+
+bool RenderQueue::hasView(int id) const
+{
+	return (usedViews & (1u << id)) != 0;
+}
+
+const RenderQueue::View& RenderQueue::getView(int id) const
+{
+	return views[id];
+}
+
+uint32_t RenderQueue::getMaterialId(const Material* material)
+{
+	if (!material)
+		return 0;
+	// Ids stay the same from frame to frame, the table starts over once they run out
+	if (materialIds.size() >= MATERIAL_MASK)
+		materialIds.clear();
+	auto [it, inserted] = materialIds.try_emplace(material, static_cast<uint32_t>(materialIds.size() + 1));
+	return it->second;
+}
+
+uint32_t RenderQueue::getShaderId(const Shader* shader)
+{
+	if (shaderIds.size() >= SHADER_MASK)
+		shaderIds.clear();
+	auto [it, inserted] = shaderIds.try_emplace(shader, static_cast<uint32_t>(shaderIds.size()));
+	return it->second;
+}
+
+uint64_t RenderQueue::getKey(int id, const View& view, const Primitive& primitive, const AABB& bounds)
+{
+	const Material* material = primitive.material;
+	uint64_t shader = getShaderId(view.shader) & SHADER_MASK;
+	uint64_t textureSet = getTextureSetId(material);
+	uint64_t materialId = getMaterialId(material) & MATERIAL_MASK;
+
+	uint64_t depth = 0;
+	if (view.camera) {
+		depth = quantizeDepth(glm::length(bounds.getCenter() - view.camera->getPosition()));
+	}
+
+	uint64_t key = static_cast<uint64_t>(id) << VIEW_SHIFT;
+	if (material && material->alphaMode == BLEND_MODE) {
+		key |= 1ull << BLEND_SHIFT;
+		key |= (DEPTH_MASK - depth) << 35;
+		key |= shader << 27;
+		key |= materialId << 14;
+		key |= textureSet;
+	}
+	else {
+		key |= shader << 51;
+		key |= textureSet << 37;
+		key |= materialId << 24;
+		key |= depth;
+	}
+	return key;
+}
+
+void RenderQueue::build(const SceneBVH& bvh)
+{
+	const std::vector<SceneBVH::Item>& bvhItems = bvh.getItems();
+	int numItems = static_cast<int>(bvhItems.size());
+
+	for (int id = 0; id < MAX_VIEWS; id++) {
+		if (!hasView(id))
+			continue;
+
+		const View& view = views[id];
+		bool culled = frustumCulling && view.camera;
+		if (culled) {
+			visible.clear();
+			bvh.queryFrustum(view.frustum, visible);
+			for (uint32_t index : visible) {
+				const SceneBVH::Item& item = bvhItems[index];
+				items.push_back({ getKey(id, view, *item.primitive, item.bounds), item.primitive, &item.node->globalMatrix, index });
+			}
+			numDrawn[id] = static_cast<int>(visible.size());
+		}
+		else {
+			for (uint32_t index = 0; index < bvhItems.size(); index++) {
+				const SceneBVH::Item& item = bvhItems[index];
+				items.push_back({ getKey(id, view, *item.primitive, item.bounds), item.primitive, &item.node->globalMatrix, index });
+			}
+			numDrawn[id] = numItems;
+		}
+		numCulled[id] = numItems - numDrawn[id];
+	}
+}
+
+void RenderQueue::sort()
+{
+	size_t count = items.size();
+	if (count < 2)
+		return;
+	scratch.resize(count);
+
+	uint64_t sharedBits = ~0ull;
+	uint64_t first = items[0].key;
+	for (const RenderItem& item : items)
+		sharedBits &= ~(item.key ^ first);
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		// Every key has the same byte here, the pass would not move anything
+		if (((sharedBits >> shift) & 0xFF) == 0xFF)
+			continue;
+
+		size_t offsets[256] = {};
+		for (const RenderItem& item : items)
+			offsets[(item.key >> shift) & 0xFF]++;
+		size_t total = 0;
+		for (size_t& offset : offsets) {
+			size_t size = offset;
+			offset = total;
+			total += size;
+		}
+		for (const RenderItem& item : items)
+			scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+		items.swap(scratch);
+	}
+}
+
+std::pair<const RenderItem*, const RenderItem*> RenderQueue::getItems(int id) const
+{
+	auto byView = [](const RenderItem& item, uint64_t view) { return (item.key >> VIEW_SHIFT) < view; };
+	auto begin = std::lower_bound(items.begin(), items.end(), static_cast<uint64_t>(id), byView);
+	auto end = std::lower_bound(begin, items.end(), static_cast<uint64_t>(id) + 1, byView);
+	const RenderItem* data = items.data();
+	return { data + (begin - items.begin()), data + (end - items.begin()) };
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "bounds.h"
+
+class SceneBVH;
+class Shader;
+class Camera;
+class Material;
+struct Primitive;
+
+// One primitive drawn in one view, in submission order once the queue is sorted
+struct RenderItem
+{
+    uint64_t key;
+    Primitive* primitive;
+    const glm::mat4* matrix; // Global matrix of the node, valid until the node tree changes
+    uint32_t index; // Item of the SceneBVH the queue was built from
+};
+
+// Node matrices that mirror a primitive reverse the winding of its triangles, its front faces are then clockwise
+inline bool isMirrored(const RenderItem& item) { return glm::determinant(glm::mat3(*item.matrix)) < 0.0f; }
+
+/**
+ * @class RenderQueue
+ * @brief Flat list of every primitive to draw this frame, sorted by a 64 bit key.
+ *
+ * Every view (a pass over the scene with its own shader and camera) is added first, then each view
+ * queries the scene BVH for the primitives it sees and writes one item per primitive. The key holds,
+ * from the top:
+ *
+ *     view (4) | blend (1) | opaque: shader (8) | texture set (14) | material (13) | depth (24)
+ *                          | blend:  far to near depth (24) | shader (8) | material (13) | texture set (14)
+ *
+ * so after the radix sort each view is contiguous, opaque primitives come front to back grouped by
+ * state and blended ones come back to front after them. Primitives whose world bounds are outside
+ * the frustum of a view get no item in it, whole BVH subtrees are accepted or rejected at once.
+ * Buffers are kept between frames.
+ */
+class RenderQueue
+{
+public:
+    static const int MAX_VIEWS = 16;
+
+    struct View {
+        Shader* shader = nullptr;
+        Camera* camera = nullptr;
+        Frustum frustum;
+    };
+
+    std::vector<RenderItem> items;
+
+    bool frustumCulling = true;
+
+    // Primitives of each view drawn and culled the last time it was added, shadow views are not added every frame
+    int numDrawn[MAX_VIEWS] = {};
+    int numCulled[MAX_VIEWS] = {};
+
+    /**
+     * @brief Empties the queue, views included, keeping the memory.
+     */
+    void clear();
+
+    /**
+     * @brief Adds a view drawn with shader from camera, id below MAX_VIEWS and only used once per frame.
+     *
+     * Views without a camera are never culled.
+     */
+    void addView(int id, Shader* shader, Camera* camera);
+    bool hasView(int id) const;
+    const View& getView(int id) const;
+
+    /**
+     * @brief Writes the items of every primitive of the BVH into every view that can see it.
+     */
+    void build(const SceneBVH& bvh);
+
+    /**
+     * @brief LSD radix sort on the keys, stable, bytes every key shares are skipped.
+     */
+    void sort();
+
+    /**
+     * @brief Sorted items of a view as [begin, end).
+     */
+    std::pair<const RenderItem*, const RenderItem*> getItems(int id) const;
+
+private:
+    uint64_t getKey(int id, const View& view, const Primitive& primitive, const AABB& bounds);
+    uint32_t getMaterialId(const Material* material);
+    uint32_t getShaderId(const Shader* shader);
+
+    View views[MAX_VIEWS];
+    uint32_t usedViews = 0; // Bit per view added
+
+    std::vector<RenderItem> scratch;
+    std::vector<uint32_t> visible;
+    std::unordered_map<const Material*, uint32_t> materialIds;
+    std::unordered_map<const Shader*, uint32_t> shaderIds;
+};
@@ -6,14 +6,21 @@ Renderer::Renderer(int width, int height) {
 	shaderMap["shadow"] = std::make_unique<Shader>("shadow.vert", "shadow.frag");
 	shaderMap["normal"] = std::make_unique<Shader>("normal.vert", "normal.frag");
 
-	normalFBO = std::make_unique<FBO>(width, height, 100, FBO_ONE_COLOR);
-	depthFBO = std::make_unique<FBO>(width, height, 101, FBO_DEPTH);
+	occlusionCuller = std::make_unique<OcclusionCuller>(width, height);
+	gpuScene = std::make_unique<GpuScene>();
+	lightBuffer = std::make_unique<LightBuffer>();
+	lightClusters = std::make_unique<LightClusters>(width, height);
+	deferredShading = std::make_unique<DeferredShading>(width, height);
 
 	quadSsao = std::make_unique<FXSsao>(width, height, 64, 0.5f, true);
 
 	FXpipeline = std::make_unique<FXMsaa>(width, height);
 	FXpipeline->nextFX = std::make_unique<FXAberration>(width, height); 
 	FXpipeline->nextFX->nextFX = std::make_unique<FXTonemap>(width, height);
+
+	// The normals of the prepass at 100, the depth it resolves to at 101
+	prepassFBO = std::make_unique<FBO>(width, height, 100, GL_RGBA16F, FXpipeline->fbo->depthBuffer);
+	cameraFBO = std::make_unique<FBO>(width, height, 100, std::vector<GLenum>{ GL_RGBA16F });
 }
 
 void Renderer::render(Model* model, Skybox* skybox) {
@@ -25,16 +32,42 @@ void Renderer::render(Model* model, Skybox* skybox) {
 	Shader* skyboxShader = shaderMap["skybox"].get();
 	FXQuad* MSAAFX = FXpipeline.get();
 
+	buildRenderQueue(model, camera);
+	gpuScene->beginFrame(model);
+	renderDepthPrepass(model, camera);
 	renderShadowMap(model);
 	setAllUniforms(model, skybox, defaultShader);
+	if (lightClusters->enabled)
+		lightClusters->build(camera, lightBuffer->getNumLights());
+	lightClusters->bind(defaultShader, camera);
+
+	if (deferredShading->enabled) {
+		renderDeferred(model, skybox, camera);
+		render(FXpipeline->nextFX.get());
+		return;
+	}
 	
 	MSAAFX->fbo->bind();
 
+	SubmitMode mode = isOcclusionCullingActive() ? SUBMIT_VISIBLE : SUBMIT_ALL;
 	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.w);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	renderModel(model, defaultShader, camera);
+	if (renderQueue.hasView(VIEW_DEPTH)) {
+		// The prepass left the nearest opaque surface of every sample in the depth buffer, only it is shaded
+		glClear(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		submit(VIEW_MAIN, mode, nullptr, SUBMIT_OPAQUE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+		submit(VIEW_MAIN, mode, nullptr, SUBMIT_BLENDED);
+	}
+	else {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		submit(VIEW_MAIN, mode);
+	}
 	renderSkybox(skybox, skyboxShader, camera);
+	markTextureUse(camera);
 
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, MSAAFX->fbo->ID);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FXpipeline->nextFX->fbo->ID);
@@ -45,55 +78,177 @@ void Renderer::render(Model* model, Skybox* skybox) {
 	render(FXpipeline->nextFX.get());
 }
 
-void Renderer::renderModel(Model* model, Shader* shader, Camera* camera) {
-	Node* root = model->root.get();
+void Renderer::buildRenderQueue(Model* model, Camera* camera) {
+	renderQueue.clear();
+	Shader* shadowShader = shaderMap["shadow"].get();
+
+	// The normal shader writes depth too, the shadow one is enough when nothing reads the normals
+	if (isDepthPrepassEnabled || isSsaoEnabled || occlusionCuller->enabled)
+		renderQueue.addView(VIEW_DEPTH, isSsaoEnabled ? shaderMap["normal"].get() : shadowShader, camera);
 
-	for (auto& renderCall : getRenderCalls(root, shader, camera)) {
-		render(renderCall);
+	// Shadow maps are only drawn again when a light moved
+	if (model->lightFlags[ProjectionMatrices]) {
+		for (auto& light : model->lodLight) {
+			if (light->shadowMap && light->enabled && light->castShadows)
+				renderQueue.addView(VIEW_SHADOW + light->shadowIndex, shadowShader, light->camera);
+		}
 	}
+
+	renderQueue.addView(VIEW_MAIN, shaderMap["default"].get(), camera);
+	renderQueue.build(model->getBVH());
+	renderQueue.sort();
 }
 
-void Renderer::render(renderCall call) {
-	call.shader->activate();
+// Uniforms set for every view and item, resolved once
+static const ShaderUniform<glm::vec3> camPosUniform("camPos");
+static const ShaderUniform<glm::mat4> camMatrixUniform("camMatrix");
+static const ShaderUniform<bool> drawFromBuffersUniform("drawFromBuffers");
+static const ShaderUniform<glm::mat4> modelUniform("model");
+static const ShaderUniform<bool> octNormalsUniform("octNormals");
 
-	// Draw all primitives in the mesh
-	for (auto& primitive: call.mesh->primitives) {
-		primitive.vao.bind(); // Bind the vao of the primitive
+void Renderer::submit(int view, SubmitMode mode, Shader* shader, SubmitBlend blendFilter) {
+	if (!renderQueue.hasView(view))
+		return;
+
+	const RenderQueue::View& target = renderQueue.getView(view);
+	if (!shader)
+		shader = target.shader;
+	shader->activate();
+
+	if (target.camera) { // If the view has a camera, set the camera uniforms
+		shader->set(camPosUniform, glm::vec3(target.camera->viewMatrix[3]));
+		shader->set(camMatrixUniform, target.camera->cameraMatrix);
+	}
 
-		if (primitive.material) { // If the primitive has a material, bind it too
-			primitive.material->bind(call.shader);
+	// The depth function is left to the caller, the main view tests against the prepass with GL_EQUAL
+	glEnable(GL_DEPTH_TEST);
+
+	// Views that sample the materials get the texture arrays, their samplers are set even when unused
+	bool textured = view == VIEW_MAIN || (view == VIEW_DEPTH && isSsaoEnabled);
+	if (textured)
+		TexturePool::shared().bind(shader);
+
+	shader->set(drawFromBuffersUniform, gpuScene->isActive());
+	if (gpuScene->isActive()) {
+		// The visibility of the occlusion test hides items on the GPU instead of their own indirect commands
+		submitted.clear();
+		auto [begin, end] = renderQueue.getItems(view);
+		for (const RenderItem* item = begin; item != end; ++item) {
+			if (isSubmitted(*item, mode, blendFilter))
+				submitted.push_back(item);
 		}
+		bool cullHidden = mode == SUBMIT_NEWLY_VISIBLE || mode == SUBMIT_VISIBLE;
+		gpuScene->submit(submitted, shader, textured, cullHidden ? occlusionCuller->getVisibilityBuffer() : 0);
+		return;
+	}
+
+	// Items come grouped by state and blended ones last, only what changes from one item to the next is set
+	Material* boundMaterial = nullptr;
+	int cullFace = -1; // Set by the first item, whatever the state was before
+	bool frontFaceCW = false;
+	bool blend = false;
+
+	bool indirect = mode == SUBMIT_NEWLY_VISIBLE || mode == SUBMIT_VISIBLE;
+	if (indirect)
+		occlusionCuller->bindCommands();
+
+	auto [begin, end] = renderQueue.getItems(view);
+	for (const RenderItem* item = begin; item != end; ++item) {
+		Primitive& primitive = *item->primitive;
+		Material* material = primitive.material;
+		if (!isSubmitted(*item, mode, blendFilter))
+			continue;
+
+		primitive.vao.bind(); // Bind the vao of the primitive
 
-		if (call.camera) { // If the call has a camera, set the camera uniforms
-			call.shader->setVec3("camPos", call.camera->viewMatrix[3]);
-			call.shader->setMat4("camMatrix", call.camera->cameraMatrix);
+		if (material && material != boundMaterial) { // If the primitive has a material, bind it too
+			material->bind(shader);
+			boundMaterial = material;
 		}
 
-		call.shader->setMat4("model", call.matrix);
+		// Compact primitives store positions relative to their bounds
+		shader->set(modelUniform, *item->matrix * primitive.dequantizeMatrix);
+		shader->set(octNormalsUniform, primitive.compact);
 
-		if (primitive.material) {
-			if (primitive.material->doubleSided) {
+		// Single sided materials cull their back faces, double sided ones draw both
+		bool cull = !(material && material->doubleSided);
+		if (cullFace != static_cast<int>(cull)) {
+			if (cull)
+				glEnable(GL_CULL_FACE);
+			else
 				glDisable(GL_CULL_FACE);
-			}
-			if (primitive.material->alphaMode == BLEND_MODE) {
-				glEnable(GL_BLEND);
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			}
+			cullFace = cull;
+		}
+		bool mirrored = isMirrored(*item);
+		if (mirrored != frontFaceCW) {
+			glFrontFace(mirrored ? GL_CW : GL_CCW);
+			frontFaceCW = mirrored;
 		}
 
-		glEnable(GL_DEPTH_TEST);
-		glDepthFunc(GL_LESS);
+		if (!blend && material && material->alphaMode == BLEND_MODE) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			blend = true;
+		}
 
-		glDrawElements(GL_TRIANGLES, primitive.indices.size(), GL_UNSIGNED_INT, 0);
+		// Hidden primitives have no instance in their command
+		if (indirect)
+			glDrawElementsIndirect(GL_TRIANGLES, primitive.indexType, reinterpret_cast<const void*>(OcclusionCuller::getCommandOffset(item->index)));
+		else
+			glDrawElements(GL_TRIANGLES, primitive.indexCount, primitive.indexType, 0);
+	}
 
-		if (primitive.material) {
-			if (primitive.material->doubleSided) {
-				glEnable(GL_CULL_FACE);
-			}
-			if (primitive.material->alphaMode == BLEND_MODE) {
-				glDisable(GL_BLEND);
-			}
-		}
+	if (indirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	// The skybox and the effects draw with culling off
+	if (cullFace == 1)
+		glDisable(GL_CULL_FACE);
+	if (frontFaceCW)
+		glFrontFace(GL_CCW);
+	if (blend)
+		glDisable(GL_BLEND);
+}
+
+bool Renderer::isSubmitted(const RenderItem& item, SubmitMode mode, SubmitBlend blend) const {
+	const Material* material = item.primitive->material;
+	if (blend != SUBMIT_ANY_BLEND && (material && material->alphaMode == BLEND_MODE) != (blend == SUBMIT_BLENDED))
+		return false;
+	if (mode != SUBMIT_LAST_VISIBLE && mode != SUBMIT_NEWLY_VISIBLE)
+		return true;
+
+	// Blended and masked primitives do not hide what is behind their bounds, they are never occluders
+	bool occluder = (!material || material->alphaMode == OPAQUE_MODE) && occlusionCuller->wasVisible(item.index);
+	return occluder == (mode == SUBMIT_LAST_VISIBLE);
+}
+
+// Diameter in pixels of the bounding sphere of a primitive
+static float getScreenSize(const Primitive& primitive, const glm::mat4& matrix, Camera* camera, int viewportHeight)
+{
+	glm::vec3 center = glm::vec3(matrix * glm::vec4((primitive.boundsMin + primitive.boundsMax) * 0.5f, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+	float radius = glm::length(primitive.boundsMax - primitive.boundsMin) * 0.5f * scale;
+	float pixelsPerUnit = camera->projectionMatrix[1][1] * 0.5f * viewportHeight;
+
+	if (camera->getType() == ORTHOGRAPHIC)
+		return 2.0f * radius * pixelsPerUnit;
+
+	// Inside the sphere it covers the whole view
+	float distance = glm::length(center - camera->getPosition());
+	if (distance <= radius)
+		return std::numeric_limits<float>::max();
+	return 2.0f * radius / distance * pixelsPerUnit;
+}
+
+void Renderer::markTextureUse(Camera* camera) {
+	if (!camera)
+		return;
+
+	int viewportHeight = FXpipeline->height;
+	auto [begin, end] = renderQueue.getItems(VIEW_MAIN);
+	for (const RenderItem* item = begin; item != end; ++item) {
+		if (item->primitive->material)
+			item->primitive->material->markUsed(getScreenSize(*item->primitive, *item->matrix, camera, viewportHeight));
 	}
 }
 
@@ -117,21 +272,6 @@ void Renderer::render(FXQuad* fxQuad) {
 	}
 }
 
-std::vector<renderCall> Renderer::getRenderCalls(Node* node, Shader* shader, Camera* camera) {
-	std::vector<renderCall> renderCalls;
-
-	if (node->mesh) {
-		renderCalls.push_back(renderCall{ node->mesh, shader, camera, node->globalMatrix });
-	}
-
-	for (auto& child : node->children) {
-		auto childCalls = getRenderCalls(child.get(), shader, camera);
-		renderCalls.insert(renderCalls.end(), childCalls.begin(), childCalls.end());
-	}
-
-	return renderCalls;
-}
-
 void Renderer::renderSkybox(Skybox* skybox, Shader* shader, Camera* camera) {
 	if (skybox) {
 		shader->activate();
@@ -152,216 +292,6 @@ void Renderer::renderSkybox(Skybox* skybox, Shader* shader, Camera* camera) {
 	}
 }
 
-void Renderer::setLightColorsUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Colors])
-		return;
-	glm::vec3 lightColors[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightColors[i] = light->color;
-	}
-	shader->activate();
-	shader->setVecs3("lightColors", lightColors, MAX_LIGHTS);
-	model->lightFlags[Colors] = false;
-}
-
-void Renderer::setLightPositionsUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Positions])
-		return;
-	glm::vec3 lightPositions[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightPositions[i] = light->position;
-	}
-	shader->activate();
-	shader->setVecs3("lightPositions", lightPositions, MAX_LIGHTS);
-	model->lightFlags[Positions] = false;
-}
-
-void Renderer::setLightEnablingUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[enablings])
-		return;
-	int lightEnablings[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightEnablings[i] = light->enabled;
-	}
-	shader->activate();
-	shader->setInts("lightEnablings", lightEnablings, MAX_LIGHTS);
-	model->lightFlags[enablings] = false;
-}
-
-void Renderer::setLightTypesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Types])
-		return;
-	int lightTypes[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightTypes[i] = static_cast<int>(light->getType());
-		std::cout << "Light types set: " << lightTypes[i] << std::endl;
-	}
-	shader->activate();
-	shader->setInts("lightTypes", lightTypes, MAX_LIGHTS);
-	shader->setInt("numLights", model->lodLight.size());
-	model->lightFlags[Types] = false;
-}
-
-void Renderer::setLightIntensitiesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Intensities])
-		return;
-	float lightIntensities[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightIntensities[i] = light->intensity;
-	}
-	shader->activate();
-	shader->setFloats("lightIntensities", lightIntensities, MAX_LIGHTS);
-	model->lightFlags[Intensities] = false;
-}
-
-void Renderer::setLightRangesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Ranges])
-		return;
-	float lightRanges[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightRanges[i] = light->range;
-	}
-	shader->activate();
-	shader->setFloats("lightRanges", lightRanges, MAX_LIGHTS);
-	model->lightFlags[Ranges] = false;
-}
-
-void Renderer::setLightShadowBiasesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[ShadowBiases])
-		return;
-	float lightShadowBiases[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightShadowBiases[i] = light->shadowBias;
-	}
-	shader->activate();
-	shader->setFloats("lightShadowBiases", lightShadowBiases, MAX_LIGHTS);
-	model->lightFlags[ShadowBiases] = false;
-}
-
-void Renderer::setLightAttenuationsUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Attenuations])
-		return;
-	float lightAttenuations[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		if (light->getType() == POINTLIGHT) {
-			lightAttenuations[i] = dynamic_cast<PointLight*>(light)->attenuation;
-		}
-		else {
-			lightAttenuations[i] = 0.0f;
-		}
-	}
-	shader->activate();
-	shader->setFloats("lightAttenuations", lightAttenuations, MAX_LIGHTS);
-	model->lightFlags[Attenuations] = false;
-}
-
-void Renderer::setLightProjectionMatricesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[ProjectionMatrices])
-		return;
-	glm::mat4 lightProjectionMatrixes[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		if (light->getType() == DIRECTIONAL) {
-			lightProjectionMatrixes[i] = dynamic_cast<DirectionalLight*>(light)->camera->cameraMatrix;
-		}
-		else {
-			lightProjectionMatrixes[i] = glm::mat4(1.0f);
-		}
-	}
-	shader->activate();
-	shader->setMats4("lightProjectionMatrixes", lightProjectionMatrixes, MAX_LIGHTS);
-	model->lightFlags[ProjectionMatrices] = false;
-}
-
-void Renderer::setLightDirectionsUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[Directions])
-		return;
-	glm::vec3 lightDirections[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		if (light->getType() == SPOTLIGHT) {
-			lightDirections[i] = dynamic_cast<SpotLight*>(light)->direction;
-		}
-		else {
-			lightDirections[i] = glm::vec3(0.0f);
-		}
-	}
-	shader->activate();
-	shader->setVecs3("lightDirections", lightDirections, MAX_LIGHTS);
-	model->lightFlags[Directions] = false;
-}
-
-void Renderer::setLightInnerConeAnglesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[InnerConeAngles])
-		return;
-	float lightInnerConeAngles[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		if (light->getType() == SPOTLIGHT) {
-			lightInnerConeAngles[i] = dynamic_cast<SpotLight*>(light)->innerConeAngle;
-		}
-		else {
-			lightInnerConeAngles[i] = 0.0f;
-		}
-	}
-	shader->activate();
-	shader->setFloats("lightInnerConeAngles", lightInnerConeAngles, MAX_LIGHTS);
-	model->lightFlags[InnerConeAngles] = false;
-}
-
-void Renderer::setLightOuterConeAnglesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[OuterConeAngles])
-		return;
-	float lightOuterConeAngles[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		if (light->getType() == SPOTLIGHT) {
-			lightOuterConeAngles[i] = dynamic_cast<SpotLight*>(light)->outerConeAngle;
-		}
-		else {
-			lightOuterConeAngles[i] = 0.0f;
-		}
-	}
-	shader->activate();
-	shader->setFloats("lightOuterConeAngles", lightOuterConeAngles, MAX_LIGHTS);
-	model->lightFlags[OuterConeAngles] = false;
-}
-
-void Renderer::setLightCastShadowsUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[CastShadows])
-		return;
-	int lightCastShadows[MAX_LIGHTS];
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		lightCastShadows[i] = light->castShadows;
-	}
-	shader->activate();
-	shader->setInts("lightCastShadows", lightCastShadows, MAX_LIGHTS);
-	model->lightFlags[CastShadows] = false;
-}
-
-void Renderer::setLightShadowMapSamplesUniform(Shader* shader, Model* model) {
-	if (!model->lightFlags[ShadowMapSamples])
-		return;
-	int indexTexture = model->lodTex.size();
-	int lightShadowMapSamples[MAX_LIGHTS] = { indexTexture, indexTexture + 1, indexTexture + 2, indexTexture + 3 };
-	shader->activate();
-	shader->setInts("lightShadowMapSamples", lightShadowMapSamples, MAX_LIGHTS);
-	for (int i = 0; i < model->lodLight.size(); i++) {
-		auto light = model->lodLight[i].get();
-		light->shadowMap->depthTex->bind();
-	}
-	model->lightFlags[ShadowMapSamples] = false;
-}
-
 void Renderer::setAmbientColorUniform(Shader* shader, Model* model) {
 	if (!model->hasAmbientColorChanged)
 		return;
@@ -406,33 +336,32 @@ void Renderer::setSkyboxUniforms(Shader* shader, Model* model, Skybox* skybox) {
 	model->hasSkyboxChanged = false;
 }
 
+void Renderer::setSceneUniforms(Model* model, Skybox* skybox, Shader* shader) {
+	shader->activate();
+	shader->setFloat("ambientLight", model->ambientLight);
+	shader->setVec3("ambientColor", model->ambientColor);
+	shader->setFloat("shadowDarkness", model->shadowDarkness);
+	shader->setFloat("reflectionFactor", model->reflectionFactor);
+	shader->setBool("hasSkybox", skybox != nullptr);
+	if (skybox)
+		shader->setSkybox("skybox", *skybox);
+}
+
 void Renderer::setDepthCameraUniform(Shader* shader, Model* model) {
 	shader->activate();
-	shader->setInt("depthCamera", depthFBO->depthTex->unit);
-	depthFBO->depthTex->bind();
+	shader->setInt("depthCamera", cameraFBO->depthTex->unit);
+	cameraFBO->depthTex->bind();
 }
 
 void Renderer::setNormalCameraUniform(Shader* shader, Model* model) {
 	shader->activate();
-	shader->setInt("normalCamera", normalFBO->colorTextures[0]->unit);
-	normalFBO->colorTextures[0]->bind();
+	shader->setInt("normalCamera", cameraFBO->colorTextures[0]->unit);
+	cameraFBO->colorTextures[0]->bind();
 }
 
 void Renderer::setAllUniforms(Model* model, Skybox* skybox, Shader* shader) {
-	setLightColorsUniform(shader, model);
-	setLightPositionsUniform(shader, model);
-	setLightEnablingUniform(shader, model);
-	setLightTypesUniform(shader, model);
-	setLightIntensitiesUniform(shader, model);
-	setLightRangesUniform(shader, model);
-	setLightShadowBiasesUniform(shader, model);
-	setLightAttenuationsUniform(shader, model);
-	setLightProjectionMatricesUniform(shader, model);
-	setLightDirectionsUniform(shader, model);
-	setLightInnerConeAnglesUniform(shader, model);
-	setLightOuterConeAnglesUniform(shader, model);
-	setLightCastShadowsUniform(shader, model);
-	setLightShadowMapSamplesUniform(shader, model);
+	lightBuffer->update(model);
+	lightBuffer->bind(model, shader);
 	setAmbientLightUniform(shader, model);
 	setAmbientColorUniform(shader, model);
 	setShadowDarknessUniform(shader, model);
@@ -440,41 +369,88 @@ void Renderer::setAllUniforms(Model* model, Skybox* skybox, Shader* shader) {
 	setSkyboxUniforms(shader, model, skybox);
 }
 
-void Renderer::renderShadowMap(Model* model) {
-	if (isSsaoEnabled) {
-		// We render the scene depth to a texture
-		glEnable(GL_DEPTH_TEST);
+void Renderer::renderDeferred(Model* model, Skybox* skybox, Camera* camera) {
+	SubmitMode mode = isOcclusionCullingActive() ? SUBMIT_VISIBLE : SUBMIT_ALL;
 
-		depthFBO->bind();
+	deferredShading->beginGeometryPass();
+	submit(VIEW_MAIN, mode, deferredShading->geometryShader.get(), SUBMIT_OPAQUE);
+	deferredShading->gBuffer->unbind();
 
-		glClear(GL_DEPTH_BUFFER_BIT);
+	// The input of the effect after the MSAA one, which this path skips
+	FBO* target = FXpipeline->nextFX->fbo.get();
+	target->bind();
+	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.w);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		renderModel(model, shaderMap["shadow"].get(), model->getMainCamera());
+	Shader* lightingShader = deferredShading->lightingShader.get();
+	setSceneUniforms(model, skybox, lightingShader);
+	lightBuffer->bind(model, lightingShader);
+	lightClusters->bind(lightingShader, camera);
+	deferredShading->light(camera);
 
-		depthFBO->unbind();
+	submit(VIEW_MAIN, mode, nullptr, SUBMIT_BLENDED);
+	renderSkybox(skybox, shaderMap["skybox"].get(), camera);
+	markTextureUse(camera);
 
-		// We render the scene normals to a texture
+	target->unbind();
+}
 
-		normalFBO->bind();
+void Renderer::renderDepthPrepass(Model* model, Camera* camera) {
+	if (!renderQueue.hasView(VIEW_DEPTH))
+		return;
 
-		glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.w);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	bool occlusionCulling = isOcclusionCullingActive();
+
+	// Depth and normals in one pass, into the depth buffer the main view is drawn against. Blended items
+	// stay out of it, the main view draws them over whatever they let through
+	glEnable(GL_DEPTH_TEST);
+
+	prepassFBO->bind();
+
+	glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.w);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		renderModel(model, shaderMap["normal"].get(), model->getMainCamera());
+	if (occlusionCulling) {
+		// The occluders of last frame go first, whatever they hide is skipped by every later pass
+		SceneBVH& bvh = model->getBVH();
+		occlusionCuller->beginFrame(bvh);
+		submit(VIEW_DEPTH, SUBMIT_LAST_VISIBLE, nullptr, SUBMIT_OPAQUE);
+		resolveDepthPrepass(false);
 
-		normalFBO->unbind();
+		occlusionCuller->buildPyramid(cameraFBO->depthTex.get());
+		auto [begin, end] = renderQueue.getItems(VIEW_MAIN);
+		occlusionCuller->cull(begin, end, bvh, camera);
 
-		quadSsao->passUniforms(model->getMainCamera(), depthFBO.get(), normalFBO.get());
+		prepassFBO->bind();
+		submit(VIEW_DEPTH, SUBMIT_NEWLY_VISIBLE, nullptr, SUBMIT_OPAQUE);
 	}
+	else
+		submit(VIEW_DEPTH, SUBMIT_ALL, nullptr, SUBMIT_OPAQUE);
 
+	prepassFBO->unbind();
+
+	if (!isSsaoEnabled)
+		return;
+
+	resolveDepthPrepass(true);
+	quadSsao->passUniforms(model->getMainCamera(), cameraFBO.get(), cameraFBO.get());
+}
+
+void Renderer::resolveDepthPrepass(bool color) {
+	// Depth samples are not averaged, each pixel keeps one of them
+	GLbitfield mask = color ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT : GL_DEPTH_BUFFER_BIT;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prepassFBO->ID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cameraFBO->ID);
+	glBlitFramebuffer(0, 0, prepassFBO->width, prepassFBO->height, 0, 0, cameraFBO->width, cameraFBO->height, mask, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::renderShadowMap(Model* model) {
 	if (!model->lightFlags[ProjectionMatrices])
 		return;
 
 	for (auto& light : model->lodLight) {
-		if (light->getType() != DIRECTIONAL)
-			continue;
-
-		if (!light->enabled)
+		if (!light->shadowMap || !light->enabled)
 			continue;
 
 		glEnable(GL_DEPTH_TEST);
@@ -482,8 +458,7 @@ void Renderer::renderShadowMap(Model* model) {
 		light->shadowMap->bind();
 
 		glClear(GL_DEPTH_BUFFER_BIT);
-		if (light->castShadows)
-			renderModel(model, shaderMap["shadow"].get(), light->camera);
+		submit(VIEW_SHADOW + light->shadowIndex); // Only in the queue if the light casts shadows
 
 		light->shadowMap->unbind();
 	}
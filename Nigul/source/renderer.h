@@ -3,13 +3,34 @@
 #include "model.h"
 #include "skybox.h"
 #include "quad.h"
+#include "renderQueue.h"
+#include "occlusionCuller.h"
+#include "gpuScene.h"
+#include "texturePool.h"
+#include "lightBuffer.h"
+#include "lightClusters.h"
+#include "deferredShading.h"
 
-// Estructura o clase renderCall no definida en el enunciado, se asume una estructura bsica
-struct renderCall {
-    Mesh* mesh;
-    Shader* shader;
-    Camera* camera;
-    glm::mat4 matrix;
+// Views of the render queue, one per pass over the scene. Shadow maps take one view each, see MAX_SHADOW_MAPS
+enum RenderView {
+    VIEW_DEPTH, // Depth and, for SSAO, normals of the main camera in one pass
+    VIEW_SHADOW,
+    VIEW_MAIN = VIEW_SHADOW + MAX_SHADOW_MAPS
+};
+
+// Items of a view submit draws, the last three only while the OcclusionCuller runs
+enum SubmitMode {
+    SUBMIT_ALL,
+    SUBMIT_LAST_VISIBLE, // Opaque items visible last frame, the occluders the depth pyramid is built from
+    SUBMIT_NEWLY_VISIBLE, // Everything else, through the indirect commands of the occlusion test
+    SUBMIT_VISIBLE // Every item through the indirect commands
+};
+
+// Items of a view submit draws by blending, the deferred path draws blended ones forward after lighting
+enum SubmitBlend {
+    SUBMIT_ANY_BLEND,
+    SUBMIT_OPAQUE,
+    SUBMIT_BLENDED
 };
 
 class Renderer {
@@ -19,38 +40,55 @@ public:
 
     glm::vec4 clearColor = glm::vec4(0.36f, 0.256f, 0.274f, 1.0f);
 
+    // Depth prepass, drawn on the depth buffer of the MSAA effect with its normals beside it
+    std::unique_ptr<FBO> prepassFBO;
+    std::unique_ptr<FBO> cameraFBO; // Normals and depth of the prepass resolved for SSAO and the occlusion test
+    bool isDepthPrepassEnabled = true; // The forward main view then only shades the opaque surfaces left in it
+
     // Ssao
-    std::unique_ptr<FBO> normalFBO;
-    std::unique_ptr<FBO> depthFBO;
     std::unique_ptr<FXSsao> quadSsao;
     bool isSsaoEnabled = true;
 
+    // Hi-Z occlusion culling of the main camera, built from the depth prepass
+    std::unique_ptr<OcclusionCuller> occlusionCuller;
+    inline bool isOcclusionCullingActive() const { return occlusionCuller->enabled && renderQueue.hasView(VIEW_DEPTH); }
+
+    // Multi-draws from the merged geometry of the model, used by every view when the model has it
+    std::unique_ptr<GpuScene> gpuScene;
+
+    // Every light of the model in one storage buffer, see setAllUniforms
+    std::unique_ptr<LightBuffer> lightBuffer;
+    // Per cluster light lists of the main camera, built every frame after the lights are uploaded
+    std::unique_ptr<LightClusters> lightClusters;
+    // Replaces the forward MSAA pass of the main view when enabled
+    std::unique_ptr<DeferredShading> deferredShading;
+
+    // Filled once per frame with every pass, see buildRenderQueue
+    RenderQueue renderQueue;
+
     Renderer(int width, int height);
 
     void render(Model* model, Skybox* skybox);
     void render(FXQuad* fxQuad);
-    void render(renderCall);
 
-    void renderModel(Model* model, Shader* shader, Camera* camera);
+    // Adds the views this frame draws, walks the model once and sorts the queue
+    void buildRenderQueue(Model* model, Camera* camera);
+    // Draws the items of a view in key order, with shader instead of the one of the view when given
+    void submit(int view, SubmitMode mode = SUBMIT_ALL, Shader* shader = nullptr, SubmitBlend blendFilter = SUBMIT_ANY_BLEND);
+    bool isSubmitted(const RenderItem& item, SubmitMode mode, SubmitBlend blend = SUBMIT_ANY_BLEND) const;
+    // Depth and normals of the opaque items of the main camera, for the main view, SSAO and the occlusion test
+    void renderDepthPrepass(Model* model, Camera* camera);
+    // Copies the depth of the prepass, and its normals with color, from its samples into cameraFBO
+    void resolveDepthPrepass(bool color);
+    // Tells the TextureStreamer how large every material of the main view is on screen
+    void markTextureUse(Camera* camera);
     void renderSkybox(Skybox* skybox, Shader* shader, Camera* camera);
-
-    std::vector<renderCall> getRenderCalls(Node* node, Shader* shader, Camera* camera);
+    // G-buffer of the opaque items, lighting, then blended items and the skybox forward, into the first post effect
+    void renderDeferred(Model* model, Skybox* skybox, Camera* camera);
 
     void setAllUniforms(Model* model, Skybox* skybox, Shader* shader);
-    void setLightPositionsUniform(Shader* shader, Model* model);
-    void setLightColorsUniform(Shader* shader, Model* model);
-    void setLightTypesUniform(Shader* shader, Model* model);
-    void setLightIntensitiesUniform(Shader* shader, Model* model);
-    void setLightRangesUniform(Shader* shader, Model* model);
-    void setLightShadowBiasesUniform(Shader* shader, Model* model);
-    void setLightAttenuationsUniform(Shader* shader, Model* model);
-    void setLightProjectionMatricesUniform(Shader* shader, Model* model);
-    void setLightDirectionsUniform(Shader* shader, Model* model);
-    void setLightInnerConeAnglesUniform(Shader* shader, Model* model);
-    void setLightOuterConeAnglesUniform(Shader* shader, Model* model);
-    void setLightCastShadowsUniform(Shader* shader, Model* model);
-    void setLightShadowMapSamplesUniform(Shader* shader, Model* model);
-    void setLightEnablingUniform(Shader* shader, Model* model);
+    // Ambient, shadow and skybox uniforms without the change flags, for shaders other than the default one
+    void setSceneUniforms(Model* model, Skybox* skybox, Shader* shader);
     void setAmbientLightUniform(Shader* shader, Model* model);
     void setAmbientColorUniform(Shader* shader, Model* model);
     void setShadowDarknessUniform(Shader* shader, Model* model);
@@ -60,4 +98,7 @@ public:
     void setNormalCameraUniform(Shader* shader, Model* model);
 
     void renderShadowMap(Model* model);
+
+private:
+    std::vector<const RenderItem*> submitted; // Items of the GpuScene submit
 };
\ No newline at end of file
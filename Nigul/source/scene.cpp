@@ -20,7 +20,7 @@ void SceneManager::loadScene() {
         for (const auto& entry : std::filesystem::directory_iterator(modelPath)) {
             if (entry.is_directory()) {
                 for (const auto& file : std::filesystem::directory_iterator(entry.path())) {
-                    if (file.path().extension() == ".gltf") {
+                    if (file.path().extension() == ".gltf" || file.path().extension() == ".glb") {
                         auto fullPathFile = modelPath / entry.path().filename() / file.path().filename();
                         std::unique_ptr<Model> model = std::make_unique<Model>();
                         model->file = fullPathFile.string();
@@ -44,12 +44,51 @@ void SceneManager::loadSkybox(std::string name)
 
 void SceneManager::loadModel(std::string path)
 {
-    if (path != "None") {
-        if (!models[path]->loaded)
-            models[path]->load();
-	}
+    if (path == pendingModel)
+        return;
+    cancelLoad();
+
+    if (path == "None" || models[path]->loaded) {
+        mainModel = path;
+        return;
+    }
+
+    // A model still ending a cancelled load is started again by update
+    pendingModel = path;
+    if (!models[path]->isLoading())
+        models[path]->loadAsync();
+}
+
+void SceneManager::cancelLoad()
+{
+    if (Model* model = getPendingModel())
+        model->cancelLoad();
+    pendingModel.clear();
+}
 
-	mainModel = path;
+void SceneManager::update()
+{
+    for (auto& [name, model] : models) {
+        if (model && model->isLoading())
+            model->updateLoad(loadBudgetMs);
+    }
+
+    Model* model = getPendingModel();
+    if (!model || model->isLoading())
+        return;
+
+    if (model->loaded) {
+        // Swapped between two frames, the renderer never sees a half loaded model
+        mainModel = pendingModel;
+        model->hasSkyboxChanged = true;
+        pendingModel.clear();
+    }
+    else if (model->loadStage == LOAD_FAILED) {
+        pendingModel.clear();
+    }
+    else {
+        model->loadAsync();
+    }
 }
 
 std::vector<std::string> SceneManager::getAllSkyboxes()
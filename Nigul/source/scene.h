@@ -12,6 +12,10 @@ public:
 
     std::map<std::string, std::unique_ptr<Model>> models;
     std::string mainModel = "None";
+    std::string pendingModel; // Loading in the background, becomes the main model once it is on the GPU
+
+    // Milliseconds of GL upload work the loading models may take every frame
+    double loadBudgetMs = 4.0;
 
     SceneManager() = default;
     void loadScene();
@@ -20,13 +24,18 @@ public:
     void loadSkybox(std::string name);
     std::vector<std::string> getAllSkyboxes();
 
-    // Dynamic model methods
+    // Dynamic model methods, the current model keeps rendering while the new one loads
     void loadModel(std::string path);
+    void cancelLoad();
     std::vector<std::string> getAllModels();
 
+    // Runs the GL work of the loading models and swaps in the pending one once it is done, once per frame
+    void update();
+
     // Getters 
     inline Model* getMainModel() { return models[mainModel].get(); }
     inline Skybox* getMainSkybox() { return skyboxes[mainSkybox].get(); }
+    inline Model* getPendingModel() { return pendingModel.empty() ? nullptr : models[pendingModel].get(); }
 
 };
 
@@ -0,0 +1,346 @@
+#include "sceneBVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+
+#include "model.h"
+
+// Shared by every hierarchy so a version never repeats, even for a new model at the address of an old one
+static uint32_t lastVersion = 0;
+
+static AABB emptyBounds()
+{
+	return { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+}
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Pre-order, so the items of a subtree follow each other
+static void collectItems(Node* node, std::vector<SceneBVH::Item>& items, std::unordered_map<const Node*, std::pair<uint32_t, uint32_t>>& subtreeItems)
+{
+	uint32_t begin = static_cast<uint32_t>(items.size());
+	if (node->mesh) {
+		for (Primitive& primitive : node->mesh->primitives)
+			items.push_back({ node, &primitive, primitive.getBounds().transform(node->globalMatrix) });
+	}
+	for (auto& child : node->children)
+		collectItems(child.get(), items, subtreeItems);
+	subtreeItems[node] = { begin, static_cast<uint32_t>(items.size()) };
+}
+
+void SceneBVH::invalidate()
+{
+	valid = false;
+	items.clear();
+	order.clear();
+	itemLeaves.clear();
+	nodes.clear();
+	subtreeItems.clear();
+}
+
+void SceneBVH::build(Node* root)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	invalidate();
+	if (!root)
+		return;
+
+	collectItems(root, items, subtreeItems);
+	valid = true;
+	generation++;
+	version = ++lastVersion;
+	uint32_t numItems = static_cast<uint32_t>(items.size());
+	if (numItems == 0)
+		return;
+
+	std::vector<glm::vec3> centroids(numItems);
+	order.resize(numItems);
+	for (uint32_t i = 0; i < numItems; i++) {
+		centroids[i] = items[i].bounds.getCenter();
+		order[i] = i;
+	}
+
+	// A binary tree with leaves of at least one item never has more nodes than this
+	nodes.reserve(2 * numItems - 1);
+	AABB rootBounds = emptyBounds();
+	for (const Item& item : items)
+		rootBounds.expand(item.bounds);
+	nodes.push_back({ rootBounds, 0, numItems, 0, -1 });
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+		split(nodeIndex, centroids);
+		if (nodes[nodeIndex].left != 0) {
+			stack.push_back(nodes[nodeIndex].left);
+			stack.push_back(nodes[nodeIndex].left + 1);
+		}
+	}
+
+	itemLeaves.resize(numItems);
+	for (uint32_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++) {
+		const BVHNode& node = nodes[nodeIndex];
+		if (node.left != 0)
+			continue;
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+			itemLeaves[order[i]] = nodeIndex;
+	}
+
+	buildTime = millisecondsSince(start);
+}
+
+void SceneBVH::split(uint32_t nodeIndex, std::vector<glm::vec3>& centroids)
+{
+	uint32_t first = nodes[nodeIndex].first;
+	uint32_t count = nodes[nodeIndex].count;
+	if (count <= MAX_LEAF_SIZE)
+		return;
+
+	AABB centroidBounds = emptyBounds();
+	for (uint32_t i = first; i < first + count; i++)
+		centroidBounds.expand({ centroids[order[i]], centroids[order[i]] });
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	uint32_t middle = first + count / 2;
+	if (extent[axis] > 0.0f) {
+		struct Bin {
+			AABB bounds = emptyBounds();
+			uint32_t count = 0;
+		};
+		Bin bins[NUM_BINS];
+		float scale = NUM_BINS / extent[axis];
+		auto getBin = [&](uint32_t item) {
+			return std::min(static_cast<int>((centroids[item][axis] - centroidBounds.min[axis]) * scale), NUM_BINS - 1);
+		};
+		for (uint32_t i = first; i < first + count; i++) {
+			Bin& bin = bins[getBin(order[i])];
+			bin.bounds.expand(items[order[i]].bounds);
+			bin.count++;
+		}
+
+		// Cost of splitting after each bin, swept from both sides
+		float rightCosts[NUM_BINS] = {};
+		AABB rightBounds = emptyBounds();
+		uint32_t rightCount = 0;
+		for (int i = NUM_BINS - 1; i > 0; i--) {
+			rightBounds.expand(bins[i].bounds);
+			rightCount += bins[i].count;
+			rightCosts[i - 1] = rightCount ? rightCount * rightBounds.getSurfaceArea() : 0.0f;
+		}
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+		AABB leftBounds = emptyBounds();
+		uint32_t leftCount = 0;
+		for (int i = 0; i < NUM_BINS - 1; i++) {
+			leftBounds.expand(bins[i].bounds);
+			leftCount += bins[i].count;
+			if (leftCount == 0 || leftCount == count)
+				continue;
+			float cost = leftCount * leftBounds.getSurfaceArea() + rightCosts[i];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		if (bestSplit >= 0) {
+			auto begin = order.begin() + first;
+			auto end = begin + count;
+			middle = static_cast<uint32_t>(std::partition(begin, end, [&](uint32_t item) { return getBin(item) <= bestSplit; }) - order.begin());
+		}
+	}
+
+	uint32_t left = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({ AABB(), first, middle - first, 0, static_cast<int32_t>(nodeIndex) });
+	nodes.push_back({ AABB(), middle, first + count - middle, 0, static_cast<int32_t>(nodeIndex) });
+	refitNode(left);
+	refitNode(left + 1);
+	nodes[nodeIndex].left = left;
+}
+
+void SceneBVH::refitNode(uint32_t nodeIndex)
+{
+	BVHNode& node = nodes[nodeIndex];
+	if (node.left != 0) {
+		node.bounds = nodes[node.left].bounds;
+		node.bounds.expand(nodes[node.left + 1].bounds);
+		return;
+	}
+	node.bounds = emptyBounds();
+	for (uint32_t i = node.first; i < node.first + node.count; i++)
+		node.bounds.expand(items[order[i]].bounds);
+}
+
+void SceneBVH::refit(const Node* subtree)
+{
+	if (!valid || nodes.empty())
+		return;
+	auto it = subtreeItems.find(subtree);
+	if (it == subtreeItems.end() || it->second.first == it->second.second)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	version = ++lastVersion;
+	auto [begin, end] = it->second;
+	for (uint32_t i = begin; i < end; i++)
+		items[i].bounds = items[i].primitive->getBounds().transform(items[i].node->globalMatrix);
+
+	// Children always come after their parent, a reverse sweep refits everything bottom-up
+	if ((end - begin) * 4 > items.size()) {
+		for (uint32_t nodeIndex = static_cast<uint32_t>(nodes.size()); nodeIndex-- > 0;)
+			refitNode(nodeIndex);
+	}
+	else {
+		for (uint32_t i = begin; i < end; i++) {
+			int32_t nodeIndex = static_cast<int32_t>(itemLeaves[i]);
+			while (nodeIndex >= 0) {
+				refitNode(nodeIndex);
+				nodeIndex = nodes[nodeIndex].parent;
+			}
+		}
+	}
+
+	refitTime = millisecondsSince(start);
+}
+
+bool SceneBVH::intersectTriangles(const Item& item, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const
+{
+	// In object space, t along the transformed direction is still the world distance
+	glm::mat4 inverse = glm::inverse(item.node->globalMatrix);
+	glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+	glm::vec3 localDirection = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+
+	const std::vector<Vertex>& vertices = item.primitive->vertices;
+	const std::vector<GLuint>& indices = item.primitive->indices;
+	size_t numIndices = indices.empty() ? vertices.size() : indices.size();
+	bool found = false;
+	distance = maxDistance;
+	for (size_t i = 0; i + 2 < numIndices; i += 3) {
+		const glm::vec3& a = vertices[indices.empty() ? i : indices[i]].position;
+		const glm::vec3& b = vertices[indices.empty() ? i + 1 : indices[i + 1]].position;
+		const glm::vec3& c = vertices[indices.empty() ? i + 2 : indices[i + 2]].position;
+
+		// Moller-Trumbore, both faces count
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(localDirection, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::abs(determinant) < 1e-12f)
+			continue;
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 s = localOrigin - a;
+		float u = glm::dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(localDirection, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+		float t = glm::dot(edge2, q) * inverseDeterminant;
+		if (t >= 0.0f && t < distance) {
+			distance = t;
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool SceneBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	hit = RayHit();
+	if (nodes.empty()) {
+		rayTime = millisecondsSince(start);
+		return false;
+	}
+
+	glm::vec3 unitDirection = glm::normalize(direction);
+	glm::vec3 inverseDirection = 1.0f / unitDirection;
+	float closest = FLT_MAX;
+	float entry, exit;
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const BVHNode& node = nodes[stack.back()];
+		stack.pop_back();
+		// Tested again when popped, a closer hit may have been found since it was pushed
+		if (!node.bounds.intersectRay(origin, inverseDirection, closest, entry, exit))
+			continue;
+
+		if (node.left == 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				const Item& item = items[order[i]];
+				if (!item.bounds.intersectRay(origin, inverseDirection, closest, entry, exit))
+					continue;
+				float distance;
+				if (!item.primitive->vertices.empty()) {
+					if (!intersectTriangles(item, origin, unitDirection, closest, distance))
+						continue;
+				}
+				else
+					distance = entry > 0.0f ? entry : exit;
+				if (distance < closest) {
+					closest = distance;
+					hit = { item.node, item.primitive, distance };
+				}
+			}
+			continue;
+		}
+
+		// The nearer child goes on top of the stack
+		float leftEntry, rightEntry;
+		bool hitsLeft = nodes[node.left].bounds.intersectRay(origin, inverseDirection, closest, leftEntry, exit);
+		bool hitsRight = nodes[node.left + 1].bounds.intersectRay(origin, inverseDirection, closest, rightEntry, exit);
+		if (hitsLeft && hitsRight) {
+			bool leftFirst = leftEntry <= rightEntry;
+			stack.push_back(leftFirst ? node.left + 1 : node.left);
+			stack.push_back(leftFirst ? node.left : node.left + 1);
+		}
+		else if (hitsLeft)
+			stack.push_back(node.left);
+		else if (hitsRight)
+			stack.push_back(node.left + 1);
+	}
+
+	rayTime = millisecondsSince(start);
+	return hit.node != nullptr;
+}
+
+void SceneBVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	if (nodes.empty())
+		return;
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const BVHNode& node = nodes[stack.back()];
+		stack.pop_back();
+
+		FrustumTest test = frustum.classify(node.bounds);
+		if (test == FRUSTUM_OUTSIDE)
+			continue;
+		// Everything below is visible, no need to look at it
+		if (test == FRUSTUM_INSIDE) {
+			visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+			continue;
+		}
+		if (node.left == 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (frustum.intersects(items[order[i]].bounds))
+					visible.push_back(order[i]);
+			}
+			continue;
+		}
+		stack.push_back(node.left + 1);
+		stack.push_back(node.left);
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "bounds.h"
+
+class Node;
+struct Primitive;
+
+/**
+ * @class SceneBVH
+ * @brief Bounding volume hierarchy over the world bounds of every primitive of a node tree.
+ *
+ * Built once per change of the tree structure with a binned surface area heuristic, then refitted
+ * when nodes only move: primitives are stored in pre-order, so the primitives under a node are a
+ * contiguous range and refitting a subtree only walks up from its own leaves. Each BVH node also
+ * covers a contiguous range of the leaf order, which lets frustum queries accept a whole subtree
+ * at once.
+ */
+class SceneBVH
+{
+public:
+    static const int MAX_LEAF_SIZE = 4;
+    static const int NUM_BINS = 12;
+
+    // A primitive drawn by a node, its bounds already in world space
+    struct Item {
+        Node* node;
+        Primitive* primitive;
+        AABB bounds;
+    };
+
+    struct RayHit {
+        Node* node = nullptr;
+        Primitive* primitive = nullptr;
+        float distance = 0.0f;
+    };
+
+    // Milliseconds spent by the last build, refit and ray query
+    double buildTime = 0.0;
+    double refitTime = 0.0;
+    double rayTime = 0.0;
+
+    inline bool isValid() const { return valid; }
+    inline const std::vector<Item>& getItems() const { return items; }
+    inline size_t getNumNodes() const { return nodes.size(); }
+    inline uint32_t getGeneration() const { return generation; } // Changes with every build, item indices are only valid within one
+    inline uint32_t getVersion() const { return version; } // Changes with every build and refit, never shared by two hierarchies
+
+    /**
+     * @brief Forgets every node, the next build starts over. Needed whenever nodes are added, removed or reparented.
+     */
+    void invalidate();
+
+    /**
+     * @brief Builds the hierarchy over every primitive under root from the current global matrices.
+     */
+    void build(Node* root);
+
+    /**
+     * @brief Updates the bounds of the primitives under subtree after its global matrices changed.
+     *
+     * Does nothing while the hierarchy is invalid or if the subtree draws nothing.
+     */
+    void refit(const Node* subtree);
+
+    /**
+     * @brief Closest primitive hit by a ray.
+     *
+     * Primitives that still have their CPU vertices are tested triangle by triangle, the others
+     * only by their bounds, where a ray starting inside the box counts as hitting where it leaves.
+     */
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit);
+
+    /**
+     * @brief Appends the index in getItems() of every primitive whose bounds intersect the frustum.
+     */
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+private:
+    struct BVHNode {
+        AABB bounds;
+        uint32_t first; // Range of order covered by the node, children included
+        uint32_t count;
+        uint32_t left; // Children are left and left + 1, 0 for a leaf since the root is never a child
+        int32_t parent;
+    };
+
+    void split(uint32_t nodeIndex, std::vector<glm::vec3>& centroids);
+    void refitNode(uint32_t nodeIndex);
+    bool intersectTriangles(const Item& item, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+    bool valid = false;
+    uint32_t generation = 0;
+    uint32_t version = 0;
+    std::vector<Item> items; // Pre-order of the node tree
+    std::vector<uint32_t> order; // Items sorted by BVH leaf
+    std::vector<uint32_t> itemLeaves; // BVH leaf of each item
+    std::vector<BVHNode> nodes;
+    std::unordered_map<const Node*, std::pair<uint32_t, uint32_t>> subtreeItems; // [begin, end) in items
+
+    mutable std::vector<uint32_t> stack;
+};
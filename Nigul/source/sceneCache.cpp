@@ -0,0 +1,740 @@
+#include "sceneCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "model.h"
+#include "mappedFile.h"
+
+// Every record is written as raw bytes, the cache is only read back by the same build that wrote it
+// and VERSION has to be bumped whenever one of these layouts changes.
+struct FileStamp {
+	int64_t time = 0;
+	uint64_t size = 0;
+	uint64_t hash = 0; // Of the content, only read when the mtime moved but the size did not
+};
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t settingsHash; // Loader settings the cached geometry depends on, see getSettingsHash
+	FileStamp source;
+};
+
+struct SceneRecord {
+	glm::vec3 ambientColor;
+	float ambientLight;
+	float shadowDarkness;
+	float reflectionFactor;
+	int32_t numNodes;
+	int32_t nodeWithCamera;
+	int32_t mainCameraId;
+};
+
+enum TextureSourceKind : uint8_t {
+	TEXTURE_NONE,
+	TEXTURE_URI,
+	TEXTURE_EMBEDDED
+};
+
+struct MaterialRecord {
+	int32_t alphaMode;
+	float alphaCutoff;
+	int32_t doubleSided;
+	glm::vec4 baseColorFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	glm::vec3 emissiveFactor;
+	int32_t baseColorTexture;
+	int32_t metallicRoughness;
+	int32_t normalMap;
+	int32_t occlusionTexture;
+	int32_t emissiveTexture;
+};
+
+struct PrimitiveRecord {
+	int32_t material;
+	uint64_t numVertices;
+	uint64_t numIndices;
+	AABB bounds;
+};
+
+struct LightRecord {
+	int32_t type;
+	int32_t enabled;
+	glm::vec3 color;
+	float intensity;
+	float range;
+	int32_t castShadows;
+	float shadowBias;
+	int32_t index;
+	int32_t camera;
+	float innerConeAngle;
+	float outerConeAngle;
+	float distance;
+	float attenuation;
+};
+
+struct CameraRecord {
+	int32_t type;
+	int32_t enabled;
+	int32_t index;
+	float nearPlane;
+	float farPlane;
+	float fov;
+	float aspectRatio;
+	glm::vec2 size;
+};
+
+struct NodeRecord {
+	int32_t id;
+	int32_t parent; // Index in the node list, -1 for children of the root
+	int32_t mesh;
+	int32_t light;
+	int32_t camera;
+	glm::mat4 matrix;
+};
+
+static const char CACHE_MAGIC[4] = { 'N', 'G', 'S', 'C' };
+static const size_t BLOB_ALIGNMENT = 16;
+
+class CacheWriter {
+public:
+	std::vector<unsigned char> bytes;
+
+	template <typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain records can be written");
+		const unsigned char* data = reinterpret_cast<const unsigned char*>(&value);
+		bytes.insert(bytes.end(), data, data + sizeof(T));
+	}
+
+	void writeString(const std::string& value)
+	{
+		write<uint32_t>(static_cast<uint32_t>(value.size()));
+		bytes.insert(bytes.end(), value.begin(), value.end());
+	}
+
+	// Blobs are aligned so they can be used in place from the mapping
+	void writeBlob(const void* data, size_t size)
+	{
+		write<uint64_t>(size);
+		bytes.resize((bytes.size() + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT, 0);
+		const unsigned char* begin = static_cast<const unsigned char*>(data);
+		bytes.insert(bytes.end(), begin, begin + size);
+	}
+};
+
+class CacheReader {
+public:
+	CacheReader(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+	template <typename T>
+	bool read(T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain records can be read");
+		if (size - offset < sizeof(T))
+			return false;
+		std::memcpy(&value, data + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	bool readString(std::string& value)
+	{
+		uint32_t length;
+		if (!read(length) || size - offset < length)
+			return false;
+		value.assign(reinterpret_cast<const char*>(data + offset), length);
+		offset += length;
+		return true;
+	}
+
+	bool readBlob(const unsigned char*& blob, uint64_t& blobSize)
+	{
+		if (!read(blobSize))
+			return false;
+		size_t aligned = (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+		if (aligned > size || size - aligned < blobSize)
+			return false;
+		blob = data + aligned;
+		offset = aligned + static_cast<size_t>(blobSize);
+		return true;
+	}
+
+private:
+	const unsigned char* data;
+	size_t size;
+	size_t offset = 0;
+};
+
+static bool getFileStamp(const std::string& path, FileStamp& stamp)
+{
+	std::error_code error;
+	uintmax_t size = std::filesystem::file_size(path, error);
+	if (error)
+		return false;
+	auto time = std::filesystem::last_write_time(path, error);
+	if (error)
+		return false;
+
+	stamp.size = static_cast<uint64_t>(size);
+	stamp.time = static_cast<int64_t>(time.time_since_epoch().count());
+	return true;
+}
+
+// FNV-1a over the whole file, eight bytes at a time
+static uint64_t hashFile(const std::string& path)
+{
+	MappedFile file(path);
+	uint64_t hash = 14695981039346656037ull;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= file.size(); i += sizeof(uint64_t)) {
+		uint64_t word;
+		std::memcpy(&word, file.data() + i, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	for (; i < file.size(); i++) {
+		hash ^= file.data()[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// A file is unchanged if its size and mtime match. When only the mtime moved (a checkout, a copy) the content
+// decides, so a warm load reads the stamps of its files and none of their data.
+static bool isUnchanged(const std::string& path, const FileStamp& cached)
+{
+	FileStamp stamp;
+	if (!getFileStamp(path, stamp) || stamp.size != cached.size)
+		return false;
+	return stamp.time == cached.time || hashFile(path) == cached.hash;
+}
+
+// VERSION and every loader setting that changes the cached geometry
+static uint64_t getSettingsHash(const Model& model)
+{
+	const uint64_t settings[] = { SceneCache::VERSION, model.optimizeMeshes, model.compactVertices };
+	uint64_t hash = 14695981039346656037ull;
+	for (uint64_t setting : settings) {
+		hash ^= setting;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+template <typename Pointer, typename P>
+static int32_t indexOf(const std::vector<Pointer>& objects, const P* object)
+{
+	if (!object)
+		return -1;
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (objects[i].get() == object)
+			return static_cast<int32_t>(i);
+	}
+	return -1;
+}
+
+// Pre-order, so every parent is written before its children
+static void collectNodes(Node* node, std::vector<Node*>& nodes)
+{
+	for (auto& child : node->children) {
+		nodes.push_back(child.get());
+		collectNodes(child.get(), nodes);
+	}
+}
+
+std::string SceneCache::getPath(const std::string& modelFile)
+{
+	return modelFile + ".cache";
+}
+
+bool SceneCache::save(Model& model)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::filesystem::path directory = std::filesystem::path(model.file).parent_path();
+
+	CacheWriter writer;
+
+	// Records are value-initialized so their padding is written as zeros, never as stack memory
+	CacheHeader header{};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = VERSION;
+	header.settingsHash = getSettingsHash(model);
+	if (!getFileStamp(model.file, header.source))
+		return false;
+	header.source.hash = hashFile(model.file);
+	writer.write(header);
+
+	// Buffer files, a change in any of them invalidates the cache too
+	std::vector<std::string> dependencies = model.getBufferFiles();
+	writer.write<uint32_t>(static_cast<uint32_t>(dependencies.size()));
+	for (const std::string& dependency : dependencies) {
+		FileStamp stamp;
+		if (!getFileStamp(dependency, stamp))
+			return false;
+		stamp.hash = hashFile(dependency);
+		writer.writeString(std::filesystem::path(dependency).lexically_relative(directory).generic_string());
+		writer.write(stamp);
+	}
+
+	SceneRecord scene{};
+	scene.ambientColor = model.ambientColor;
+	scene.ambientLight = model.ambientLight;
+	scene.shadowDarkness = model.shadowDarkness;
+	scene.reflectionFactor = model.reflectionFactor;
+	scene.numNodes = model.numNodes;
+	scene.nodeWithCamera = model.nodeWithCamera;
+	scene.mainCameraId = model.mainCameraId;
+	writer.write(scene);
+
+	// Textures, files are referenced and embedded images are copied
+	writer.write<uint32_t>(static_cast<uint32_t>(model.textureSources.size()));
+	for (const TextureSource& source : model.textureSources) {
+		writer.write<int32_t>(source.roles);
+		if (source.encoded) {
+			writer.write<uint8_t>(TEXTURE_EMBEDDED);
+			writer.writeBlob(source.encoded, source.encodedSize);
+		}
+		else if (!source.uri.empty()) {
+			writer.write<uint8_t>(TEXTURE_URI);
+			writer.writeString(source.uri);
+		}
+		else {
+			writer.write<uint8_t>(TEXTURE_NONE);
+		}
+	}
+
+	writer.write<uint32_t>(static_cast<uint32_t>(model.lodMat.size()));
+	for (const auto& material : model.lodMat) {
+		MaterialRecord record{};
+		record.alphaMode = material->alphaMode;
+		record.alphaCutoff = material->alphaCutoff;
+		record.doubleSided = material->doubleSided;
+		record.baseColorFactor = material->pbrMetallicRoughness.baseColorFactor;
+		record.metallicFactor = material->pbrMetallicRoughness.metallicFactor;
+		record.roughnessFactor = material->pbrMetallicRoughness.roughnessFactor;
+		record.emissiveFactor = material->emissiveFactor;
+		record.baseColorTexture = indexOf(model.lodTex, material->pbrMetallicRoughness.baseColorTexture);
+		record.metallicRoughness = indexOf(model.lodTex, material->pbrMetallicRoughness.metallicRoughness);
+		record.normalMap = indexOf(model.lodTex, material->normalMap);
+		record.occlusionTexture = indexOf(model.lodTex, material->occlusionTexture);
+		record.emissiveTexture = indexOf(model.lodTex, material->emissiveTexture);
+		writer.writeString(material->name);
+		writer.write(record);
+	}
+
+	writer.write<uint32_t>(static_cast<uint32_t>(model.lodMesh.size()));
+	for (const auto& mesh : model.lodMesh) {
+		writer.write<uint32_t>(static_cast<uint32_t>(mesh->primitives.size()));
+		for (const Primitive& primitive : mesh->primitives) {
+			PrimitiveRecord record{};
+			record.material = indexOf(model.lodMat, primitive.material);
+			record.numVertices = primitive.vertices.size();
+			record.numIndices = primitive.indices.size();
+			record.bounds = primitive.getBounds();
+			writer.write(record);
+			writer.writeBlob(primitive.vertices.data(), primitive.vertices.size() * sizeof(Vertex));
+			writer.writeBlob(primitive.indices.data(), primitive.indices.size() * sizeof(GLuint));
+		}
+	}
+
+	writer.write<uint32_t>(static_cast<uint32_t>(model.lodLight.size()));
+	for (const auto& light : model.lodLight) {
+		LightRecord record{};
+		record.type = light->getType();
+		record.enabled = light->enabled;
+		record.color = light->color;
+		record.intensity = light->intensity;
+		record.range = light->range;
+		record.castShadows = light->castShadows;
+		record.shadowBias = light->shadowBias;
+		record.index = light->index;
+		record.camera = indexOf(model.lodCamera, light->camera);
+		if (light->getType() == SPOTLIGHT) {
+			auto spotLight = static_cast<SpotLight*>(light.get());
+			record.innerConeAngle = spotLight->innerConeAngle;
+			record.outerConeAngle = spotLight->outerConeAngle;
+		}
+		else if (light->getType() == DIRECTIONAL) {
+			record.distance = static_cast<DirectionalLight*>(light.get())->distance;
+		}
+		else if (light->getType() == POINTLIGHT) {
+			record.attenuation = static_cast<PointLight*>(light.get())->attenuation;
+		}
+		writer.write(record);
+	}
+
+	writer.write<uint32_t>(static_cast<uint32_t>(model.lodCamera.size()));
+	for (const auto& camera : model.lodCamera) {
+		CameraRecord record{};
+		record.type = camera->getType();
+		record.enabled = camera->enabled;
+		record.index = camera->index;
+		record.nearPlane = camera->nearPlane;
+		record.farPlane = camera->farPlane;
+		if (camera->getType() == PERSPECTIVE) {
+			auto perspectiveCamera = static_cast<PerspectiveCamera*>(camera.get());
+			record.fov = perspectiveCamera->fov;
+			record.aspectRatio = perspectiveCamera->aspectRatio;
+		}
+		else {
+			record.size = static_cast<OrthographicCamera*>(camera.get())->size;
+		}
+		writer.write(record);
+	}
+
+	std::vector<Node*> nodes;
+	collectNodes(model.getRootNode(), nodes);
+	writer.write<uint32_t>(static_cast<uint32_t>(nodes.size()));
+	for (Node* node : nodes) {
+		NodeRecord record{};
+		record.id = node->id;
+		record.parent = -1;
+		for (size_t i = 0; i < nodes.size(); i++) {
+			if (nodes[i] == node->parent) {
+				record.parent = static_cast<int32_t>(i);
+				break;
+			}
+		}
+		record.mesh = indexOf(model.lodMesh, node->mesh);
+		record.light = indexOf(model.lodLight, node->light);
+		record.camera = indexOf(model.lodCamera, node->camera);
+		record.matrix = node->matrix;
+		writer.writeString(node->name);
+		writer.write(record);
+	}
+
+	// Written next to the final file first so a crash never leaves a truncated cache behind
+	std::string path = getPath(model.file);
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		output.write(reinterpret_cast<const char*>(writer.bytes.data()), writer.bytes.size());
+		if (!output) {
+			std::cerr << "Failed to write the scene cache " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::cerr << "Failed to write the scene cache " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Baked scene cache " << path << " (" << writer.bytes.size() / 1024 << " KB) in " << totalTime << " ms" << std::endl;
+	return true;
+}
+
+struct CachedPrimitive {
+	PrimitiveRecord record;
+	const Vertex* vertices;
+	const GLuint* indices;
+};
+
+bool SceneCache::load(Model& model)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::string path = getPath(model.file);
+	std::filesystem::path directory = std::filesystem::path(model.file).parent_path();
+
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return false;
+
+	MappedFile cacheFile(path);
+	if (!cacheFile.isOpen())
+		return false;
+	CacheReader reader(cacheFile.data(), cacheFile.size());
+
+	auto reject = [&path](const char* reason) {
+		std::cout << "Ignoring scene cache " << path << ": " << reason << std::endl;
+		return false;
+	};
+
+	CacheHeader header;
+	if (!reader.read(header) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+		return reject("not a scene cache");
+	if (header.version != VERSION)
+		return reject("written by another version");
+
+	if (header.settingsHash != getSettingsHash(model))
+		return reject("baked with other loader settings");
+	if (!isUnchanged(model.file, header.source))
+		return reject("the model file changed");
+
+	uint32_t numDependencies;
+	if (!reader.read(numDependencies))
+		return reject("truncated");
+	for (uint32_t i = 0; i < numDependencies; i++) {
+		std::string dependency;
+		FileStamp cachedStamp;
+		if (!reader.readString(dependency) || !reader.read(cachedStamp))
+			return reject("truncated");
+		if (!isUnchanged((directory / dependency).string(), cachedStamp))
+			return reject("a buffer file changed");
+	}
+
+	// Everything is read and validated before touching the model or the GPU
+	SceneRecord scene;
+	if (!reader.read(scene))
+		return reject("truncated");
+
+	uint32_t numTextures;
+	if (!reader.read(numTextures))
+		return reject("truncated");
+	std::vector<TextureSource> textures(numTextures);
+	for (TextureSource& texture : textures) {
+		uint8_t kind;
+		if (!reader.read(texture.roles) || !reader.read(kind))
+			return reject("truncated");
+		if (kind == TEXTURE_EMBEDDED) {
+			uint64_t size;
+			if (!reader.readBlob(texture.encoded, size))
+				return reject("truncated");
+			texture.encodedSize = static_cast<size_t>(size);
+		}
+		else if (kind == TEXTURE_URI) {
+			if (!reader.readString(texture.uri))
+				return reject("truncated");
+		}
+	}
+
+	auto validTexture = [numTextures](int32_t index) { return index >= -1 && index < (int32_t)numTextures; };
+
+	uint32_t numMaterials;
+	if (!reader.read(numMaterials))
+		return reject("truncated");
+	std::vector<std::pair<std::string, MaterialRecord>> materials(numMaterials);
+	for (auto& material : materials) {
+		if (!reader.readString(material.first) || !reader.read(material.second))
+			return reject("truncated");
+		const MaterialRecord& record = material.second;
+		if (record.alphaMode != BLEND_MODE && record.alphaMode != OPAQUE_MODE)
+			return reject("corrupt material");
+		if (!validTexture(record.baseColorTexture) || !validTexture(record.metallicRoughness) || !validTexture(record.normalMap)
+			|| !validTexture(record.occlusionTexture) || !validTexture(record.emissiveTexture))
+			return reject("corrupt material");
+	}
+
+	uint32_t numMeshes;
+	if (!reader.read(numMeshes))
+		return reject("truncated");
+	std::vector<std::vector<CachedPrimitive>> meshes(numMeshes);
+	for (auto& mesh : meshes) {
+		uint32_t numPrimitives;
+		if (!reader.read(numPrimitives))
+			return reject("truncated");
+		mesh.resize(numPrimitives);
+		for (CachedPrimitive& primitive : mesh) {
+			const unsigned char* vertices;
+			const unsigned char* indices;
+			uint64_t verticesSize, indicesSize;
+			if (!reader.read(primitive.record) || !reader.readBlob(vertices, verticesSize) || !reader.readBlob(indices, indicesSize))
+				return reject("truncated");
+			if (verticesSize != primitive.record.numVertices * sizeof(Vertex) || indicesSize != primitive.record.numIndices * sizeof(GLuint)
+				|| primitive.record.material < -1 || primitive.record.material >= (int32_t)numMaterials)
+				return reject("corrupt mesh");
+			primitive.vertices = reinterpret_cast<const Vertex*>(vertices);
+			primitive.indices = reinterpret_cast<const GLuint*>(indices);
+		}
+	}
+
+	uint32_t numLights;
+	if (!reader.read(numLights))
+		return reject("truncated");
+	std::vector<LightRecord> lights(numLights);
+	for (LightRecord& light : lights) {
+		if (!reader.read(light))
+			return reject("truncated");
+		if (light.type < POINTLIGHT || light.type > DIRECTIONAL)
+			return reject("corrupt light");
+	}
+
+	uint32_t numCameras;
+	if (!reader.read(numCameras))
+		return reject("truncated");
+	std::vector<CameraRecord> cameras(numCameras);
+	for (CameraRecord& camera : cameras) {
+		if (!reader.read(camera))
+			return reject("truncated");
+	}
+	for (const LightRecord& light : lights) {
+		if (light.camera < -1 || light.camera >= (int32_t)numCameras)
+			return reject("corrupt light");
+	}
+
+	uint32_t numNodes;
+	if (!reader.read(numNodes))
+		return reject("truncated");
+	std::vector<std::pair<std::string, NodeRecord>> nodes(numNodes);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (!reader.readString(nodes[i].first) || !reader.read(nodes[i].second))
+			return reject("truncated");
+		const NodeRecord& record = nodes[i].second;
+		if (record.parent < -1 || record.parent >= (int32_t)i || record.mesh < -1 || record.mesh >= (int32_t)numMeshes
+			|| record.light < -1 || record.light >= (int32_t)numLights || record.camera < -1 || record.camera >= (int32_t)numCameras)
+			return reject("corrupt node");
+	}
+
+	if (scene.mainCameraId < -1 || scene.mainCameraId >= (int32_t)numCameras)
+		return reject("corrupt scene");
+
+	// One unit of work per image decode and upload and per primitive upload
+	int numPrimitives = 0;
+	for (const auto& mesh : meshes)
+		numPrimitives += static_cast<int>(mesh.size());
+	int numImages = static_cast<int>(std::count_if(textures.begin(), textures.end(), [](const TextureSource& texture) { return !texture.empty(); }));
+	model.loadWorkTotal = 2 * numImages + numPrimitives;
+	model.loadStage = LOAD_DECODE;
+
+	// Textures decode straight from the mapping
+	model.uploadTextures(textures);
+
+	auto getTexture = [&model](int32_t index) { return index >= 0 ? model.lodTex[index].get() : nullptr; };
+
+	for (const auto& cached : materials) {
+		const MaterialRecord& record = cached.second;
+		auto material = std::make_unique<Material>();
+		material->name = cached.first;
+		material->alphaMode = static_cast<ALPHAMODE>(record.alphaMode);
+		material->alphaCutoff = record.alphaCutoff;
+		material->doubleSided = record.doubleSided != 0;
+		material->pbrMetallicRoughness.baseColorFactor = record.baseColorFactor;
+		material->pbrMetallicRoughness.metallicFactor = record.metallicFactor;
+		material->pbrMetallicRoughness.roughnessFactor = record.roughnessFactor;
+		material->emissiveFactor = record.emissiveFactor;
+		material->pbrMetallicRoughness.baseColorTexture = getTexture(record.baseColorTexture);
+		material->pbrMetallicRoughness.metallicRoughness = getTexture(record.metallicRoughness);
+		material->normalMap = getTexture(record.normalMap);
+		material->occlusionTexture = getTexture(record.occlusionTexture);
+		material->emissiveTexture = getTexture(record.emissiveTexture);
+		model.lodMat.push_back(std::move(material));
+	}
+
+	// One glBufferData per vertex and index buffer, straight from the mapping, which has to outlive the uploads
+	std::vector<std::future<void>> uploads;
+	for (const auto& cachedMesh : meshes) {
+		model.lodMesh.push_back(std::make_unique<Mesh>());
+		Mesh* mesh = model.lodMesh.back().get();
+		mesh->primitives.reserve(cachedMesh.size());
+		for (const CachedPrimitive& primitive : cachedMesh) {
+			Material* material = primitive.record.material >= 0 ? model.lodMat[primitive.record.material].get() : nullptr;
+			uploads.push_back(model.runOnGLThread([&model, mesh, &primitive, material]() {
+				size_t numVertices = static_cast<size_t>(primitive.record.numVertices);
+				size_t numIndices = static_cast<size_t>(primitive.record.numIndices);
+				Primitive& created = mesh->primitives.emplace_back(primitive.vertices, numVertices, primitive.indices, numIndices,
+					material, model.compactVertices, &primitive.record.bounds);
+				// Only models that keep their geometry on the CPU (for triangle picking) need a copy of the mapping
+				if (!model.gpuResident) {
+					created.vertices.assign(primitive.vertices, primitive.vertices + numVertices);
+					created.indices.assign(primitive.indices, primitive.indices + numIndices);
+				}
+				model.loadWorkDone++;
+			}));
+		}
+	}
+	model.waitForGLThread(uploads);
+
+	for (const CameraRecord& record : cameras) {
+		std::unique_ptr<Camera> camera;
+		if (record.type == PERSPECTIVE) {
+			auto perspectiveCamera = std::make_unique<PerspectiveCamera>();
+			perspectiveCamera->fov = record.fov;
+			perspectiveCamera->aspectRatio = record.aspectRatio;
+			camera = std::move(perspectiveCamera);
+		}
+		else {
+			auto orthographicCamera = std::make_unique<OrthographicCamera>();
+			orthographicCamera->size = record.size;
+			camera = std::move(orthographicCamera);
+		}
+		camera->enabled = record.enabled != 0;
+		camera->index = record.index;
+		camera->nearPlane = record.nearPlane;
+		camera->farPlane = record.farPlane;
+		camera->updateProjection();
+		model.lodCamera.push_back(std::move(camera));
+	}
+
+	std::vector<std::future<void>> shadowMaps;
+	int numShadowMaps = 0;
+	for (size_t i = 0; i < lights.size(); i++) {
+		const LightRecord& record = lights[i];
+		std::unique_ptr<Light> light;
+		if (record.type == SPOTLIGHT) {
+			auto spotLight = std::make_unique<SpotLight>();
+			spotLight->innerConeAngle = record.innerConeAngle;
+			spotLight->outerConeAngle = record.outerConeAngle;
+			light = std::move(spotLight);
+		}
+		else if (record.type == DIRECTIONAL) {
+			auto directionalLight = std::make_unique<DirectionalLight>();
+			DirectionalLight* target = directionalLight.get();
+			if (numShadowMaps < MAX_SHADOW_MAPS) {
+				directionalLight->shadowIndex = numShadowMaps++;
+				int slot = MATERIAL_TEXTURE_UNITS + directionalLight->shadowIndex;
+				shadowMaps.push_back(model.runOnGLThread([target, slot]() {
+					target->shadowMap = std::make_unique<FBO>(8192, 8192, slot, FBO_DEPTH);
+				}));
+			}
+			directionalLight->distance = record.distance;
+			light = std::move(directionalLight);
+		}
+		else {
+			auto pointLight = std::make_unique<PointLight>();
+			pointLight->attenuation = record.attenuation;
+			light = std::move(pointLight);
+		}
+		light->enabled = record.enabled != 0;
+		light->color = record.color;
+		light->intensity = record.intensity;
+		light->range = record.range;
+		light->castShadows = record.castShadows != 0;
+		light->shadowBias = record.shadowBias;
+		light->index = record.index;
+		light->camera = record.camera >= 0 ? model.lodCamera[record.camera].get() : nullptr;
+		model.lodLight.push_back(std::move(light));
+	}
+	model.waitForGLThread(shadowMaps);
+
+	// Parents always come first, global matrices are rebuilt by Model::load
+	std::vector<Node*> createdNodes;
+	createdNodes.reserve(nodes.size());
+	for (const auto& cached : nodes) {
+		const NodeRecord& record = cached.second;
+		Node* parent = record.parent >= 0 ? createdNodes[record.parent] : model.getRootNode();
+		auto node = std::make_unique<Node>(record.id, record.matrix, glm::mat4(1.0f), parent, cached.first);
+		if (record.mesh >= 0)
+			node->mesh = model.lodMesh[record.mesh].get();
+		if (record.light >= 0)
+			node->light = model.lodLight[record.light].get();
+		if (record.camera >= 0)
+			node->camera = model.lodCamera[record.camera].get();
+		createdNodes.push_back(node.get());
+		parent->addChild(std::move(node));
+	}
+
+	model.ambientColor = scene.ambientColor;
+	model.ambientLight = scene.ambientLight;
+	model.shadowDarkness = scene.shadowDarkness;
+	model.reflectionFactor = scene.reflectionFactor;
+	model.numNodes = scene.numNodes;
+	model.nodeWithCamera = scene.nodeWithCamera;
+	model.mainCameraId = scene.mainCameraId;
+
+	double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Read scene cache " << path << " in " << totalTime << " ms" << std::endl;
+	return true;
+}
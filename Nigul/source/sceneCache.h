@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+class Model;
+
+/**
+ * @class SceneCache
+ * @brief Versioned binary copy of a loaded model, written next to its glTF file.
+ *
+ * Holds the interleaved vertex and index data, the materials, the flattened node tree, the lights
+ * and the cameras exactly as Model::load leaves them, so a later load maps the file and skips the
+ * JSON parse, the accessor decoding and the node traversal. The cache is rebuilt whenever the model
+ * file or one of its buffer files changes, judged by their size and mtime and by a content hash when
+ * only the mtime moved, or when a loader setting the geometry depends on is toggled.
+ */
+class SceneCache
+{
+public:
+    static const uint32_t VERSION = 7;
+
+    /**
+     * @brief Path of the cache belonging to a model file.
+     */
+    static std::string getPath(const std::string& modelFile);
+
+    /**
+     * @brief Fills a freshly constructed model from its cache.
+     *
+     * GL work goes through Model::runOnGLThread, so this can run on the loading thread of Model::loadAsync.
+     *
+     * @param model Model with its file set and nothing loaded yet.
+     * @return false if there is no cache or it is stale or corrupt, the model is left untouched.
+     */
+    static bool load(Model& model);
+
+    /**
+     * @brief Bakes a model that has just been loaded from its glTF.
+     *
+     * Must be called before the model releases its buffers, embedded images are copied from them.
+     */
+    static bool save(Model& model);
+};
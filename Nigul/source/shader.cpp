@@ -1,4 +1,19 @@
 #include"shader.h"
+#include "programCache.h"
+
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+bool Shader::parallelCompile = false;
+int Shader::numUploads = 0;
+int Shader::numSkippedUploads = 0;
+std::vector<Shader*> Shader::pendingShaders;
 
 std::string get_file_contents(const char* filename)
 {
@@ -16,86 +31,172 @@ std::string get_file_contents(const char* filename)
 	throw(errno);
 }
 
-Shader::Shader(const char* computeFile)
+// Expands the #include "file" lines of a stage with the files of shaders/include/, each file at most once. #line
+// directives keep the line numbers of compile errors, every included file counts as its own source string.
+static std::string expandIncludes(const std::string& source, int sourceNumber, std::vector<std::string>& included)
 {
-	std::cout << "Creating computer shader..." << std::endl;
-	// Get file path
-	std::string computeFilePath = "shaders/" + std::string(computeFile);
-
-	// Read computeFile and store the string
-	std::string computeCode = get_file_contents(computeFilePath.c_str());
-
-	// Convert the shader source strings into character arrays
-	const char* computeSource = computeCode.c_str();
-
-	// Create Compute Shader Object 
-	GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
-	glShaderSource(computeShader, 1, &computeSource, NULL);
-	glCompileShader(computeShader);
-	compileErrors(computeShader, "COMPUTE");
-
-	// Create Shader Program Object and get its reference
-	ID = glCreateProgram();
-
-	// Attach the Compute Shader to the Shader Program
-	glAttachShader(ID, computeShader);
+	std::istringstream lines(source);
+	std::string expanded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line)) {
+		lineNumber++;
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			expanded += line + "\n";
+			continue;
+		}
 
-	// Wrap-up/Link all the shaders together into the Shader Program
-	glLinkProgram(ID);
-	compileErrors(ID, "PROGRAM");
+		size_t open = line.find('"', start);
+		size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			std::cerr << "Malformed shader include: " << line << std::endl;
+			expanded += "\n";
+			continue;
+		}
+		std::string file = line.substr(open + 1, close - open - 1);
+		if (std::find(included.begin(), included.end(), file) == included.end()) {
+			included.push_back(file);
+			int fileNumber = static_cast<int>(included.size());
+			expanded += "#line 1 " + std::to_string(fileNumber) + "\n";
+			expanded += expandIncludes(get_file_contents(("shaders/include/" + file).c_str()), fileNumber, included);
+		}
+		expanded += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceNumber) + "\n";
+	}
+	return expanded;
+}
 
-	// Delete the now useless Compute Shader object
-	glDeleteShader(computeShader);
+Shader::Shader(const char* computeFile)
+{
+	std::cout << "Creating computer shader..." << std::endl;
+	createProgram({ computeFile }, { GL_COMPUTE_SHADER });
 }
 
 Shader::~Shader()
 {
+	for (GLuint shader : pendingStages)
+		glDeleteShader(shader);
+	pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), this), pendingShaders.end());
 	glDeleteProgram(ID);
 }
 
 Shader::Shader(const char* vertexFile, const char* fragmentFile)
 {
-	// Get file path
-	std::string vertexFilePath = "shaders/" + std::string(vertexFile);
-	std::string fragmentFilePath = "shaders/" + std::string(fragmentFile);
-
-	// Read vertexFile and fragmentFile and store the strings
-	std::string vertexCode = get_file_contents(vertexFilePath.c_str());
-	std::string fragmentCode = get_file_contents(fragmentFilePath.c_str());
+	createProgram({ vertexFile, fragmentFile }, { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER });
+}
 
-	// Convert the shader source strings into character arrays
-	const char* vertexSource = vertexCode.c_str();
-	const char* fragmentSource = fragmentCode.c_str();
+void Shader::createProgram(const std::vector<std::string>& stageFiles, const std::vector<GLenum>& stageTypes)
+{
+	auto start = std::chrono::high_resolution_clock::now();
 
-	// Create Vertex Shader Object 
-	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexSource, NULL);
-	glCompileShader(vertexShader);
-	compileErrors(vertexShader, "VERTEX");
+	// Read every stage from shaders/ with its includes and store the strings, the cache key covers the includes too
+	std::vector<std::string> stageSources;
+	for (const std::string& file : stageFiles) {
+		std::vector<std::string> included;
+		stageSources.push_back(expandIncludes(get_file_contents(("shaders/" + file).c_str()), 0, included));
+	}
 
-	// Create Fragment Shader Object 
-	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-	glCompileShader(fragmentShader);
-	compileErrors(fragmentShader, "FRAGMENT");
+	// A binary from an earlier launch skips the compile and the link
+	std::string cachePath = ProgramCache::getPath(stageFiles);
+	uint64_t key = ProgramCache::getKey(stageSources);
+	ID = glCreateProgram();
+	if (ProgramCache::load(ID, cachePath, key)) {
+		ProgramCache::numLoaded++;
+		reflect();
+		ProgramCache::loadTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
 
-	// Create Shader Program Object and get its reference
+	// A rejected binary leaves the program unlinked, start over with a fresh one
+	glDeleteProgram(ID);
 	ID = glCreateProgram();
-	// Attach the Vertex and Fragment Shaders to the Shader Program
-	glAttachShader(ID, vertexShader);
-	glAttachShader(ID, fragmentShader);
-	// Wrap-up/Link all the shaders together into the Shader Program
+
+	// Only submitted here, the driver compiles while the caller goes on and finish() collects the result
+	binaryPath = cachePath;
+	binaryKey = key;
+	for (size_t i = 0; i < stageSources.size(); i++) {
+		// Create Shader Object and compile it
+		const char* source = stageSources[i].c_str();
+		GLuint shader = glCreateShader(stageTypes[i]);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		// Attach the Shader to the Shader Program
+		glAttachShader(ID, shader);
+		pendingStages.push_back(shader);
+		pendingStageTypes.push_back(stageTypes[i]);
+	}
+
+	// Wrap-up/Link all the shaders together into the Shader Program, keeping its binary around for the cache
+	glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ID);
+	pendingShaders.push_back(this);
+	submitTime = start;
+
+	ProgramCache::numCompiled++;
+}
+
+bool Shader::isReady() const
+{
+	if (pendingStages.empty())
+		return true;
+	// Without the extension there is no way to ask, finish() blocks until the driver is done
+	if (!parallelCompile)
+		return true;
+	GLint completed = GL_FALSE;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+void Shader::finish()
+{
+	if (pendingStages.empty())
+		return;
+
+	for (size_t i = 0; i < pendingStages.size(); i++) {
+		switch (pendingStageTypes[i]) {
+		case GL_VERTEX_SHADER: compileErrors(pendingStages[i], "VERTEX"); break;
+		case GL_FRAGMENT_SHADER: compileErrors(pendingStages[i], "FRAGMENT"); break;
+		case GL_GEOMETRY_SHADER: compileErrors(pendingStages[i], "GEOMETRY"); break;
+		default: compileErrors(pendingStages[i], "COMPUTE"); break;
+		}
+	}
 	compileErrors(ID, "PROGRAM");
 
-	// Delete the now useless Vertex and Fragment Shader objects
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	// Delete the now useless Shader objects
+	for (GLuint shader : pendingStages) {
+		glDetachShader(ID, shader);
+		glDeleteShader(shader);
+	}
+	pendingStages.clear();
+	pendingStageTypes.clear();
+	pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), this), pendingShaders.end());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+	if (linked == GL_TRUE) {
+		ProgramCache::save(ID, binaryPath, binaryKey);
+		reflect();
+	}
 
+	// From submit to the link being collected, the driver compiles in between whether it runs in parallel or not
+	ProgramCache::compileTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - submitTime).count();
+}
+
+bool Shader::finishReady()
+{
+	std::vector<Shader*> ready;
+	for (Shader* shader : pendingShaders) {
+		if (shader->isReady())
+			ready.push_back(shader);
+	}
+	for (Shader* shader : ready)
+		shader->finish();
+	return pendingShaders.empty();
 }
 
 void Shader::activate()
 {
+	finish();
 	glUseProgram(ID);
 }
 
@@ -125,84 +226,272 @@ void Shader::compileErrors(unsigned int shader, const char* type)
 	}
 }
 
+uint32_t Shader::getUniformId(const std::string& name)
+{
+	// Shared by every shader, only touched on the GL thread
+	static std::unordered_map<std::string, uint32_t> ids;
+	auto it = ids.find(name);
+	if (it != ids.end())
+		return it->second;
+	uint32_t id = static_cast<uint32_t>(ids.size());
+	ids.emplace(name, id);
+	return id;
+}
+
+// Bytes of one element of a uniform, large for the types not listed so comparisons never fall short
+static size_t getUniformTypeSize(GLenum type)
+{
+	switch (type) {
+	case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: return 8;
+	case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: return 12;
+	case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2: return 16;
+	case GL_FLOAT_MAT3: return 36;
+	case GL_FLOAT_MAT4: return 64;
+	case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL: return 4;
+	default: return 64; // Samplers, images and the rest are set as ints, a larger size only wastes shadow bytes
+	}
+}
+
+void Shader::reflect()
+{
+	uniforms.clear();
+	uniformSlots.clear();
+	blocks.clear();
+
+	GLint numUniforms = 0;
+	glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &numUniforms);
+	const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_ARRAY_SIZE, GL_LOCATION, GL_BLOCK_INDEX };
+	size_t shadowSize = 0;
+	for (GLint i = 0; i < numUniforms; i++) {
+		GLint values[5] = {};
+		glGetProgramResourceiv(ID, GL_UNIFORM, i, 5, properties, 5, nullptr, values);
+		if (values[3] < 0 || values[4] != -1)
+			continue; // Members of blocks have no location
+
+		std::string name(std::max(values[0], 1), '\0');
+		glGetProgramResourceName(ID, GL_UNIFORM, i, values[0], nullptr, &name[0]);
+		name.resize(std::strlen(name.c_str()));
+		// Arrays are reported as their first element
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			name.resize(name.size() - 3);
+
+		UniformInfo uniform;
+		uniform.location = values[3];
+		uniform.type = values[1];
+		uniform.count = std::max(values[2], 1);
+		uniform.offset = shadowSize;
+		uniform.size = getUniformTypeSize(uniform.type);
+		shadowSize += uniform.size * uniform.count;
+
+		uint32_t id = getUniformId(name);
+		if (id >= uniformSlots.size())
+			uniformSlots.resize(id + 1, -1);
+		uniformSlots[id] = static_cast<int32_t>(uniforms.size());
+		uniforms.push_back(uniform);
+	}
+	shadow.assign(shadowSize, 0);
+
+	for (GLenum blockInterface : { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK }) {
+		GLint numBlocks = 0;
+		glGetProgramInterfaceiv(ID, blockInterface, GL_ACTIVE_RESOURCES, &numBlocks);
+		const GLenum blockProperties[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING };
+		for (GLint i = 0; i < numBlocks; i++) {
+			GLint values[2] = {};
+			glGetProgramResourceiv(ID, blockInterface, i, 2, blockProperties, 2, nullptr, values);
+			BlockInfo block;
+			block.name.assign(std::max(values[0], 1), '\0');
+			glGetProgramResourceName(ID, blockInterface, i, values[0], nullptr, &block.name[0]);
+			block.name.resize(std::strlen(block.name.c_str()));
+			block.binding = values[1];
+			blocks.push_back(block);
+		}
+	}
+}
+
+GLint Shader::getBlockBinding(const std::string& name) const
+{
+	for (const BlockInfo& block : blocks) {
+		if (block.name == name)
+			return block.binding;
+	}
+	return -1;
+}
+
+const Shader::UniformInfo* Shader::change(uint32_t id, const void* data, size_t size) const
+{
+	// The tables only exist once the program is linked
+	if (!pendingStages.empty())
+		const_cast<Shader*>(this)->finish();
+
+	if (id >= uniformSlots.size() || uniformSlots[id] < 0)
+		return nullptr;
+	UniformInfo& uniform = uniforms[uniformSlots[id]];
+	size = std::min(size, uniform.size * uniform.count);
+	unsigned char* copy = shadow.data() + uniform.offset;
+	if (uniform.known && std::memcmp(copy, data, size) == 0) {
+		numSkippedUploads++;
+		return nullptr;
+	}
+
+	std::memcpy(copy, data, size);
+	uniform.known = true;
+	numUploads++;
+	return &uniform;
+}
+
+// Bools and samplers are ints to the shader, the shadow copy holds them as ints
+void Shader::set(const ShaderUniform<bool>& uniform, bool value) const
+{
+	int integer = value;
+	if (const UniformInfo* info = change(uniform.id, &integer, sizeof(int)))
+		glProgramUniform1i(ID, info->location, integer);
+}
+
+void Shader::set(const ShaderUniform<int>& uniform, int value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<float>& uniform, float value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<glm::vec2>& uniform, const glm::vec2& value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<glm::vec3>& uniform, const glm::vec3& value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<glm::vec4>& uniform, const glm::vec4& value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<glm::mat4>& uniform, const glm::mat4& value) const
+{
+	set(uniform, &value, 1);
+}
+
+void Shader::set(const ShaderUniform<int>& uniform, const int* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(int)))
+		glProgramUniform1iv(ID, info->location, count, values);
+}
+
+void Shader::set(const ShaderUniform<float>& uniform, const float* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(float)))
+		glProgramUniform1fv(ID, info->location, count, values);
+}
+
+void Shader::set(const ShaderUniform<glm::vec2>& uniform, const glm::vec2* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(glm::vec2)))
+		glProgramUniform2fv(ID, info->location, count, &values[0][0]);
+}
+
+void Shader::set(const ShaderUniform<glm::vec3>& uniform, const glm::vec3* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(glm::vec3)))
+		glProgramUniform3fv(ID, info->location, count, &values[0][0]);
+}
+
+void Shader::set(const ShaderUniform<glm::vec4>& uniform, const glm::vec4* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(glm::vec4)))
+		glProgramUniform4fv(ID, info->location, count, &values[0][0]);
+}
+
+void Shader::set(const ShaderUniform<glm::mat4>& uniform, const glm::mat4* values, int count) const
+{
+	if (const UniformInfo* info = change(uniform.id, values, count * sizeof(glm::mat4)))
+		glProgramUniformMatrix4fv(ID, info->location, count, GL_FALSE, &values[0][0][0]);
+}
+
 void Shader::setVec2(const std::string& name, const glm::vec2& value) const
 {
-	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	set(ShaderUniform<glm::vec2>(name), value);
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& value) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	set(ShaderUniform<glm::vec3>(name), value);
 }
 
 void Shader::setVec4(const std::string& name, const glm::vec4& value) const
 {
-	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	set(ShaderUniform<glm::vec4>(name), value);
 }
 
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	set(ShaderUniform<glm::mat4>(name), mat);
 }
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	set(ShaderUniform<bool>(name), value);
 }
 
 void Shader::setBools(const std::string& name, const bool* values, int count) const
 {
-	glUniform1iv(glGetUniformLocation(ID, name.c_str()), count, (int*)values);
+	std::vector<int> ints(values, values + count);
+	set(ShaderUniform<int>(name), ints.data(), count);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	set(ShaderUniform<int>(name), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	set(ShaderUniform<float>(name), value);
 }
 
 void Shader::setSizeT(const std::string& name, size_t value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	set(ShaderUniform<int>(name), static_cast<int>(value));
 }
 
 void Shader::setInts(const std::string& name, const int* values, int count) const
 {
-	glUniform1iv(glGetUniformLocation(ID, name.c_str()), count, values);
+	set(ShaderUniform<int>(name), values, count);
 }
 
 void Shader::setFloats(const std::string& name, const float* values, int count) const
 {
-	glUniform1fv(glGetUniformLocation(ID, name.c_str()), count, values);
+	set(ShaderUniform<float>(name), values, count);
 }
 
 void Shader::setVecs2(const std::string& name, const glm::vec2* values, int count) const
 {
-	glUniform2fv(glGetUniformLocation(ID, name.c_str()), count, &values[0][0]);
+	set(ShaderUniform<glm::vec2>(name), values, count);
 }
 
 void Shader::setVecs3(const std::string& name, const glm::vec3* values, int count) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), count, &values[0][0]);
+	set(ShaderUniform<glm::vec3>(name), values, count);
 }
 
 void Shader::setVecs4(const std::string& name, const glm::vec4* values, int count) const
 {
-	glUniform4fv(glGetUniformLocation(ID, name.c_str()), count, &values[0][0]);
+	set(ShaderUniform<glm::vec4>(name), values, count);
 }
 
 void Shader::setMats4(const std::string& name, const glm::mat4* mats, int count) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), count, GL_FALSE, &mats[0][0][0]);
+	set(ShaderUniform<glm::mat4>(name), mats, count);
 }
 
 void Shader::setSkybox(const std::string& name, const Skybox& skybox) const
 {
 	glActiveTexture(GL_TEXTURE0 + skybox.slot);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, skybox.cubemapTexture);
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), skybox.slot);
+	setInt(name, skybox.slot);
 }
@@ -3,10 +3,13 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cerrno>
+#include <cstdint>
+#include <chrono>
 
 #include "skybox.h"
 
@@ -19,6 +22,18 @@
  */
 std::string get_file_contents(const char* filename);
 
+/**
+ * @brief Uniform name resolved once into an id every Shader looks up in its reflected table.
+ *
+ * Meant to be built once (a static at the call site), T is the type the shader declares.
+ */
+template <typename T>
+struct ShaderUniform
+{
+    uint32_t id;
+    explicit ShaderUniform(const std::string& name);
+};
+
 /**
  * @class Shader
  * @brief Represents an OpenGL shader program, encapsulating vertex and fragment shaders.
@@ -28,6 +43,11 @@ class Shader
 public:
     GLuint ID; ///< ID of the shader program
 
+    static bool parallelCompile; ///< Set when the driver compiles on its own threads (GL_KHR_parallel_shader_compile)
+
+    static int numUploads; ///< Uniform uploads since the start
+    static int numSkippedUploads; ///< Uploads of the value a uniform already had, not sent to the driver
+
     /**
      * @brief Constructs a Shader object and creates a shader program from vertex and fragment shader files.
      *
@@ -49,6 +69,25 @@ public:
      */
     void activate();
 
+    /**
+     * @brief Whether the driver is done compiling and linking, without blocking on it.
+     */
+    bool isReady() const;
+
+    /**
+     * @brief Waits for the compile submitted by the constructor, reports its errors and caches its binary.
+     *
+     * Called by activate(), so a program is only waited on the first time it is used.
+     */
+    void finish();
+
+    /**
+     * @brief Finishes every program the driver is done with, once per frame.
+     *
+     * @return true once no program is compiling anymore.
+     */
+    static bool finishReady();
+
     /**
      * @brief checks if the shaders have been compiled succesfully
      *
@@ -57,6 +96,34 @@ public:
      */
     void compileErrors(unsigned int shader, const char* type);
 
+    /**
+     * @brief Id of a uniform name, the same in every shader. Names are registered on first use.
+     */
+    static uint32_t getUniformId(const std::string& name);
+
+    /**
+     * @brief Binding of a uniform or shader storage block, -1 if the program has no such active block.
+     */
+    GLint getBlockBinding(const std::string& name) const;
+
+    // Uploads are skipped when the uniform already holds the value, inactive uniforms are ignored.
+    // The program does not need to be active
+    void set(const ShaderUniform<bool>& uniform, bool value) const;
+    void set(const ShaderUniform<int>& uniform, int value) const;
+    void set(const ShaderUniform<float>& uniform, float value) const;
+    void set(const ShaderUniform<glm::vec2>& uniform, const glm::vec2& value) const;
+    void set(const ShaderUniform<glm::vec3>& uniform, const glm::vec3& value) const;
+    void set(const ShaderUniform<glm::vec4>& uniform, const glm::vec4& value) const;
+    void set(const ShaderUniform<glm::mat4>& uniform, const glm::mat4& value) const;
+
+    void set(const ShaderUniform<int>& uniform, const int* values, int count) const;
+    void set(const ShaderUniform<float>& uniform, const float* values, int count) const;
+    void set(const ShaderUniform<glm::vec2>& uniform, const glm::vec2* values, int count) const;
+    void set(const ShaderUniform<glm::vec3>& uniform, const glm::vec3* values, int count) const;
+    void set(const ShaderUniform<glm::vec4>& uniform, const glm::vec4* values, int count) const;
+    void set(const ShaderUniform<glm::mat4>& uniform, const glm::mat4* values, int count) const;
+
+    // Same as set, resolving the name first
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
@@ -77,4 +144,56 @@ public:
 
     void setSkybox(const std::string &name, const Skybox& skybox) const;
 
+private:
+    // An active uniform outside of any block, its last value is kept in shadow
+    struct UniformInfo {
+        GLint location = -1;
+        GLenum type = 0;
+        GLint count = 1; // Elements of an array
+        size_t offset = 0; // In shadow
+        size_t size = 0; // Bytes for every element
+        bool known = false; // Whether shadow holds what the program has
+    };
+
+    struct BlockInfo {
+        std::string name;
+        GLint binding = -1;
+    };
+
+    /**
+     * @brief Builds the uniform and block tables once the program is linked.
+     */
+    void reflect();
+
+    // The uniform to upload to, nullptr if it is inactive or already holds the bytes (then counted as skipped)
+    const UniformInfo* change(uint32_t id, const void* data, size_t size) const;
+
+    mutable std::vector<UniformInfo> uniforms;
+    std::vector<int32_t> uniformSlots; // Index in uniforms of each uniform id, -1 if inactive
+    std::vector<BlockInfo> blocks;
+    mutable std::vector<unsigned char> shadow;
+
+    /**
+     * @brief Submits the compile and link of the stages into ID, or restores them from the ProgramCache.
+     *
+     * A line #include "file" in a stage is replaced by that file of shaders/include/, once per stage, so
+     * declarations shared with the C++ side or between shaders live in one place.
+     *
+     * @param stageFiles Stage files inside shaders/.
+     * @param stageTypes GL type of each stage.
+     */
+    void createProgram(const std::vector<std::string>& stageFiles, const std::vector<GLenum>& stageTypes);
+
+    // Compile in flight, empty once finished
+    std::vector<GLuint> pendingStages;
+    std::vector<GLenum> pendingStageTypes;
+    std::string binaryPath;
+    uint64_t binaryKey = 0;
+    std::chrono::high_resolution_clock::time_point submitTime; // Start of the compile, finish() adds the time to link completion
+
+    static std::vector<Shader*> pendingShaders;
+
 };
+
+template <typename T>
+ShaderUniform<T>::ShaderUniform(const std::string& name) : id(Shader::getUniformId(name)) {}
@@ -1,4 +1,6 @@
 #include "skybox.h"
+#include "texture.h"
+#include "textureCache.h"
 
 float skyboxVertices[] =
 {
@@ -65,71 +67,11 @@ Skybox::Skybox(const std::string& folderPath, int slot)
 		folderPath + "/nz.png"
 	};
 
-	glGenTextures(1, &cubemapTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	// These are very important to prevent seams
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	// This might help with seams on some systems
-	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-
-	for (unsigned int i = 0; i < 6; i++)
-	{
-		int width, height, nrChannels;
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			stbi_set_flip_vertically_on_load(false);
-			if (nrChannels == 3)
-			{
-				glTexImage2D
-				(
-					GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-					0,
-					GL_RGB,
-					width,
-					height,
-					0,
-					GL_RGB,
-					GL_UNSIGNED_BYTE,
-					data
-				);
-			}
-			else if (nrChannels == 4)
-			{
-				glTexImage2D
-				(
-					GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-					0,
-					GL_RGBA,
-					width,
-					height,
-					0,
-					GL_RGBA,
-					GL_UNSIGNED_BYTE,
-					data
-				);
-			}
-			else
-			{
-				std::cout << "nrChannels not 3 or 4" << std::endl;
-			}
-
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Failed to load texture: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-
-	// Generate mipmaps
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-	// Unbind texture
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	// Faces already on the GPU for another skybox are not loaded again
+	TextureCache& cache = TextureCache::shared();
+	TextureKey key = cache.getCubemapKey(faces);
+	cubemap = cache.acquire(key);
+	if (!cubemap)
+		cubemap = cache.insert(key, Texture::createCubemap(faces, slot));
+	cubemapTexture = cubemap->ID;
 }
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
 #include <glad/glad.h>
 
+class Texture;
+
 class Skybox
 {
 public:
+	std::shared_ptr<Texture> cubemap; // Shared through the TextureCache with every skybox made of the same faces
 	GLuint cubemapTexture;
 	GLuint slot;
 
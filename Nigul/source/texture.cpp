@@ -1,9 +1,65 @@
 #include "texture.h"
+#include "textureStreamer.h"
+#include "texturePool.h"
+#include <cmath>
 #include <chrono>
 
-Texture::Texture(const char* image, GLuint slot){
+ImageData ImageData::decode(const std::string& image, int index) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ImageData data;
+	data.index = index;
 	// Reads the image from a file and stores it in bytes
-	bytes = stbi_load(image, &width, &height, &numColCh, 0);
+	data.bytes = stbi_load(image.c_str(), &data.width, &data.height, &data.numColCh, 0);
+	if (!data.bytes)
+		std::cerr << "Failed to decode image: " << image << std::endl;
+
+	data.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return data;
+}
+
+ImageData ImageData::decode(const unsigned char* encoded, size_t size, int index) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ImageData data;
+	data.index = index;
+	data.bytes = stbi_load_from_memory(encoded, static_cast<int>(size), &data.width, &data.height, &data.numColCh, 0);
+	if (!data.bytes)
+		std::cerr << "Failed to decode embedded image " << index << std::endl;
+
+	data.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return data;
+}
+
+void ImageData::free() {
+	stbi_image_free(bytes);
+	bytes = nullptr;
+	compressed.clear();
+	compressed.shrink_to_fit();
+	levels.clear();
+}
+
+Texture::Texture(const char* image, GLuint slot) {
+	ImageData data = ImageData::decode(image);
+	try {
+		upload(data, slot);
+	}
+	catch (...) {
+		data.free();
+		throw;
+	}
+	data.free();
+}
+
+Texture::Texture(const ImageData& image, GLuint slot) {
+	upload(image, slot);
+}
+
+void Texture::upload(const ImageData& image, GLuint slot) {
+	bytes = image.bytes;
+	width = image.width;
+	height = image.height;
+	numColCh = image.numColCh;
 	unit = slot;
 
 	// Generates an OpenGL texture object
@@ -20,13 +76,19 @@ Texture::Texture(const char* image, GLuint slot){
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
+	if (image.isCompressed()) {
+		uploadCompressed(image);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
+
 	// Assigns the image to the OpenGL Texture object
 	if (numColCh == 4)
 		glTexImage2D
 		(
 			GL_TEXTURE_2D,
 			0,
-			GL_RGBA,
+			GL_RGBA8,
 			width,
 			height,
 			0,
@@ -39,7 +101,7 @@ Texture::Texture(const char* image, GLuint slot){
 		(
 			GL_TEXTURE_2D,
 			0,
-			GL_RGBA,
+			GL_RGBA8,
 			width,
 			height,
 			0,
@@ -52,7 +114,7 @@ Texture::Texture(const char* image, GLuint slot){
 		(
 			GL_TEXTURE_2D,
 			0,
-			GL_RGBA,
+			GL_RGBA8,
 			width,
 			height,
 			0,
@@ -65,15 +127,80 @@ Texture::Texture(const char* image, GLuint slot){
 
 	// Generates MipMaps
 	glGenerateMipmap(GL_TEXTURE_2D);
+	memorySize = static_cast<size_t>(width) * height * 4 * 4 / 3;
 
-	// Deletes the image data as it is already in the OpenGL Texture object
-	stbi_image_free(bytes);
+	// The image data is owned by the caller, it can be freed as soon as it is in the OpenGL Texture object
+	bytes = nullptr;
 
 	// Unbinds the OpenGL Texture object so that it can't accidentally be modified
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+	TexturePool::shared().add(this);
+}
+
+void Texture::uploadCompressed(const ImageData& image) {
+	// The whole mip chain was built offline, the levels read from the container are uploaded as is
+	compressedFormat = image.compressedFormat;
+	levels = image.levels;
+	residentLevel = static_cast<int>(levels.size());
+	setResidentLevel(image.firstLevel, image.getLevelData(image.firstLevel));
+
+	// The finer levels can be streamed in later
+	container = image.container;
+	containerOffset = image.containerOffset;
+	if (isStreamed())
+		TextureStreamer::shared().add(this);
+}
+
+void Texture::setResidentLevel(int level, const unsigned char* data) {
+	// Immutable storage for the new range of levels, level 0 of the GL object is level of the chain
+	bool hasLevels = residentLevel < static_cast<int>(levels.size());
+	GLuint newID = ID;
+	if (hasLevels)
+		glGenTextures(1, &newID);
+
+	const MipLevel& top = levels[level];
+	glBindTexture(GL_TEXTURE_2D, newID);
+	glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(levels.size()) - level, compressedFormat, top.width, top.height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	memorySize = 0;
+	for (int i = level; i < static_cast<int>(levels.size()); i++) {
+		const MipLevel& mip = levels[i];
+		if (i < residentLevel) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i - level, 0, 0, mip.width, mip.height, compressedFormat,
+				static_cast<GLsizei>(mip.size), data + mip.offset - top.offset);
+		}
+		else {
+			// Already on the GPU, copied without a round trip through the CPU
+			glCopyImageSubData(ID, GL_TEXTURE_2D, i - residentLevel, 0, 0, 0, newID, GL_TEXTURE_2D, i - level, 0, 0, 0, mip.width, mip.height, 1);
+		}
+		memorySize += mip.size;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (hasLevels) {
+		TexturePool::shared().remove(this);
+		glDeleteTextures(1, &ID);
+	}
+	ID = newID;
+	residentLevel = level;
+	TexturePool::shared().add(this);
+}
+
+int Texture::getNumLevels() const {
+	if (compressedFormat)
+		return static_cast<int>(levels.size()) - residentLevel;
+	return static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
 }
 
 Texture::~Texture() {
+	if (isStreamed())
+		TextureStreamer::shared().remove(this);
+	TexturePool::shared().remove(this);
 	glDeleteTextures(1, &ID);
 }
 
@@ -103,7 +230,7 @@ std::unique_ptr<Texture> Texture::createShadowMapTexture(int width, int height,
 	return tex;
 }
 
-std::unique_ptr<Texture> Texture::createColorTexture(int width, int height, GLuint slot) {
+std::unique_ptr<Texture> Texture::createColorTexture(int width, int height, GLuint slot, GLenum internalFormat) {
 	std::unique_ptr<Texture> tex = std::make_unique<Texture>();
 	tex->unit = slot;
 	tex->width = width;
@@ -112,7 +239,7 @@ std::unique_ptr<Texture> Texture::createColorTexture(int width, int height, GLui
 	glGenTextures(1, &tex->ID);
 	glBindTexture(GL_TEXTURE_2D, tex->ID);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
@@ -121,7 +248,7 @@ std::unique_ptr<Texture> Texture::createColorTexture(int width, int height, GLui
 	return tex;
 }
 
-std::unique_ptr<Texture> Texture::createMultisampleTexture(int width, int height, GLuint slot) {
+std::unique_ptr<Texture> Texture::createMultisampleTexture(int width, int height, GLuint slot, GLenum internalFormat) {
 	std::unique_ptr<Texture> tex = std::make_unique<Texture>();
 	tex->unit = slot;
 	tex->width = width;
@@ -131,7 +258,7 @@ std::unique_ptr<Texture> Texture::createMultisampleTexture(int width, int height
 	glGenTextures(1, &tex->ID);
 	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex->ID);
 
-	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, SAMPLES, GL_RGBA32F, width, height, GL_TRUE);
+	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, SAMPLES, internalFormat, width, height, GL_TRUE);
 	glTexParameteri(GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
@@ -140,20 +267,81 @@ std::unique_ptr<Texture> Texture::createMultisampleTexture(int width, int height
 	return tex;
 }
 
+std::unique_ptr<Texture> Texture::createCubemap(const std::vector<std::string>& faces, GLuint slot) {
+	std::unique_ptr<Texture> tex = std::make_unique<Texture>();
+	tex->unit = slot;
+	tex->isCubemap = true;
+
+	glGenTextures(1, &tex->ID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, tex->ID);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// These are very important to prevent seams
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// This might help with seams on some systems
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	for (unsigned int i = 0; i < faces.size(); i++)
+	{
+		int width, height, nrChannels;
+		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+		if (data)
+		{
+			stbi_set_flip_vertically_on_load(false);
+			if (nrChannels == 3 || nrChannels == 4)
+			{
+				GLenum format = nrChannels == 3 ? GL_RGB : GL_RGBA;
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+				tex->width = width;
+				tex->height = height;
+				tex->numColCh = nrChannels;
+				tex->memorySize += size_t(width) * height * nrChannels * 4 / 3;
+			}
+			else
+			{
+				std::cout << "nrChannels not 3 or 4" << std::endl;
+			}
+
+			stbi_image_free(data);
+		}
+		else
+		{
+			std::cout << "Failed to load texture: " << faces[i] << std::endl;
+		}
+	}
+
+	// Generate mipmaps
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	// Unbind texture
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	return tex;
+}
+
 void Texture::texUnit(Shader* shader, const char* uniform)
 {
-	// Gets the location of the uniform
-	GLuint texUni = glGetUniformLocation(shader->ID, uniform);
-	// Shader needs to be activated before changing the value of a uniform
-	shader->activate();
-	// Sets the value of the uniform
-	glUniform1i(texUni, unit);
+	texUnit(shader, uniform, unit);
+}
+
+void Texture::texUnit(Shader* shader, const char* uniform, GLuint unit)
+{
+	shader->setInt(uniform, static_cast<int>(unit));
 }
 
 void Texture::bind()
+{
+	bind(unit);
+}
+
+void Texture::bind(GLuint unit)
 {
 	glActiveTexture(GL_TEXTURE0 + unit);
-	if (isMultisampled)
+	if (isCubemap)
+		glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+	else if (isMultisampled)
 		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, ID);
 	else
 		glBindTexture(GL_TEXTURE_2D, ID);
@@ -1,11 +1,55 @@
 #pragma once
 #include <glad/glad.h>
 #include <stb/stb_image.h>
+#include <string>
+#include <memory>
+#include <vector>
 
 #include "shader.h"
 
 #define SAMPLES 16
 
+// One level of a block compressed mip chain, the bytes live in ImageData::compressed
+struct MipLevel
+{
+	int width = 0;
+	int height = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+// Decoded image living in CPU memory, waiting to be uploaded by the GL thread
+struct ImageData
+{
+	int index = -1; // Position of the image inside the model, used to keep the upload order
+	unsigned char* bytes = nullptr;
+
+	int width = 0;
+	int height = 0;
+	int numColCh = 0;
+
+	double decodeTime = 0.0; // Milliseconds spent inside stbi_load
+
+	// Block compressed mip chain, used instead of bytes when compressedFormat is set (see TextureCompressor)
+	GLenum compressedFormat = 0;
+	std::vector<unsigned char> compressed; // Levels from firstLevel on, the finer ones are left on disk
+	std::vector<MipLevel> levels; // Whole chain, offsets are relative to level 0
+	int firstLevel = 0;
+
+	// Container the chain can be read back from by the TextureStreamer, empty if it is not on disk
+	std::string container;
+	size_t containerOffset = 0; // Where level 0 starts inside the container
+
+	inline bool isCompressed() const { return compressedFormat != 0; }
+	inline const unsigned char* getLevelData(int level) const { return compressed.data() + levels[level].offset - levels[firstLevel].offset; }
+
+	// Decodes an image from disk, it does not touch OpenGL so it can be called from any thread
+	static ImageData decode(const std::string& image, int index = -1);
+	// Same as above for an image that is already in memory (embedded in a .glb or a data uri)
+	static ImageData decode(const unsigned char* encoded, size_t size, int index = -1);
+	void free();
+};
+
 class Texture
 {
 public:
@@ -16,18 +60,56 @@ public:
 	int width;
 	int height;
 	int numColCh;
+	size_t memorySize = 0; // Bytes of video memory used by every level
 
 	bool isMultisampled = false;
+	bool isCubemap = false;
+
+	// Block compressed chain, levels finer than residentLevel are not on the GPU (see TextureStreamer)
+	GLenum compressedFormat = 0;
+	std::vector<MipLevel> levels;
+	int residentLevel = 0;
+	std::string container;
+	size_t containerOffset = 0;
+
+	inline bool isStreamed() const { return !container.empty(); }
+
+	// Where the shaders find a material texture without binding it (see TexturePool), the GL object is then a
+	// view of an array layer or has a resident handle
+	int arrayIndex = -1;
+	int layer = -1;
+	GLuint64 handle = 0;
+
+	inline bool isIndexable() const { return handle != 0 || arrayIndex >= 0; }
+
+	// Shape of the GL object, compressed textures may not have their finest levels
+	inline GLenum getFormat() const { return compressedFormat ? compressedFormat : GL_RGBA8; }
+	inline int getStorageWidth() const { return compressedFormat ? levels[residentLevel].width : width; }
+	inline int getStorageHeight() const { return compressedFormat ? levels[residentLevel].height : height; }
+	int getNumLevels() const;
 
 	Texture() = default;
 	Texture(const char* image, GLuint slot); // Loads image
+	Texture(const ImageData& image, GLuint slot); // Uploads an already decoded image
 	static std::unique_ptr<Texture> createShadowMapTexture(int width, int height, GLuint slot); // Creates a shadow map
-	static std::unique_ptr<Texture> createColorTexture(int width, int height, GLuint slot); // Creates a color texture
-	static std::unique_ptr<Texture> createMultisampleTexture(int width, int height, GLuint slot); // Creates a multisample texture
+	static std::unique_ptr<Texture> createColorTexture(int width, int height, GLuint slot, GLenum internalFormat = GL_RGBA32F); // Creates a color texture
+	static std::unique_ptr<Texture> createMultisampleTexture(int width, int height, GLuint slot, GLenum internalFormat = GL_RGBA32F); // Creates a multisample texture
+	static std::unique_ptr<Texture> createCubemap(const std::vector<std::string>& faces, GLuint slot); // Loads the 6 faces of a cubemap
 	~Texture();
 
 	// Assigns a texture unit to a texture
 	void texUnit(Shader* shader, const char* uniform);
 	void bind();
+	// Same as above on a given unit, for textures shared between models that each bind them elsewhere
+	void texUnit(Shader* shader, const char* uniform, GLuint unit);
+	void bind(GLuint unit);
+
+	// Moves the finest level on the GPU to level, the levels above the current one come from data (laid out as in the
+	// container) and the ones already resident are copied on the GPU. The GL object is replaced, its unit is kept
+	void setResidentLevel(int level, const unsigned char* data);
+
+private:
+	void upload(const ImageData& image, GLuint slot);
+	void uploadCompressed(const ImageData& image);
 };
 
@@ -0,0 +1,151 @@
+#include "textureCache.h"
+
+#include <filesystem>
+
+#include "texture.h"
+#include "mappedFile.h"
+
+// FNV-1a, continues from hash so several sources can go into one key
+static uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+TextureCache& TextureCache::shared()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureKey TextureCache::getFileKey(const std::string& path, GLenum format)
+{
+	TextureKey key;
+	key.format = format;
+
+	std::error_code error;
+	std::string canonical = std::filesystem::weakly_canonical(path, error).string();
+	if (error)
+		canonical = path;
+	uintmax_t size = std::filesystem::file_size(canonical, error);
+	if (error)
+		return key;
+	auto time = std::filesystem::last_write_time(canonical, error);
+	if (error)
+		return key;
+
+	FileEntry entry;
+	entry.size = static_cast<uint64_t>(size);
+	entry.time = static_cast<int64_t>(time.time_since_epoch().count());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = files.find(canonical);
+		if (it != files.end() && it->second.size == entry.size && it->second.time == entry.time) {
+			key.hash = it->second.hash;
+			key.size = entry.size;
+			return key;
+		}
+	}
+
+	// Hashed outside of the lock, two threads hashing the same file store the same entry
+	MappedFile file(canonical);
+	if (!file.isOpen() || file.size() != entry.size)
+		return key;
+	entry.hash = hashBytes(file.data(), file.size());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	files[canonical] = entry;
+	key.hash = entry.hash;
+	key.size = entry.size;
+	return key;
+}
+
+TextureKey TextureCache::getMemoryKey(const unsigned char* data, size_t size, GLenum format)
+{
+	TextureKey key;
+	key.hash = hashBytes(data, size);
+	key.size = size;
+	key.format = format;
+	return key;
+}
+
+TextureKey TextureCache::getCubemapKey(const std::vector<std::string>& faces)
+{
+	TextureKey key;
+	key.format = GL_TEXTURE_CUBE_MAP;
+	key.hash = 14695981039346656037ull;
+	for (const std::string& face : faces) {
+		TextureKey faceKey = getFileKey(face, 0);
+		if (!faceKey.isValid())
+			return TextureKey();
+		key.hash = hashBytes(reinterpret_cast<const unsigned char*>(&faceKey.hash), sizeof(faceKey.hash), key.hash);
+		key.size += faceKey.size;
+	}
+	return key;
+}
+
+bool TextureCache::contains(const TextureKey& key)
+{
+	if (!key.isValid())
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	return it != textures.end() && !it->second.expired();
+}
+
+std::shared_ptr<Texture> TextureCache::acquire(const TextureKey& key)
+{
+	if (!key.isValid())
+		return nullptr;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	if (it == textures.end())
+		return nullptr;
+
+	std::shared_ptr<Texture> texture = it->second.lock();
+	if (!texture) {
+		textures.erase(it);
+		return nullptr;
+	}
+	hits++;
+	savedBytes += texture->memorySize;
+	return texture;
+}
+
+std::shared_ptr<Texture> TextureCache::insert(const TextureKey& key, std::unique_ptr<Texture> texture)
+{
+	std::shared_ptr<Texture> shared = std::move(texture);
+	misses++;
+	if (!key.isValid())
+		return shared;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::weak_ptr<Texture>& entry = textures[key];
+	if (std::shared_ptr<Texture> existing = entry.lock())
+		return existing;
+	entry = shared;
+	return shared;
+}
+
+int TextureCache::getNumTextures()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int count = 0;
+	for (const auto& [key, texture] : textures)
+		count += texture.expired() ? 0 : 1;
+	return count;
+}
+
+size_t TextureCache::getMemorySize()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t size = 0;
+	for (const auto& [key, texture] : textures) {
+		if (std::shared_ptr<Texture> alive = texture.lock())
+			size += alive->memorySize;
+	}
+	return size;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <cstdint>
+
+class Texture;
+
+// Identity of a GPU texture: what its source bytes hash to and how they were uploaded
+struct TextureKey
+{
+    uint64_t hash = 0;
+    uint64_t size = 0; // Bytes of the source, 0 if it could not be read
+    GLenum format = 0; // Compressed format, 0 for plain RGBA, GL_TEXTURE_CUBE_MAP for skyboxes
+
+    inline bool isValid() const { return size != 0; }
+    inline bool operator<(const TextureKey& other) const { return std::tie(hash, size, format) < std::tie(other.hash, other.size, other.format); }
+};
+
+/**
+ * @class TextureCache
+ * @brief Process-wide table of the GPU textures alive, keyed by the content of their source image.
+ *
+ * Models and skyboxes that reference the same image, even under different paths or embedded in
+ * different files, end up sharing one Texture. The cache only holds weak references: a texture is
+ * freed when the last model or skybox using it is, and the next load decodes it again.
+ *
+ * Keys can be built from any thread, acquire and insert are called from the GL thread.
+ */
+class TextureCache
+{
+public:
+    // Statistics since the start
+    std::atomic<int> hits{ 0 };
+    std::atomic<int> misses{ 0 };
+    std::atomic<size_t> savedBytes{ 0 }; // Video memory the hits did not have to allocate
+
+    static TextureCache& shared();
+
+    /**
+     * @brief Key of an image file, the file is only read again when its size or mtime changes.
+     */
+    TextureKey getFileKey(const std::string& path, GLenum format);
+
+    /**
+     * @brief Key of an image already in memory (embedded in a .glb or a data uri).
+     */
+    static TextureKey getMemoryKey(const unsigned char* data, size_t size, GLenum format);
+
+    /**
+     * @brief Key of a cubemap made of the given face files.
+     */
+    TextureKey getCubemapKey(const std::vector<std::string>& faces);
+
+    /**
+     * @brief Whether a texture with this key is alive, without touching the statistics.
+     */
+    bool contains(const TextureKey& key);
+
+    /**
+     * @brief The texture with this key, counted as a hit, or nullptr if there is none alive.
+     */
+    std::shared_ptr<Texture> acquire(const TextureKey& key);
+
+    /**
+     * @brief Shares a freshly uploaded texture, counted as a miss.
+     *
+     * @return The texture stored under the key, which is a previous one if two loads raced.
+     */
+    std::shared_ptr<Texture> insert(const TextureKey& key, std::unique_ptr<Texture> texture);
+
+    // Textures alive and the video memory they use
+    int getNumTextures();
+    size_t getMemorySize();
+
+private:
+    struct FileEntry {
+        uint64_t size = 0;
+        int64_t time = 0;
+        uint64_t hash = 0;
+    };
+
+    std::mutex mutex;
+    std::map<TextureKey, std::weak_ptr<Texture>> textures;
+    std::map<std::string, FileEntry> files;
+};
@@ -0,0 +1,646 @@
+#include "textureCompressor.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "mappedFile.h"
+
+static const char CONTAINER_MAGIC[4] = { 'N', 'T', 'E', 'X' };
+
+// Identifies the source a container was built from, files by size and mtime, embedded images by their hash
+struct SourceStamp {
+	uint64_t size = 0;
+	int64_t time = 0;
+	uint64_t hash = 0;
+};
+
+struct ContainerHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	int32_t width;
+	int32_t height;
+	uint32_t numLevels;
+	SourceStamp source;
+};
+
+struct ContainerLevel {
+	int32_t width;
+	int32_t height;
+	uint64_t size;
+};
+
+// Interpolation weights of the 4 bit BC7 indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+GLenum TextureCompressor::chooseFormat(int roles)
+{
+	if (roles == TEXTURE_ROLE_NORMAL)
+		return GL_COMPRESSED_RG_RGTC2; // BC5, z is rebuilt in the shaders
+	if (roles == TEXTURE_ROLE_OCCLUSION)
+		return GL_COMPRESSED_RED_RGTC1; // BC4, only red is sampled
+	return GL_COMPRESSED_RGBA_BPTC_UNORM; // BC7
+}
+
+const char* TextureCompressor::getFormatName(GLenum format)
+{
+	switch (format) {
+	case GL_COMPRESSED_RED_RGTC1: return "bc4";
+	case GL_COMPRESSED_RG_RGTC2: return "bc5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return "bc7";
+	default: return "rgba8";
+	}
+}
+
+size_t TextureCompressor::getBlockSize(GLenum format)
+{
+	return format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+std::string TextureCompressor::getContainerPath(const std::string& source, GLenum format)
+{
+	return source + "." + getFormatName(format) + ".ntex";
+}
+
+// ---------------------------------------------------------------------------------------------
+// Block encoders, every block is read as 16 RGBA texels in row order
+// ---------------------------------------------------------------------------------------------
+
+class BitWriter {
+public:
+	BitWriter(unsigned char* output, size_t size) : output(output) { std::memset(output, 0, size); }
+
+	void write(uint32_t value, int numBits)
+	{
+		for (int bit = 0; bit < numBits; bit++, position++) {
+			if ((value >> bit) & 1)
+				output[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+		}
+	}
+
+private:
+	unsigned char* output;
+	int position = 0;
+};
+
+// BC4, one channel with two 8 bit endpoints and 3 bit indices
+static void encodeBlockBC4(const unsigned char values[16], unsigned char* output)
+{
+	unsigned char minValue = 255, maxValue = 0;
+	for (int i = 0; i < 16; i++) {
+		minValue = std::min(minValue, values[i]);
+		maxValue = std::max(maxValue, values[i]);
+	}
+
+	BitWriter writer(output, 8);
+	writer.write(maxValue, 8);
+	writer.write(minValue, 8);
+	if (maxValue == minValue) {
+		writer.write(0, 48);
+		return;
+	}
+
+	// red0 > red1 selects the mode with six interpolated values
+	int palette[8];
+	palette[0] = maxValue;
+	palette[1] = minValue;
+	for (int i = 2; i < 8; i++)
+		palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestError = 256;
+		for (int p = 0; p < 8; p++) {
+			int error = std::abs(palette[p] - values[i]);
+			if (error < bestError) {
+				bestError = error;
+				best = p;
+			}
+		}
+		writer.write(best, 3);
+	}
+}
+
+// Quantizes an RGBA endpoint to 7 bits per channel plus the shared p-bit of BC7 mode 6
+static void quantizeEndpointBC7(const float endpoint[4], int quantized[4], int& pBit)
+{
+	float bestError = 1e30f;
+	for (int p = 0; p < 2; p++) {
+		int candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			int q = static_cast<int>(std::lround((endpoint[c] - p) * 0.5f));
+			candidate[c] = std::clamp(q, 0, 127);
+			float value = static_cast<float>((candidate[c] << 1) | p);
+			error += (value - endpoint[c]) * (value - endpoint[c]);
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			std::copy(candidate, candidate + 4, quantized);
+		}
+	}
+}
+
+// Picks the closest of the 16 interpolated colors for every texel, returns the squared error
+static int assignIndicesBC7(const unsigned char texels[16][4], const int endpoint0[4], const int endpoint1[4], int indices[16])
+{
+	int palette[16][4];
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++)
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoint0[c] + BC7_WEIGHTS[i] * endpoint1[c] + 32) >> 6;
+	}
+
+	int totalError = 0;
+	for (int t = 0; t < 16; t++) {
+		int bestError = INT32_MAX;
+		for (int i = 0; i < 16; i++) {
+			int error = 0;
+			for (int c = 0; c < 4; c++) {
+				int d = palette[i][c] - texels[t][c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				indices[t] = i;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+struct EndpointsBC7 {
+	int endpoint0[4];
+	int endpoint1[4];
+	int pBit0 = 0;
+	int pBit1 = 0;
+	int indices[16];
+	int error = INT32_MAX;
+};
+
+static void fitEndpointsBC7(const unsigned char texels[16][4], const float line0[4], const float line1[4], EndpointsBC7& result)
+{
+	EndpointsBC7 candidate;
+	int q0[4], q1[4];
+	quantizeEndpointBC7(line0, q0, candidate.pBit0);
+	quantizeEndpointBC7(line1, q1, candidate.pBit1);
+	for (int c = 0; c < 4; c++) {
+		candidate.endpoint0[c] = (q0[c] << 1) | candidate.pBit0;
+		candidate.endpoint1[c] = (q1[c] << 1) | candidate.pBit1;
+	}
+	candidate.error = assignIndicesBC7(texels, candidate.endpoint0, candidate.endpoint1, candidate.indices);
+	if (candidate.error < result.error)
+		result = candidate;
+}
+
+// BC7 mode 6, a single RGBA subset with 7.7.7.7 endpoints, per endpoint p-bits and 4 bit indices
+static void encodeBlockBC7(const unsigned char texels[16][4], unsigned char* output)
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int t = 0; t < 16; t++) {
+		for (int c = 0; c < 4; c++)
+			mean[c] += texels[t][c] / 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int t = 0; t < 16; t++) {
+		float d[4];
+		for (int c = 0; c < 4; c++)
+			d[c] = texels[t][c] - mean[c];
+		for (int a = 0; a < 4; a++) {
+			for (int b = 0; b < 4; b++)
+				covariance[a][b] += d[a] * d[b];
+		}
+	}
+
+	// Principal axis by power iteration
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		for (int a = 0; a < 4; a++) {
+			for (int b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+		}
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float minProjection = 0.0f, maxProjection = 0.0f;
+	for (int t = 0; t < 16; t++) {
+		float projection = 0.0f;
+		for (int c = 0; c < 4; c++)
+			projection += (texels[t][c] - mean[c]) * axis[c];
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	float line0[4], line1[4];
+	for (int c = 0; c < 4; c++) {
+		line0[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+		line1[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+	}
+
+	EndpointsBC7 best;
+	fitEndpointsBC7(texels, line0, line1, best);
+
+	// Least squares refit of the endpoints for the chosen indices
+	for (int iteration = 0; iteration < 2 && best.error > 0; iteration++) {
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int t = 0; t < 16; t++) {
+			float w = BC7_WEIGHTS[best.indices[t]] / 64.0f;
+			aa += (1.0f - w) * (1.0f - w);
+			ab += (1.0f - w) * w;
+			bb += w * w;
+			for (int c = 0; c < 4; c++) {
+				ax[c] += (1.0f - w) * texels[t][c];
+				bx[c] += w * texels[t][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f)
+			break;
+
+		for (int c = 0; c < 4; c++) {
+			line0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+			line1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+		}
+		fitEndpointsBC7(texels, line0, line1, best);
+	}
+
+	// The anchor texel stores only 3 bits, its index must be below 8
+	if (best.indices[0] >= 8) {
+		std::swap(best.endpoint0, best.endpoint1);
+		std::swap(best.pBit0, best.pBit1);
+		for (int t = 0; t < 16; t++)
+			best.indices[t] = 15 - best.indices[t];
+	}
+
+	BitWriter writer(output, 16);
+	writer.write(1 << 6, 7); // Mode 6
+	for (int c = 0; c < 4; c++) {
+		writer.write(best.endpoint0[c] >> 1, 7);
+		writer.write(best.endpoint1[c] >> 1, 7);
+	}
+	writer.write(best.pBit0, 1);
+	writer.write(best.pBit1, 1);
+	writer.write(best.indices[0], 3);
+	for (int t = 1; t < 16; t++)
+		writer.write(best.indices[t], 4);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Mip chain
+// ---------------------------------------------------------------------------------------------
+
+// Expands the decoded image to RGBA the same way glTexImage2D would (GL_RED fills green and blue with 0)
+static std::vector<unsigned char> expandToRGBA(const ImageData& image, GLenum format)
+{
+	size_t numTexels = static_cast<size_t>(image.width) * image.height;
+	std::vector<unsigned char> rgba(numTexels * 4);
+	for (size_t i = 0; i < numTexels; i++) {
+		const unsigned char* src = image.bytes + i * image.numColCh;
+		unsigned char* dst = rgba.data() + i * 4;
+		if (image.numColCh == 2) {
+			if (format == GL_COMPRESSED_RG_RGTC2) {
+				// Two channel normal maps only store x and y, z is rebuilt so the mips renormalize whole normals
+				float x = src[0] / 127.5f - 1.0f, y = src[1] / 127.5f - 1.0f;
+				float z = std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = static_cast<unsigned char>(std::lround((z + 1.0f) * 127.5f));
+				dst[3] = 255;
+			}
+			else {
+				// Grey and alpha
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = src[1];
+			}
+			continue;
+		}
+		dst[0] = src[0];
+		dst[1] = image.numColCh >= 3 ? src[1] : 0;
+		dst[2] = image.numColCh >= 3 ? src[2] : 0;
+		dst[3] = image.numColCh == 4 ? src[3] : 255;
+	}
+	return rgba;
+}
+
+// 2x2 box filter, odd sizes clamp to the last row or column
+static std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height, int newWidth, int newHeight, bool normalMap)
+{
+	std::vector<unsigned char> result(static_cast<size_t>(newWidth) * newHeight * 4);
+	for (int y = 0; y < newHeight; y++) {
+		int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < newWidth; x++) {
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			float sum[4];
+			for (int c = 0; c < 4; c++) {
+				sum[c] = (rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+					+ rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c]) / 4.0f;
+			}
+
+			// Averaged normals get shorter, put them back on the unit sphere
+			if (normalMap) {
+				float n[3], length = 0.0f;
+				for (int c = 0; c < 3; c++) {
+					n[c] = sum[c] / 127.5f - 1.0f;
+					length += n[c] * n[c];
+				}
+				length = std::sqrt(length);
+				if (length > 1e-6f) {
+					for (int c = 0; c < 3; c++)
+						sum[c] = (n[c] / length + 1.0f) * 127.5f;
+				}
+			}
+
+			unsigned char* dst = result.data() + (static_cast<size_t>(y) * newWidth + x) * 4;
+			for (int c = 0; c < 4; c++)
+				dst[c] = static_cast<unsigned char>(std::clamp(std::lround(sum[c]), 0L, 255L));
+		}
+	}
+	return result;
+}
+
+static void compressLevel(const std::vector<unsigned char>& rgba, int width, int height, GLenum format, unsigned char* output)
+{
+	size_t blockSize = TextureCompressor::getBlockSize(format);
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			// Texels past the edge repeat the last row or column
+			unsigned char texels[16][4];
+			for (int t = 0; t < 16; t++) {
+				int x = std::min(bx * 4 + t % 4, width - 1);
+				int y = std::min(by * 4 + t / 4, height - 1);
+				std::memcpy(texels[t], rgba.data() + (static_cast<size_t>(y) * width + x) * 4, 4);
+			}
+
+			unsigned char* block = output + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+			if (format == GL_COMPRESSED_RED_RGTC1 || format == GL_COMPRESSED_RG_RGTC2) {
+				int numChannels = format == GL_COMPRESSED_RED_RGTC1 ? 1 : 2;
+				for (int c = 0; c < numChannels; c++) {
+					unsigned char values[16];
+					for (int t = 0; t < 16; t++)
+						values[t] = texels[t][c];
+					encodeBlockBC4(values, block + c * 8);
+				}
+			}
+			else {
+				encodeBlockBC7(texels, block);
+			}
+		}
+	}
+}
+
+void TextureCompressor::compress(ImageData& image, GLenum format)
+{
+	if (!image.bytes)
+		return;
+	if (image.numColCh < 1 || image.numColCh > 4) {
+		std::cerr << "Texture " << image.index << " left uncompressed: " << image.numColCh << " channels are not supported" << std::endl;
+		return;
+	}
+
+	bool normalMap = format == GL_COMPRESSED_RG_RGTC2;
+	size_t blockSize = getBlockSize(format);
+
+	std::vector<unsigned char> rgba = expandToRGBA(image, format);
+	int width = image.width, height = image.height;
+
+	image.levels.clear();
+	image.compressed.clear();
+
+	while (true) {
+		MipLevel level;
+		level.width = width;
+		level.height = height;
+		level.offset = image.compressed.size();
+		level.size = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+
+		image.compressed.resize(level.offset + level.size);
+		compressLevel(rgba, width, height, format, image.compressed.data() + level.offset);
+		image.levels.push_back(level);
+
+		if (width == 1 && height == 1)
+			break;
+
+		int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+		rgba = downsample(rgba, width, height, newWidth, newHeight, normalMap);
+		width = newWidth;
+		height = newHeight;
+	}
+
+	image.compressedFormat = format;
+	stbi_image_free(image.bytes);
+	image.bytes = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Container
+// ---------------------------------------------------------------------------------------------
+
+static bool getSourceStamp(const std::string& path, SourceStamp& stamp)
+{
+	std::error_code error;
+	uintmax_t size = std::filesystem::file_size(path, error);
+	if (error)
+		return false;
+	auto time = std::filesystem::last_write_time(path, error);
+	if (error)
+		return false;
+
+	stamp.size = static_cast<uint64_t>(size);
+	stamp.time = static_cast<int64_t>(time.time_since_epoch().count());
+	return true;
+}
+
+// FNV-1a, embedded images have no mtime of their own
+static SourceStamp getMemoryStamp(const unsigned char* data, size_t size)
+{
+	SourceStamp stamp;
+	stamp.size = size;
+	stamp.hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		stamp.hash ^= data[i];
+		stamp.hash *= 1099511628211ull;
+	}
+	return stamp;
+}
+
+// First level of at most streamSize texels, the finer ones are left to the TextureStreamer. 0 keeps every level
+static int getFirstStreamedLevel(const std::vector<MipLevel>& levels, int streamSize)
+{
+	if (streamSize <= 0)
+		return 0;
+	for (size_t level = 0; level < levels.size(); level++) {
+		if (std::max(levels[level].width, levels[level].height) <= streamSize)
+			return static_cast<int>(level);
+	}
+	return static_cast<int>(levels.size()) - 1;
+}
+
+static bool readContainer(const std::string& path, GLenum format, const SourceStamp& stamp, int streamSize, ImageData& image)
+{
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+		return false;
+
+	MappedFile file(path);
+	if (!file.isOpen() || file.size() < sizeof(ContainerHeader))
+		return false;
+
+	ContainerHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0 || header.version != TextureCompressor::VERSION
+		|| header.format != format || header.source.size != stamp.size || header.source.time != stamp.time || header.source.hash != stamp.hash)
+		return false;
+
+	size_t offset = sizeof(header);
+	if (header.numLevels == 0 || header.numLevels > 32 || file.size() - offset < header.numLevels * sizeof(ContainerLevel))
+		return false;
+
+	std::vector<MipLevel> levels(header.numLevels);
+	size_t payloadSize = 0;
+	for (MipLevel& level : levels) {
+		ContainerLevel stored;
+		std::memcpy(&stored, file.data() + offset, sizeof(stored));
+		offset += sizeof(stored);
+
+		level.width = stored.width;
+		level.height = stored.height;
+		level.offset = payloadSize;
+		level.size = static_cast<size_t>(stored.size);
+		if (level.size != static_cast<size_t>((level.width + 3) / 4) * ((level.height + 3) / 4) * TextureCompressor::getBlockSize(format))
+			return false;
+		payloadSize += level.size;
+	}
+
+	if (file.size() - offset != payloadSize)
+		return false;
+
+	image.width = header.width;
+	image.height = header.height;
+	image.numColCh = 4;
+	image.compressedFormat = format;
+	image.levels = std::move(levels);
+	image.firstLevel = getFirstStreamedLevel(image.levels, streamSize);
+	image.compressed.assign(file.data() + offset + image.levels[image.firstLevel].offset, file.data() + offset + payloadSize);
+	if (streamSize > 0) {
+		image.container = path;
+		image.containerOffset = offset;
+	}
+	return true;
+}
+
+static bool writeContainer(const std::string& path, const SourceStamp& stamp, const ImageData& image)
+{
+	ContainerHeader header;
+	std::memcpy(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+	header.version = TextureCompressor::VERSION;
+	header.format = image.compressedFormat;
+	header.width = image.width;
+	header.height = image.height;
+	header.numLevels = static_cast<uint32_t>(image.levels.size());
+	header.source = stamp;
+
+	// Written under a temporary name so another load never reads half a file, unique as two loader threads can
+	// compress the same texture at once
+	static std::atomic<unsigned int> nextTemporary{ 0 };
+	std::string temporaryPath = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+		+ "." + std::to_string(nextTemporary++) + ".tmp";
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const MipLevel& level : image.levels) {
+			ContainerLevel stored = { level.width, level.height, level.size };
+			output.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+		}
+		output.write(reinterpret_cast<const char*>(image.compressed.data()), image.compressed.size());
+		if (!output) {
+			std::cerr << "Failed to write the compressed texture " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::cerr << "Failed to write the compressed texture " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
+
+// A freshly built chain that made it to disk drops the levels the TextureStreamer reads back later
+static void streamFromContainer(const std::string& path, int streamSize, ImageData& image)
+{
+	if (streamSize <= 0)
+		return;
+
+	image.firstLevel = getFirstStreamedLevel(image.levels, streamSize);
+	image.compressed.erase(image.compressed.begin(), image.compressed.begin() + image.levels[image.firstLevel].offset);
+	image.compressed.shrink_to_fit();
+	image.container = path;
+	image.containerOffset = sizeof(ContainerHeader) + image.levels.size() * sizeof(ContainerLevel);
+}
+
+// ---------------------------------------------------------------------------------------------
+
+ImageData TextureCompressor::load(const std::string& containerPath, GLenum format, const std::string& imagePath, int index, int streamSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ImageData image;
+	image.index = index;
+
+	SourceStamp stamp;
+	bool hasStamp = getSourceStamp(imagePath, stamp);
+	if (hasStamp && readContainer(containerPath, format, stamp, streamSize, image)) {
+		image.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return image;
+	}
+
+	image = ImageData::decode(imagePath, index);
+	compress(image, format);
+	if (image.isCompressed() && hasStamp && writeContainer(containerPath, stamp, image))
+		streamFromContainer(containerPath, streamSize, image);
+
+	image.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return image;
+}
+
+ImageData TextureCompressor::load(const std::string& containerPath, GLenum format, const unsigned char* encoded, size_t size, int index, int streamSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ImageData image;
+	image.index = index;
+
+	SourceStamp stamp = getMemoryStamp(encoded, size);
+	if (readContainer(containerPath, format, stamp, streamSize, image)) {
+		image.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return image;
+	}
+
+	image = ImageData::decode(encoded, size, index);
+	compress(image, format);
+	if (image.isCompressed() && writeContainer(containerPath, stamp, image))
+		streamFromContainer(containerPath, streamSize, image);
+
+	image.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return image;
+}
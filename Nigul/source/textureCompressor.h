@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+
+#include "texture.h"
+
+// How materials sample a texture, a texture shared by several slots has several roles
+enum TextureRole {
+	TEXTURE_ROLE_BASE_COLOR = 1 << 0,
+	TEXTURE_ROLE_METALLIC_ROUGHNESS = 1 << 1,
+	TEXTURE_ROLE_NORMAL = 1 << 2,
+	TEXTURE_ROLE_OCCLUSION = 1 << 3,
+	TEXTURE_ROLE_EMISSIVE = 1 << 4
+};
+
+/**
+ * @class TextureCompressor
+ * @brief Turns decoded images into block compressed mip chains and keeps them on disk.
+ *
+ * The format follows the role of the texture: BC5 for normal maps (the shaders rebuild z),
+ * BC4 for occlusion maps and BC7 for everything else. The first load decodes the image, builds
+ * the whole mip chain on the CPU, compresses it and writes it into a small container next to the
+ * source (<image>.<format>.ntex). Later loads read the container back as long as the source has
+ * not changed, so neither decoding nor glGenerateMipmap run again.
+ *
+ * Nothing in here touches OpenGL, everything can run on the worker pool.
+ */
+class TextureCompressor
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    /**
+     * @brief Compressed format used for a set of TextureRole flags.
+     */
+    static GLenum chooseFormat(int roles);
+
+    static const char* getFormatName(GLenum format);
+
+    /**
+     * @brief Bytes per 4x4 block of a compressed format.
+     */
+    static size_t getBlockSize(GLenum format);
+
+    /**
+     * @brief Path of the container that holds a source in the given format.
+     *
+     * @param source Image file, or any unique name next to the model for embedded images.
+     */
+    static std::string getContainerPath(const std::string& source, GLenum format);
+
+    /**
+     * @brief Reads the container of an image file, rebuilding it if it is missing or stale.
+     *
+     * @param streamSize If not 0, only the levels of at most streamSize texels are kept in memory and the image
+     * remembers its container so the TextureStreamer can read the finer ones later.
+     */
+    static ImageData load(const std::string& containerPath, GLenum format, const std::string& imagePath, int index = -1, int streamSize = 0);
+
+    /**
+     * @brief Same as above for an image that is already in memory (embedded in a .glb or a buffer).
+     */
+    static ImageData load(const std::string& containerPath, GLenum format, const unsigned char* encoded, size_t size, int index = -1, int streamSize = 0);
+
+    /**
+     * @brief Builds the mip chain of a decoded image and compresses every level.
+     *
+     * The decoded pixels are freed, on failure the image is left uncompressed.
+     */
+    static void compress(ImageData& image, GLenum format);
+};
@@ -0,0 +1,220 @@
+#include "texturePool.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "texture.h"
+
+TexturePool& TexturePool::shared()
+{
+	static TexturePool pool;
+	return pool;
+}
+
+TexturePool::TexturePool()
+{
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxUnits);
+	if (!hasArrayUnits()) {
+		std::cerr << "Texture arrays need units " << FIRST_UNIT << " to " << FIRST_UNIT + MAX_ARRAYS - 1
+			<< " but the context has " << maxUnits << ", material textures stay standalone" << std::endl;
+	}
+}
+
+void TexturePool::setBindless(GetTextureHandle getHandle, SetTextureHandleResidency makeResident, SetTextureHandleResidency makeNonResident)
+{
+	this->getHandle = getHandle;
+	this->makeResident = makeResident;
+	this->makeNonResident = makeNonResident;
+}
+
+void TexturePool::add(Texture* texture)
+{
+	if (isBindless()) {
+		texture->handle = getHandle(texture->ID);
+		makeResident(texture->handle);
+		numTextures++;
+		return;
+	}
+	if (!hasArrayUnits())
+		return;
+
+	GLenum format = texture->getFormat();
+	int width = texture->getStorageWidth();
+	int height = texture->getStorageHeight();
+	int numLevels = texture->getNumLevels();
+
+	// An array of the same shape, else a free one
+	int arrayIndex = -1;
+	for (int i = 0; i < MAX_ARRAYS; i++) {
+		const Array& array = arrays[i];
+		if (array.ID && array.format == format && array.width == width && array.height == height && array.numLevels == numLevels) {
+			arrayIndex = i;
+			break;
+		}
+		if (!array.ID && arrayIndex < 0)
+			arrayIndex = i;
+	}
+	if (arrayIndex < 0)
+		return; // Every array holds another shape, the texture stays bound by its material
+
+	Array& array = arrays[arrayIndex];
+	if (!array.ID) {
+		array.format = format;
+		array.width = width;
+		array.height = height;
+		array.numLevels = numLevels;
+		array.layerSize = texture->memorySize;
+		array.layers.assign(INITIAL_LAYERS, nullptr);
+		glGenTextures(1, &array.ID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.ID);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, format, width, height, INITIAL_LAYERS);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	auto freeLayer = std::find(array.layers.begin(), array.layers.end(), nullptr);
+	if (freeLayer == array.layers.end()) {
+		resize(arrayIndex, static_cast<int>(array.layers.size()) * 2);
+		freeLayer = std::find(array.layers.begin(), array.layers.end(), nullptr);
+	}
+	int layer = static_cast<int>(freeLayer - array.layers.begin());
+
+	for (int level = 0; level < numLevels; level++) {
+		glCopyImageSubData(texture->ID, GL_TEXTURE_2D, level, 0, 0, 0, array.ID, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+			std::max(width >> level, 1), std::max(height >> level, 1), 1);
+	}
+
+	array.layers[layer] = texture;
+	array.numUsed++;
+	texture->arrayIndex = arrayIndex;
+	texture->layer = layer;
+	makeView(texture, array);
+	numTextures++;
+}
+
+void TexturePool::remove(Texture* texture)
+{
+	if (texture->handle) {
+		makeNonResident(texture->handle);
+		texture->handle = 0;
+		numTextures--;
+		return;
+	}
+	if (texture->arrayIndex < 0)
+		return;
+
+	// The view of the texture keeps the storage alive until it is deleted as well
+	Array& array = arrays[texture->arrayIndex];
+	array.layers[texture->layer] = nullptr;
+	array.numUsed--;
+	int arrayIndex = texture->arrayIndex;
+	texture->arrayIndex = -1;
+	texture->layer = -1;
+	numTextures--;
+	if (array.numUsed == 0) {
+		glDeleteTextures(1, &array.ID);
+		array = Array();
+		return;
+	}
+
+	// Halves the array while three quarters of it are past the last used layer, so unloading a scene
+	// gives the memory back. Free layers below the last used one are reused by the next add.
+	int numLayers = static_cast<int>(array.layers.size());
+	int lastUsed = numLayers - 1;
+	while (!array.layers[lastUsed])
+		lastUsed--;
+	int newLayers = numLayers;
+	while (newLayers > INITIAL_LAYERS && lastUsed < newLayers / 4)
+		newLayers /= 2;
+	if (newLayers < numLayers)
+		resize(arrayIndex, newLayers);
+}
+
+void TexturePool::resize(int arrayIndex, int numLayers)
+{
+	Array& array = arrays[arrayIndex];
+	int keptLayers = std::min(static_cast<int>(array.layers.size()), numLayers);
+	GLuint oldID = array.ID;
+
+	glGenTextures(1, &array.ID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.ID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.numLevels, array.format, array.width, array.height, numLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	for (int level = 0; level < array.numLevels; level++) {
+		glCopyImageSubData(oldID, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, array.ID, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+			std::max(array.width >> level, 1), std::max(array.height >> level, 1), keptLayers);
+	}
+	array.layers.resize(numLayers, nullptr);
+
+	// Views cannot be moved to another storage, every texture of the array gets a new one
+	for (Texture* texture : array.layers) {
+		if (texture)
+			makeView(texture, array);
+	}
+	glDeleteTextures(1, &oldID);
+}
+
+void TexturePool::makeView(Texture* texture, const Array& array)
+{
+	GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	glBindTexture(GL_TEXTURE_2D, texture->ID);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+
+	GLuint view = 0;
+	glGenTextures(1, &view);
+	glTextureView(view, GL_TEXTURE_2D, array.ID, array.format, 0, array.numLevels, texture->layer, 1);
+	glBindTexture(GL_TEXTURE_2D, view);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glDeleteTextures(1, &texture->ID);
+	texture->ID = view;
+}
+
+static const ShaderUniform<int> textureArraysUniform("textureArrays");
+
+void TexturePool::bind(Shader* shader) const
+{
+	// Every uniform is set, even for unused arrays, so no array sampler shares a unit with a 2D sampler
+	GLuint textures[MAX_ARRAYS];
+	int units[MAX_ARRAYS];
+	if (!hasArrayUnits()) {
+		// Nothing is in the arrays, their samplers only need a unit of their own: the last one
+		std::fill(units, units + MAX_ARRAYS, std::max(maxUnits - 1, 0));
+		shader->set(textureArraysUniform, units, MAX_ARRAYS);
+		return;
+	}
+	for (int i = 0; i < MAX_ARRAYS; i++) {
+		textures[i] = arrays[i].ID;
+		units[i] = static_cast<int>(FIRST_UNIT) + i;
+	}
+	glBindTextures(FIRST_UNIT, MAX_ARRAYS, textures);
+	shader->set(textureArraysUniform, units, MAX_ARRAYS);
+}
+
+int TexturePool::getNumArrays() const
+{
+	int count = 0;
+	for (const Array& array : arrays)
+		count += array.ID != 0;
+	return count;
+}
+
+size_t TexturePool::getMemorySize() const
+{
+	size_t size = 0;
+	for (const Array& array : arrays)
+		size += array.layerSize * array.layers.size();
+	return size;
+}
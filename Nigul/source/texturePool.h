@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+class Texture;
+class Shader;
+
+/**
+ * @class TexturePool
+ * @brief Makes every material texture addressable from the shaders without binding it.
+ *
+ * Where GL_ARB_bindless_texture is supported each texture gets a resident handle. Otherwise textures
+ * are grouped by format, size and number of levels into texture arrays: the levels of a texture are
+ * copied into a free layer and the texture itself becomes a view of that layer, so it takes no more
+ * memory than before and can still be bound on its own. Materials reference a handle or an
+ * (array, layer) pair through the GpuScene, a whole pass binds the arrays once.
+ *
+ * Textures whose shape does not fit in one of the MAX_ARRAYS arrays stay standalone and are bound
+ * by their material as before, so do all textures when the context has too few texture units for the
+ * arrays. An array shrinks again as its last layers are freed and is deleted with its last texture.
+ * Everything runs on the GL thread, the pool is first used once the context is current.
+ */
+class TexturePool
+{
+public:
+    static const int MAX_ARRAYS = 16; // Same as MAX_TEXTURE_ARRAYS in the shaders
+    static const GLuint FIRST_UNIT = 60; // Arrays are bound to the units from here on
+    static const int INITIAL_LAYERS = 4;
+
+    typedef GLuint64 (APIENTRYP GetTextureHandle)(GLuint texture);
+    typedef void (APIENTRYP SetTextureHandleResidency)(GLuint64 handle);
+
+    static TexturePool& shared();
+
+    /**
+     * @brief Switches to bindless handles, before any texture is added. Called once the extension is found.
+     */
+    void setBindless(GetTextureHandle getHandle, SetTextureHandleResidency makeResident, SetTextureHandleResidency makeNonResident);
+    inline bool isBindless() const { return getHandle != nullptr; }
+
+    /**
+     * @brief Makes a material texture addressable, called by Texture once its levels are uploaded.
+     */
+    void add(Texture* texture);
+
+    /**
+     * @brief Called by Texture before its GL object goes away.
+     */
+    void remove(Texture* texture);
+
+    /**
+     * @brief Binds every array to its unit and points the textureArrays uniform of shader at them.
+     */
+    void bind(Shader* shader) const;
+
+    /**
+     * @brief Whether the arrays have their texture units, false falls back to standalone textures.
+     */
+    inline bool hasArrayUnits() const { return FIRST_UNIT + MAX_ARRAYS <= static_cast<GLuint>(maxUnits); }
+
+    // Statistics
+    int getNumArrays() const;
+    int getNumTextures() const { return numTextures; }
+    size_t getMemorySize() const;
+
+private:
+    TexturePool();
+
+    struct Array {
+        GLuint ID = 0;
+        GLenum format = 0;
+        int width = 0;
+        int height = 0;
+        int numLevels = 0;
+        size_t layerSize = 0; // Bytes of one layer, every level included
+        std::vector<Texture*> layers; // nullptr for a free layer
+        int numUsed = 0;
+    };
+
+    // Moves the array to a new storage of numLayers layers, the layers kept do not change index
+    void resize(int arrayIndex, int numLayers);
+    // Replaces the GL object of the texture with a view of its layer, keeping its filtering
+    void makeView(Texture* texture, const Array& array);
+
+    GetTextureHandle getHandle = nullptr;
+    SetTextureHandleResidency makeResident = nullptr;
+    SetTextureHandleResidency makeNonResident = nullptr;
+
+    GLint maxUnits = 0; // GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS
+    Array arrays[MAX_ARRAYS];
+    int numTextures = 0;
+};
@@ -0,0 +1,175 @@
+#include "textureStreamer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+
+#include "texture.h"
+
+// Frames a texture may go unused before it counts as not visible
+static const uint64_t VISIBLE_FRAMES = 2;
+
+TextureStreamer& TextureStreamer::shared()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Reads still on the pool push into this queue
+	while (numPendingReads > 0) {
+		reads.waitPop();
+		numPendingReads--;
+	}
+}
+
+void TextureStreamer::add(Texture* texture)
+{
+	uint64_t id = nextId++;
+	StreamState& state = states[id];
+	state.texture = texture;
+	state.baseLevel = texture->residentLevel;
+	ids[texture] = id;
+}
+
+void TextureStreamer::remove(Texture* texture)
+{
+	// A read still in flight is dropped when it comes back
+	auto it = ids.find(texture);
+	if (it == ids.end())
+		return;
+	states.erase(it->second);
+	ids.erase(it);
+}
+
+void TextureStreamer::markUsed(Texture* texture, float screenSize)
+{
+	auto it = ids.find(texture);
+	if (it == ids.end())
+		return;
+
+	StreamState& state = states[it->second];
+	if (state.lastUsedFrame != frame)
+		state.screenSize = 0.0f;
+	state.lastUsedFrame = frame;
+	state.screenSize = std::max(state.screenSize, screenSize);
+}
+
+int TextureStreamer::getWantedLevel(const Texture* texture, float screenSize) const
+{
+	const MipLevel& top = texture->levels[0];
+	int lastLevel = static_cast<int>(texture->levels.size()) - 1;
+	if (screenSize <= 0.0f)
+		return lastLevel;
+
+	// One texel per pixel across the largest side
+	float level = std::log2(std::max(top.width, top.height) / screenSize) + lodBias;
+	return std::clamp(static_cast<int>(std::floor(level)), 0, lastLevel);
+}
+
+void TextureStreamer::evictLevel(StreamState& state)
+{
+	Texture* texture = state.texture;
+	residentBytes -= texture->levels[texture->residentLevel].size;
+	texture->setResidentLevel(texture->residentLevel + 1, nullptr);
+	numEvicted++;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const StreamState* requester)
+{
+	while (residentBytes + pendingBytes + bytes > budget) {
+		// Least recently used first, textures drawn right now only give up levels finer than they need
+		StreamState* victim = nullptr;
+		for (auto& [id, state] : states) {
+			Texture* texture = state.texture;
+			if (&state == requester || state.reading || texture->residentLevel >= state.baseLevel)
+				continue;
+			bool visible = state.lastUsedFrame + VISIBLE_FRAMES > frame;
+			if (visible && texture->residentLevel >= getWantedLevel(texture, state.screenSize))
+				continue;
+			if (!victim || state.lastUsedFrame < victim->lastUsedFrame
+				|| (state.lastUsedFrame == victim->lastUsedFrame && state.screenSize < victim->screenSize))
+				victim = &state;
+		}
+
+		if (!victim)
+			return false;
+		evictLevel(*victim);
+	}
+	return true;
+}
+
+void TextureStreamer::update()
+{
+	// Levels read since the last frame go to the GPU
+	ReadResult result;
+	while (reads.tryPop(result)) {
+		numPendingReads--;
+		pendingBytes -= result.reservedBytes;
+
+		auto it = states.find(result.id);
+		if (it == states.end())
+			continue; // The texture is gone
+		StreamState& state = it->second;
+		state.reading = false;
+
+		Texture* texture = state.texture;
+		if (result.data.empty() || result.endLevel != texture->residentLevel)
+			continue;
+		texture->setResidentLevel(result.level, result.data.data());
+		numStreamedIn += result.endLevel - result.level;
+	}
+
+	residentBytes = 0;
+	for (auto& [id, state] : states)
+		residentBytes += state.texture->memorySize;
+	numTextures = static_cast<int>(states.size());
+
+	if (enabled) {
+		// Stays in budget when it is lowered
+		makeRoom(0, nullptr);
+
+		// Visible textures missing levels, the largest ones on screen first
+		std::vector<std::pair<uint64_t, StreamState*>> requests;
+		for (auto& [id, state] : states) {
+			bool visible = state.lastUsedFrame + VISIBLE_FRAMES > frame;
+			if (visible && !state.reading && getWantedLevel(state.texture, state.screenSize) < state.texture->residentLevel)
+				requests.push_back({ id, &state });
+		}
+		std::sort(requests.begin(), requests.end(), [](const auto& a, const auto& b) { return a.second->screenSize > b.second->screenSize; });
+
+		ThreadPool& pool = ThreadPool::shared();
+		for (auto& [id, state] : requests) {
+			if (numPendingReads >= maxPendingReads)
+				break;
+
+			// One level at a time, so every texture gets sharper before any gets its finest level
+			Texture* texture = state->texture;
+			ReadResult read;
+			read.id = id;
+			read.endLevel = texture->residentLevel;
+			read.level = read.endLevel - 1;
+			const MipLevel& mip = texture->levels[read.level];
+			read.reservedBytes = mip.size;
+			if (!makeRoom(read.reservedBytes, state))
+				break;
+
+			state->reading = true;
+			pendingBytes += read.reservedBytes;
+			numPendingReads++;
+
+			std::string container = texture->container;
+			size_t offset = texture->containerOffset + mip.offset;
+			pool.submit([this, container, offset, read]() mutable {
+				std::ifstream input(container, std::ios::binary);
+				read.data.resize(read.reservedBytes);
+				if (!input.seekg(offset) || !input.read(reinterpret_cast<char*>(read.data.data()), read.data.size()))
+					read.data.clear();
+				reads.push(std::move(read));
+			});
+		}
+	}
+
+	frame++;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#include "threadPool.h"
+
+class Texture;
+
+/**
+ * @class TextureStreamer
+ * @brief Streams the fine mip levels of block compressed textures in and out of video memory.
+ *
+ * Models upload only the levels of at most initialSize texels, so a scene shows up as soon as its
+ * coarse levels are in. Every frame the renderer reports how large each material is on screen, the
+ * streamer picks the level each texture needs from that, reads the missing levels from the
+ * texture's container on the worker pool and uploads them on the GL thread, one level at a time
+ * and the largest textures on screen first. When the resident levels of every texture would go
+ * over budget, the fine levels of the least recently used textures are evicted first.
+ *
+ * Everything but the file reads runs on the GL thread.
+ */
+class TextureStreamer
+{
+public:
+    bool enabled = true;
+    size_t budget = size_t(512) << 20; // Bytes of video memory for every streamed texture together
+    int initialSize = 128; // Levels up to this size are uploaded by the load and never evicted
+    int maxPendingReads = 4;
+    float lodBias = 0.0f; // Positive values stream coarser levels
+
+    // Statistics of the last update
+    size_t residentBytes = 0;
+    int numTextures = 0;
+    int numPendingReads = 0;
+    int numStreamedIn = 0; // Levels uploaded since the start
+    int numEvicted = 0; // Levels dropped since the start
+
+    ~TextureStreamer();
+
+    static TextureStreamer& shared();
+
+    /**
+     * @brief Starts tracking a texture built from a container, called by Texture on upload.
+     */
+    void add(Texture* texture);
+    void remove(Texture* texture);
+
+    /**
+     * @brief Records that a texture is drawn this frame covering screenSize pixels.
+     */
+    void markUsed(Texture* texture, float screenSize);
+
+    /**
+     * @brief Uploads the levels read since the last call, then evicts and requests levels. Once per frame.
+     */
+    void update();
+
+    /**
+     * @brief Level of a texture that matches screenSize pixels.
+     */
+    int getWantedLevel(const Texture* texture, float screenSize) const;
+
+private:
+    struct StreamState {
+        Texture* texture = nullptr;
+        uint64_t lastUsedFrame = 0;
+        float screenSize = 0.0f; // Largest size drawn at in lastUsedFrame
+        int baseLevel = 0; // Coarsest level that may be evicted
+        bool reading = false;
+    };
+
+    // Levels [level, endLevel) read from the container of a texture
+    struct ReadResult {
+        uint64_t id = 0;
+        int level = 0;
+        int endLevel = 0;
+        size_t reservedBytes = 0;
+        std::vector<unsigned char> data; // Empty if the read failed
+    };
+
+    void evictLevel(StreamState& state);
+    // Evicts levels until bytes more fit in the budget, false if not enough can be evicted
+    bool makeRoom(size_t bytes, const StreamState* requester);
+
+    std::unordered_map<uint64_t, StreamState> states;
+    std::unordered_map<const Texture*, uint64_t> ids;
+    uint64_t nextId = 1;
+    uint64_t frame = 1;
+    size_t pendingBytes = 0; // Levels being read, counted against the budget already
+
+    ConcurrentQueue<ReadResult> reads;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads that run submitted tasks in FIFO order.
+ *
+ * Workers never touch OpenGL, tasks that produce GPU data must hand it back to the
+ * GL thread (see ConcurrentQueue).
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Creates the workers.
+     *
+     * @param numThreads Number of workers, 0 means one per hardware thread.
+     */
+    ThreadPool(size_t numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task to be run by the first free worker.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Blocks until every submitted task has finished.
+     */
+    void wait();
+
+    inline size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Pool shared by the whole engine, created on first use.
+     */
+    static ThreadPool& shared();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksDone;
+
+    size_t pendingTasks = 0;
+    bool stopping = false;
+};
+
+/**
+ * @class ConcurrentQueue
+ * @brief Minimal multi-producer queue used to hand finished work back to the GL thread.
+ */
+template <typename T>
+class ConcurrentQueue
+{
+public:
+    void push(T value)
+    {
+        // Notified under the lock, the consumer may destroy the queue as soon as it pops the last item
+        std::lock_guard<std::mutex> lock(mutex);
+        items.push(std::move(value));
+        available.notify_one();
+    }
+
+    // Blocks until an item is available
+    T waitPop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return !items.empty(); });
+        T value = std::move(items.front());
+        items.pop();
+        return value;
+    }
+
+    // Returns false if the queue is empty
+    bool tryPop(T& value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty())
+            return false;
+        value = std::move(items.front());
+        items.pop();
+        return true;
+    }
+
+private:
+    std::queue<T> items;
+    std::mutex mutex;
+    std::condition_variable available;
+};